@@ -111,8 +111,8 @@ public extension Image {
         }
 
         // 2) Try and create the image straight from the file contents
-        let fileURL = FileManager.default.cacheDirectory.appending(path: cacheKey)
-        guard FileManager.default.fileExists(atPath: fileURL.path),
+        guard let fileURL = Vim.DiskCache.shared.url(named: cacheKey),
+            FileManager.default.fileExists(atPath: fileURL.path),
             let image: CacheType = .init(contentsOfFile: fileURL.path) else {
             return nil
         }
@@ -8,7 +8,7 @@
 import MetalKit
 
 /// See: https://github.com/vimaec/vim/#assets-buffer
-public class Assets {
+public class Assets: @unchecked Sendable {
 
     private let bfast: BFast
 
@@ -19,7 +19,7 @@ public class Assets {
 
     /// Returns all of the asset names
     public lazy var names: [String] = {
-        bfast.buffers.map { $0.name }
+        bfast.names
     }()
 
     /// The preview image extension.
@@ -41,16 +41,15 @@ public class Assets {
         guard let bufferName = names.last,
                 let data = data(bufferName) else { return }
 
-        let fileURL = FileManager.default.cacheDirectory.appendingPathComponent(previewImageName)
-        if !FileManager.default.fileExists(atPath: fileURL.path) {
-            try? data.write(to: fileURL)
+        let cache = Vim.DiskCache.shared
+        if !cache.contains(previewImageName, group: bfast.fileHash) {
+            try? cache.write(data, name: previewImageName, group: bfast.fileHash)
         }
     }
 
     /// Returns the raw data for the asset name
     public func data(_ name: String) -> Data? {
-        guard let buffer = bfast.buffers.filter({ $0.name == name }).first else { return nil }
-        return buffer.data
+        bfast.buffer(name)?.data
     }
 }
 
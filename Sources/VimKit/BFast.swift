@@ -5,17 +5,43 @@
 //  Created by Kevin McKee
 //
 
-import CryptoKit
 import Foundation
 
 /// The BFast format is essentially a collection of named data buffers (byte arrays).
-struct BFast: Hashable {
+///
+/// Only the header, ranges and names are parsed when a container is initialized,
+/// buffers are looked up by name through a hashed index and materialized when requested.
+struct BFast: Hashable, Sendable {
 
     // The header magic validation
     fileprivate static let MAGIC = 0xBFA5
+    // The byte alignment of each buffer
+    fileprivate static let ALIGNMENT = 64
+
+    /// Describes why a container failed validation.
+    enum ValidationError: Error, Equatable {
+        /// The file couldn't be opened or mapped.
+        case unreadable(URL)
+        /// The container is too small to hold a header (byte count).
+        case truncated(Int)
+        /// The header magic doesn't match.
+        case invalidMagic(UInt64)
+        /// The number of buffers is zero or more than the container could possibly hold.
+        case invalidNumberOfBuffers(UInt64)
+        /// The data section (start, end) overlaps the ranges section or lies outside of the container.
+        case invalidDataSection(UInt64, UInt64)
+        /// The range at the index lies outside of the data section.
+        case rangeOutOfBounds(Int)
+        /// The range at the index doesn't start on an aligned boundary.
+        case misalignedRange(Int)
+        /// The range at the index starts before the end of the previous range.
+        case overlappingRange(Int)
+        /// The number of names (actual, expected) doesn't match the number of buffers - 1.
+        case invalidNames(Int, Int)
+    }
 
     // 32 Bytes
-    public struct Header: Hashable {
+    public struct Header: Hashable, Sendable {
         let magic: UInt64
         let dataStart: UInt64
         let dataEnd: UInt64
@@ -23,7 +49,7 @@ struct BFast: Hashable {
     }
 
     // 16 Bytes
-    public struct Range {
+    public struct Range: Sendable {
         let begin: UInt64
         let end: UInt64
         var count: Int {
@@ -35,172 +61,301 @@ struct BFast: Hashable {
         }
     }
 
-    public struct Buffer: Hashable {
+    /// A named view into the memory mapped file. Buffers never own or copy their bytes,
+    /// they simply describe where their data lives inside the mapping.
+    public struct Buffer: Hashable, Sendable {
         let name: String
-        let data: Data
+        /// The byte range of this buffer inside the mapped file.
+        let range: Swift.Range<Int>
+        /// The memory mapped file that holds the buffer bytes.
+        fileprivate let file: MappedFile
+
+        /// Returns a zero-copy data view of the buffer bytes.
+        var data: Data {
+            file.data(range)
+        }
 
-        /// Common Initializer.
-        /// - Parameters:
-        ///   - name: the name of the buffer
-        ///   - data: the buffer data
-        init(name: String, data: Data) {
-            self.name = name
-            self.data = data
+        /// Returns the number of bytes inside this buffer.
+        var count: Int {
+            range.count
         }
 
-        /// Initializes the buffer with mmap'd data from the specified file within the specified range.
-        /// - Parameters:
-        ///   - file: the file handle to the buffer data
-        ///   - range: the range of buffer data to mmap
-        ///   - sha256Hash: the buffer's container SHA 256 hash
-        ///   - name: the name of the buffer.
-        fileprivate init?(file: FileHandle, range: Range, _ sha256Hash: String, _ name: String) {
-            let fileName = [sha256Hash, name].joined(separator: ".")
-            guard let data = file.readMapped(offset: range.begin, count: range.count, fileName) else {
-                return nil
-            }
-            self.name = name
-            self.data = data
+        /// Returns the raw bytes of this buffer straight out of the mapping.
+        /// The pointer is only valid for as long as this buffer (or the container it belongs to) is alive.
+        var unsafeBytes: UnsafeRawBufferPointer {
+            file.bytes(range)
         }
 
-        /// Initializes the buffer with the specified data block and attempts to mmap the data into it's own file.
+        /// Initializes the buffer as a view into the mapped file.
         /// - Parameters:
-        ///   - data: the data block
-        ///   - sha256Hash: the unique sha256Hash
-        ///   - name: the name of the buffer.
-        fileprivate init?(data: Data, _ sha256Hash: String, _ name: String) {
-            let fileName = [sha256Hash, name].joined(separator: ".")
-            guard let mmapped = data.mmap(fileName) else { return nil }
+        ///   - name: the name of the buffer
+        ///   - file: the mapped file that holds the buffer data
+        ///   - range: the byte range of the buffer inside the mapped file
+        fileprivate init(name: String, file: MappedFile, range: Swift.Range<Int>) {
             self.name = name
-            self.data = mmapped
+            self.file = file
+            self.range = range
         }
     }
 
     /// The container header.
     let header: Header
-    /// The buffers contained inside this container.
-    let buffers: [Buffer]
+    /// The names of the buffers contained inside this container (in the order they are stored).
+    let names: [String]
     /// The SHA 256 hash of this container
     let sha256Hash: String
+    /// The memory mapped file this container is a view into.
+    private let file: MappedFile
+    /// The absolute byte ranges of the buffers inside the mapped file (parallel to `names`).
+    private let ranges: [Swift.Range<Int>]
+    /// Provides a hash lookup of buffer names into their position inside the `names` and `ranges` arrays.
+    private let index: [String: Int]
+
+    /// Returns the buffers contained inside this container.
+    /// Buffers are materialized on demand and are simply views into the mapped file.
+    var buffers: [Buffer] {
+        names.indices.map { Buffer(name: names[$0], file: file, range: ranges[$0]) }
+    }
+
+    /// The disk cache group of the file this container was mapped from.
+    /// Containers nested inside the same file share the same file hash.
+    var fileHash: String {
+        file.group
+    }
 
     /// Returns the total bytes of this container
-    public lazy var totalByteSize: Int = {
-        var total: Int = .zero
-        for buffer in buffers {
-            total += buffer.data.count
-        }
-        return total
-    }()
+    public var totalByteSize: Int {
+        ranges.reduce(.zero) { $0 + $1.count }
+    }
 
-    /// Initializes the BFast container from the specified file path
+    /// Initializes the BFast container from the specified file path.
+    ///
+    /// The entire file is mapped into memory once and every buffer (including the buffers of
+    /// any nested containers) is simply a view into that single mapping, so pages are only
+    /// faulted in as the data is actually touched.
     ///
     /// - Parameters:
     ///   - url: The local file url
-    init?(_ url: URL) {
-
-        guard let file = try? FileHandle(forReadingFrom: url) else {
-            debugPrint("💩 Unable to load file handle from url [\(url)]")
-            return nil
+    /// - Throws: a `ValidationError` if the file can't be mapped or isn't a valid BFast container
+    init(_ url: URL) throws {
+        guard let file = MappedFile(url) else {
+            throw ValidationError.unreadable(url)
         }
+        try self.init(file: file, range: 0..<file.count, sha256Hash: file.identifier)
+    }
 
-        defer {
-            try? file.close()
-        }
+    /// Initializes the BFast container from the specified buffer.
+    ///
+    /// The nested container shares the mapping of its parent buffer, which means
+    /// none of the child buffer data is copied with `.subdata(in: Range)`.
+    ///
+    /// The identity of a nested container is derived from the identity of the file it lives in plus its byte range
+    /// inside that file, so the container bytes are never read just to produce a cache key.
+    ///
+    /// - Parameters:
+    ///   - buffer: The data buffer that holds a BFast container
+    /// - Throws: a `ValidationError` if the buffer isn't a valid BFast container
+    init(buffer: Buffer) throws {
+        let key = "\(buffer.file.identifier):\(buffer.range.lowerBound)-\(buffer.range.upperBound)"
+        try self.init(file: buffer.file, range: buffer.range, sha256Hash: key.sha256Hash)
+    }
+
+    /// Initializes the BFast container that lives inside the specified range of the mapped file.
+    ///
+    /// The header, ranges and names are validated in a single linear sweep before any buffer is handed out,
+    /// so every buffer range is guaranteed to be inside the container and the decoders can read them without
+    /// any further bounds checks.
+    ///
+    /// - Parameters:
+    ///   - file: the memory mapped file
+    ///   - range: the byte range of the container inside the mapped file
+    ///   - sha256Hash: the container SHA 256 hash
+    /// - Throws: a `ValidationError` describing the first problem found
+    private init(file: MappedFile, range: Swift.Range<Int>, sha256Hash: String) throws {
 
         // 1) Read the header
-        guard let header: Header = file.unsafeType(), header.magic == BFast.MAGIC else {
-            debugPrint("💩 Not a BFast file")
-            return nil
+        let headerSize = MemoryLayout<Header>.size
+        guard range.count >= headerSize else {
+            throw ValidationError.truncated(range.count)
+        }
+        let header: Header = file.load(at: range.lowerBound)
+        guard header.magic == BFast.MAGIC else {
+            throw ValidationError.invalidMagic(header.magic)
         }
-        self.header = header
-        self.sha256Hash = url.lastPathComponent
 
-        assert(header.numberOfBuffers > 0, "The number of buffers is invalid")
+        // 2) Validate the data section and that the ranges section fits in front of it
+        // See: https://github.com/vimaec/vim-format/blob/develop/docs/bfast.md#header-section
+        let rangeSize = MemoryLayout<Range>.size
+        guard header.numberOfBuffers > 0, header.numberOfBuffers <= UInt64(range.count / rangeSize) else {
+            throw ValidationError.invalidNumberOfBuffers(header.numberOfBuffers)
+        }
+        let numberOfBuffers = Int(header.numberOfBuffers)
+        let rangesEnd = UInt64(headerSize + rangeSize * numberOfBuffers)
+        guard rangesEnd <= header.dataStart, header.dataStart <= header.dataEnd, header.dataEnd <= UInt64(range.count) else {
+            throw ValidationError.invalidDataSection(header.dataStart, header.dataEnd)
+        }
 
-        // 2) Read the buffer data ranges
+        // 3) Sweep the buffer data ranges - They always start at byte 32 right after the header.
+        // Each range must be inside the data section, start on an aligned boundary and must not overlap the previous range.
         // See: https://github.com/vimaec/vim-format/blob/develop/docs/bfast.md#ranges-section
-        let ranges: [Range] = file.unsafeTypeArray(count: Int(header.numberOfBuffers))
-        assert(ranges.count == header.numberOfBuffers, "The number of byte ranges doesn't match the number of buffers")
-
         var names = [String]()
-        var buffers = [Buffer]()
+        var bufferNames = [String]()
+        var bufferRanges = [Swift.Range<Int>]()
+        var previousEnd = header.dataStart
+
+        for i in 0..<numberOfBuffers {
+            let r: Range = file.load(at: range.lowerBound + headerSize + rangeSize * i)
+            guard r.begin <= r.end else {
+                throw ValidationError.rangeOutOfBounds(i)
+            }
+            guard r.isValid else { continue } // Ignore any zero byte ranges
+            guard r.begin >= header.dataStart, r.end <= header.dataEnd else {
+                throw ValidationError.rangeOutOfBounds(i)
+            }
+            guard r.begin % UInt64(BFast.ALIGNMENT) == 0 else {
+                throw ValidationError.misalignedRange(i)
+            }
+            guard r.begin >= previousEnd else {
+                throw ValidationError.overlappingRange(i)
+            }
+            previousEnd = r.end
 
-        for (i, range) in ranges.enumerated() {
-            guard let slice = file.read(offset: range.begin, count: range.count) else { break }
+            // The buffer ranges are relative to the start of this container
+            let lowerBound = range.lowerBound + Int(r.begin)
+            let upperBound = range.lowerBound + Int(r.end)
             if i == 0 {
                 // The first buffer is always the array of names
-                names = slice.toStringArray()
+                // See: https://github.com/vimaec/vim#names-buffer
+                names = file.data(lowerBound..<upperBound).toStringArray()
             } else {
-                let name = names[i-1]
-                guard let buffer = Buffer(data: slice, sha256Hash, name) else { continue }
-                buffers.append(buffer)
+                guard names.indices.contains(i-1) else {
+                    throw ValidationError.invalidNames(names.count, numberOfBuffers - 1)
+                }
+                bufferNames.append(names[i-1])
+                bufferRanges.append(lowerBound..<upperBound)
             }
         }
 
-        /// See: https://github.com/vimaec/vim#names-buffer
-        assert(names.count == header.numberOfBuffers - 1, "The number of names must equal the number of buffers - 1")
-        self.buffers = buffers
+        guard names.count == numberOfBuffers - 1 else {
+            throw ValidationError.invalidNames(names.count, numberOfBuffers - 1)
+        }
 
+        self.header = header
+        self.sha256Hash = sha256Hash
+        self.file = file
+        self.names = bufferNames
+        self.ranges = bufferRanges
+        self.index = bufferNames.enumerated().reduce(into: [String: Int]()) { result, element in
+            // Keep the first occurrence if a name is duplicated
+            if result[element.element] == nil {
+                result[element.element] = element.offset
+            }
+        }
     }
 
-    /// Initializes the BFast container from the specified buffer.
-    ///
-    /// It's important to call `.subdata(in: Range)` instead of simply subscripting child buffer data in order 
-    /// to reset any resulting child buffer data indices.
-    /// Although `.subdata` returns a new copy of the data in this range which bloats memory (but can be offset by mmapping),
-    /// the indices in a subscript slice are copied from the original data block that can/will crash child buffers when slicing.
-    /// For more info on this subject see https://forums.swift.org/t/data-subscript/57195
-    ///
-    /// - Parameters:
-    ///   - buffer: The data buffer that holds a BFast container
-    init?(buffer: Buffer) {
-        guard let header: Header = buffer.data.unsafeType(), header.magic == BFast.MAGIC else {
-            debugPrint("💩 Not a BFast file")
-            return nil
-        }
-        self.header = header
-        self.sha256Hash = buffer.data.sha256Hash
+    /// Returns the buffer with the specified name.
+    /// - Parameter name: the name of the buffer
+    /// - Returns: the buffer with the specified name or nil if no buffer with the name exists
+    func buffer(_ name: String) -> Buffer? {
+        guard let i = index[name] else { return nil }
+        return Buffer(name: names[i], file: file, range: ranges[i])
+    }
 
-        // Read the buffer data ranges - They always start at byte 32 right after the header
-        let offset = MemoryLayout<Header>.size
-        let data = buffer.data.slice(offset: offset)
-        let ranges: [Range] = data.unsafeTypeArray(Int(header.numberOfBuffers))
-        assert(ranges.count == header.numberOfBuffers, "The number of byte ranges doesn't match the number of buffers")
+    /// Returns the byte size of the buffer with the specified name.
+    public func bufferByteSize(name: String) -> Int {
+        guard let i = index[name] else { return .zero }
+        return ranges[i].count
+    }
+}
 
-        var names = [String]()
-        var buffers = [Buffer]()
+extension BFast {
+
+    /// Provides a read-only memory mapping of an entire file.
+    /// The mapping is released once the last container, buffer or data view that references it is released.
+    final class MappedFile: Hashable, @unchecked Sendable {
+
+        /// The start address of the mapping.
+        private let baseAddress: UnsafeMutableRawPointer
+        /// The total number of bytes mapped.
+        let count: Int
+        /// The identity of the mapped file, which is the SHA 256 hash of the file path, device, inode, size and
+        /// modification time. A file that is replaced or edited in place gets a new identity so any artifacts
+        /// cached for the previous contents are never reused.
+        let identifier: String
+        /// The disk cache group of the mapped file. Downloaded files live in a group named after the file
+        /// (the SHA 256 hash of the source url), any other local file is grouped by the hash of it's path
+        /// so files with the same name in different directories never share a group.
+        let group: String
+
+        /// Maps the file at the specified url into memory.
+        /// - Parameters:
+        ///   - url: the local file url
+        init?(_ url: URL) {
+            let descriptor = open(url.path, O_RDONLY)
+            guard descriptor >= 0 else { return nil }
+            defer {
+                close(descriptor)
+            }
 
-        for (i, range) in ranges.enumerated() {
-            guard range.isValid else { continue } // Ignore any zero byte ranges
+            var info = stat()
+            guard fstat(descriptor, &info) == 0, info.st_size > 0 else { return nil }
+            let count = Int(info.st_size)
 
-            let slice = buffer.data.subdata(in: Int(range.begin)..<Int(range.end))
-            if i == 0 {
-                // The first buffer is always the array of names
-                names = slice.toStringArray()
-            } else {
-                let name = names[i-1]
-                // Mmap the data slice to it's own file
-                if slice.count >= Data.minMmapByteSize {
-                    guard let b = Buffer(data: slice, sha256Hash, name) else { continue }
-                    buffers.append(b)
-                } else {
-                    let b = Buffer(name: name, data: slice)
-                    buffers.append(b)
-                }
+            guard let address = mmap(nil, count, PROT_READ, MAP_PRIVATE, descriptor, 0),
+                  address != UnsafeMutableRawPointer(bitPattern: -1) else {
+                debugPrint("💩 Unable to mmap [\(url)]")
+                return nil
             }
+            self.baseAddress = address
+            self.count = count
+
+            let path = url.standardizedFileURL.path
+            let cacheURL = Vim.DiskCache.shared.url(group: url.lastPathComponent).appending(path: url.lastPathComponent)
+            let modified = info.st_mtimespec
+            self.group = path == cacheURL.standardizedFileURL.path ? url.lastPathComponent : path.sha256Hash
+            self.identifier = "\(path):\(info.st_dev):\(info.st_ino):\(count):\(modified.tv_sec).\(modified.tv_nsec)".sha256Hash
         }
 
-        /// See: https://github.com/vimaec/vim#names-buffer
-        assert(names.count == header.numberOfBuffers - 1, "The number of names must equal the number of buffers - 1")
-        self.buffers = buffers
-    }
+        deinit {
+            munmap(baseAddress, count)
+        }
 
-    /// Returns the byte size of the buffer with the specified name.
-    public func bufferByteSize(name: String) -> Int {
-        if let buffer = buffers.filter({ $0.name == name }).first {
-            return buffer.data.count
+        /// Returns a zero-copy data view into the mapping.
+        /// The returned data holds a strong reference to this file which keeps the mapping alive.
+        /// - Parameter range: the byte range of the view
+        /// - Returns: a data block that points directly into the mapped bytes
+        func data(_ range: Swift.Range<Int>) -> Data {
+            guard range.isNotEmpty else { return .init() }
+            assert(range.lowerBound >= 0 && range.upperBound <= count, "💩 Range [\(range)] is outside of the mapped file")
+            return Data(bytesNoCopy: baseAddress + range.lowerBound, count: range.count, deallocator: .custom({ _, _ in
+                withExtendedLifetime(self) {}
+            }))
+        }
+
+        /// Returns a raw pointer view into the mapping.
+        /// - Parameter range: the byte range of the view
+        /// - Returns: a raw buffer pointer that points directly into the mapped bytes
+        func bytes(_ range: Swift.Range<Int>) -> UnsafeRawBufferPointer {
+            assert(range.lowerBound >= 0 && range.upperBound <= count, "💩 Range [\(range)] is outside of the mapped file")
+            return UnsafeRawBufferPointer(start: baseAddress + range.lowerBound, count: range.count)
+        }
+
+        /// Loads a value of the specified type from the byte offset of the mapping.
+        /// The caller is responsible for validating that the value lies inside the mapping.
+        /// - Parameter offset: the byte offset into the mapping
+        /// - Returns: the loaded value
+        func load<T>(at offset: Int) -> T {
+            assert(offset >= 0 && offset + MemoryLayout<T>.size <= count, "💩 Offset [\(offset)] is outside of the mapped file")
+            return UnsafeRawPointer(baseAddress).loadUnaligned(fromByteOffset: offset, as: T.self)
+        }
+
+        static func == (lhs: MappedFile, rhs: MappedFile) -> Bool {
+            lhs === rhs
+        }
+
+        func hash(into hasher: inout Hasher) {
+            hasher.combine(ObjectIdentifier(self))
         }
-        return .zero
     }
 }
 
@@ -211,12 +366,4 @@ fileprivate extension Data {
     func toStringArray() -> [String] {
         String(data: self, encoding: .utf8)?.split(separator: "\0").map { String($0)} ?? []
     }
-
-    /// Returns a slice of this data block from the specified range.
-    /// - Parameter range: the bfast data range
-    /// - Returns: a data slice
-    func slice(range: BFast.Range) -> Data {
-        let r = Int(range.begin)..<Int(range.end)
-        return self[r]
-    }
 }
@@ -163,6 +163,8 @@ extension Database {
             ImportTaskTracker.shared.tasks.removeValue(forKey: database.sha256Hash)
             // Update the database state
             database.publish(state: .ready)
+            // Account for the size of the imported sqlite store
+            Vim.DiskCache.shared.record(database.containerName, group: database.bfast.fileHash)
 
             let timeInterval = abs(start.timeIntervalSinceNow)
             debugPrint("􁗫 Database imported [\(count)] models in [\(timeInterval.stringFromTimeInterval())]")
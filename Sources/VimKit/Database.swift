@@ -203,7 +203,7 @@ public class Database: ObservableObject, @unchecked Sendable {
         ///   - stringDataProvider: The string data provider
         init?(_ buffer: BFast.Buffer, _ stringDataProvider: IndexedStringDataProvider) {
             self.buffer = buffer
-            guard let bfast = BFast(buffer: buffer) else { return nil }
+            guard let bfast = try? BFast(buffer: buffer) else { return nil }
             var columns = [String: Column]()
             // The columns of the table are encoded as BFast buffers
             for (_, buffer) in bfast.buffers.enumerated() {
@@ -263,6 +263,11 @@ public class Database: ObservableObject, @unchecked Sendable {
     /// The SwiftData model container
     public var modelContainer: ModelContainer
 
+    /// The file name of the sqlite store inside the disk cache.
+    var containerName: String {
+        "\(bfast.sha256Hash)\(sqliteExtension)"
+    }
+
     /// Initializes the database with the specified BFast container.
     ///
     /// - Parameters:
@@ -274,8 +279,8 @@ public class Database: ObservableObject, @unchecked Sendable {
         // Register the value transformers
         Database.registerValueTransformers()
 
-        let cacheDir = FileManager.default.cacheDirectory
-        let containerURL = cacheDir.appending(path: "\(bfast.sha256Hash)\(sqliteExtension)")
+        let containerName = "\(bfast.sha256Hash)\(sqliteExtension)"
+        let containerURL = Vim.DiskCache.shared.url(for: containerName, group: bfast.fileHash)
 
         let schema = Schema(Database.allTypes)
         let configuration = ModelConfiguration(schema: schema, url: containerURL)
@@ -286,6 +291,7 @@ public class Database: ObservableObject, @unchecked Sendable {
         } catch let error {
             fatalError("💀 \(error)")
         }
+        Vim.DiskCache.shared.record(containerName, group: bfast.fileHash)
 
         // Each buffer is contains a table
         for (_, buffer) in bfast.buffers.enumerated() {
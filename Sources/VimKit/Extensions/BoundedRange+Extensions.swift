@@ -10,6 +10,18 @@ import VimKitShaders
 
 extension BoundedRange: @retroactive Equatable, @retroactive Hashable {
 
+    /// The lower bounds of the range (stored as a 32 bit unsigned integer).
+    public var lowerBound: Int {
+        get { Int(__lowerBound) }
+        set { __lowerBound = UInt32(newValue) }
+    }
+
+    /// The upper bounds of the range (stored as a 32 bit unsigned integer).
+    public var upperBound: Int {
+        get { Int(__upperBound) }
+        set { __upperBound = UInt32(newValue) }
+    }
+
     var count: Int {
         Int(upperBound) - Int(lowerBound)
     }
@@ -20,7 +32,7 @@ extension BoundedRange: @retroactive Equatable, @retroactive Hashable {
     }
 
     init(_ range: Range<Int>) {
-        self.init(lowerBound: range.lowerBound, upperBound: range.upperBound)
+        self.init(__lowerBound: UInt32(range.lowerBound), __upperBound: UInt32(range.upperBound))
     }
 
     public static func == (lhs: BoundedRange, rhs: BoundedRange) -> Bool {
@@ -15,8 +15,7 @@ extension Data {
 
     /// Calculates the SHA hash of this data
     var sha256Hash: String {
-        let hashed = SHA256.hash(data: self)
-        return hashed.compactMap { String(format: "%02x", $0) }.joined()
+        SHA256.hash(data: self).hexString
     }
 
     /// Returns the data block as a raw byte array.
@@ -33,11 +32,9 @@ extension Data {
         return string
     }
 
-    /// Returns the data block as a single specified type.
-    ///
-    /// TODO: Validate the size of this data block against the MemoryLayout size of the specified type.
+    /// Returns the data block as a single specified type or nil if the data block is too small to hold the type.
     func unsafeType<T>() -> T? {
-        guard let result: UnsafePointer<T> = unsafePointer() else { return nil }
+        guard count >= MemoryLayout<T>.size, let result: UnsafePointer<T> = unsafePointer() else { return nil }
         return result.pointee
     }
 
@@ -70,18 +67,15 @@ extension Data {
         return self[range]
     }
 
-    /// Attempts to mmap this data into the specified file
-    /// - Parameters:
-    ///   - fileName: the file's unique name
-    /// - Returns: the mmap'd file data
-    func mmap(_ fileName: String) -> Data? {
-        let cacheDir = FileManager.default.cacheDirectory
-        let cacheFile = cacheDir.appending(path: fileName)
-        if !FileManager.default.fileExists(atPath: cacheFile.path) {
-            // Copy the data into the the cache file
-            try? self.write(to: cacheFile)
+    /// Returns true if this data block starts on a page boundary and spans a whole number of pages,
+    /// which is required in order to wrap the bytes inside a MTLBuffer without copying them.
+    var isPageAligned: Bool {
+        let pageSize = Int(getpagesize())
+        guard count % pageSize == .zero else { return false }
+        return withUnsafeBytes { pointer in
+            guard let baseAddress = pointer.baseAddress else { return false }
+            return Int(bitPattern: baseAddress) % pageSize == .zero
         }
-        return try? Data(contentsOf: cacheFile, options: .alwaysMapped)
     }
 
     /// Returns the total count of elements for the specified type.
@@ -0,0 +1,28 @@
+//
+//  Digest+Extensions.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import CryptoKit
+import Foundation
+
+// The lowercase hex digits
+private let hexDigits: [UInt8] = Array("0123456789abcdef".utf8)
+
+extension Digest {
+
+    /// Returns the digest as a lowercase hex string.
+    /// The string is built directly from a lookup table instead of formatting each byte with `String(format:)`.
+    var hexString: String {
+        let bytes = Array(self)
+        return String(unsafeUninitializedCapacity: bytes.count * 2) { buffer in
+            for (i, byte) in bytes.enumerated() {
+                buffer[i * 2] = hexDigits[Int(byte >> 4)]
+                buffer[i * 2 + 1] = hexDigits[Int(byte & 0x0F)]
+            }
+            return bytes.count * 2
+        }
+    }
+}
@@ -69,21 +69,4 @@ extension FileHandle {
             return nil
         }
     }
-
-    /// Reads the file data at the specified offset up to the specified number of bytes and mmap's the data into a cache file.
-    /// - Parameters:
-    ///   - offset: the offset to seek the file handle to
-    ///   - count: the number of bytes to read from the offset
-    ///   - fileName: the file's unique name
-    /// - Returns: the mmap'd data
-    func readMapped(offset: UInt64, count: Int, _ fileName: String) -> Data? {
-        let cacheDir = FileManager.default.cacheDirectory
-        let cacheFile = cacheDir.appending(path: fileName)
-        if !FileManager.default.fileExists(atPath: cacheFile.path) {
-            // Copy the bytes into the the cache file
-            let data = read(offset: offset, count: count)
-            try? data?.write(to: cacheFile)
-        }
-        return try? Data(contentsOf: cacheFile, options: .alwaysMapped)
-    }
 }
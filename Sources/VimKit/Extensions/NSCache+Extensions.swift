@@ -54,11 +54,12 @@ public final class Cache<Key: Hashable, Value>: @unchecked Sendable {
     /// - Parameters:
     ///   - value: the value
     ///   - key: the key
-    public func insert(_ value: Value, for key: Key) {
+    ///   - cost: the cost of the value used to evict values once the `totalCostLimit` is exceeded
+    public func insert(_ value: Value, for key: Key, cost: Int = 0) {
         lock.lock()
         defer { lock.unlock() }
         let entry = Entry(value: value)
-        storage.setObject(entry, forKey: WrappedKey(key))
+        storage.setObject(entry, forKey: WrappedKey(key), cost: cost)
         keys.insert(key)
     }
 
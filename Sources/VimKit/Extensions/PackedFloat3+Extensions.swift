@@ -0,0 +1,23 @@
+//
+//  PackedFloat3+Extensions.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import simd
+import VimKitShaders
+
+extension PackedFloat3 {
+
+    /// Initializes the packed vector from a SIMD vector.
+    /// - Parameter vector: the vector to pack
+    init(_ vector: SIMD3<Float>) {
+        self.init(x: vector.x, y: vector.y, z: vector.z)
+    }
+
+    /// Convenience var that returns the unpacked SIMD vector.
+    var vector: SIMD3<Float> {
+        .init(x, y, z)
+    }
+}
@@ -15,8 +15,7 @@ public extension String {
 
     /// Calculates the SHA hash of this string instance
     var sha256Hash: String {
-        let hashed = SHA256.hash(data: Data(self.utf8))
-        return hashed.compactMap { String(format: "%02x", $0) }.joined()
+        SHA256.hash(data: Data(self.utf8)).hexString
     }
 
     /// Convenience var that trim all whitespace.
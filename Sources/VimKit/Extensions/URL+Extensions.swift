@@ -12,8 +12,7 @@ public extension URL {
 
     /// Calculates the SHA hash of an url
     var sha256Hash: String {
-        let hashed = SHA256.hash(data: Data(self.absoluteString.utf8))
-        return hashed.compactMap { String(format: "%02x", $0) }.joined()
+        SHA256.hash(data: Data(self.absoluteString.utf8)).hexString
     }
 
     /// Returns true if the file is locally cached or not
@@ -32,9 +31,8 @@ public extension URL {
     var cacheURL: URL {
         switch self.scheme {
         case "https":
-            let cacheDir = FileManager.default.cacheDirectory
-            let cachedFileURL = cacheDir.appending(path: sha256Hash)
-            return cachedFileURL
+            // Downloaded files are grouped by their own hash inside the disk cache
+            return Vim.DiskCache.shared.url(group: sha256Hash).appending(path: sha256Hash)
         case "file":
             return self
         default:
@@ -22,6 +22,58 @@ extension Geometry {
             descriptor.dataType.size * descriptor.arity
         }
     }
+
+    /// Provides typed, random access to the elements of one or more attributes without copying any bytes.
+    ///
+    /// The elements are reinterpreted straight out of the memory mapped file (BFast buffers are validated to
+    /// start on 64 byte boundaries so any of the attribute data types can be bound in place). Attributes that share
+    /// the same association and semantic are presented as one continuous collection.
+    struct AttributeElements<T>: RandomAccessCollection {
+
+        /// The attribute buffers (holding on to them keeps the mapped file alive).
+        private let buffers: [BFast.Buffer]
+        /// The typed views into each of the buffers.
+        private let chunks: [UnsafeBufferPointer<T>]
+
+        let startIndex: Int = .zero
+        let endIndex: Int
+
+        /// Initializes the elements from the specified attributes.
+        /// - Parameter attributes: the attributes that hold the element data
+        init(_ attributes: [Attribute]) {
+            self.buffers = attributes.map { $0.buffer }
+            self.chunks = buffers.map { buffer in
+                let bytes = buffer.unsafeBytes
+                let count = bytes.count / MemoryLayout<T>.stride
+                return UnsafeBufferPointer(start: bytes.baseAddress?.assumingMemoryBound(to: T.self), count: count)
+            }
+            self.endIndex = chunks.reduce(.zero) { $0 + $1.count }
+        }
+
+        subscript(position: Int) -> T {
+            // Fast path - almost every attribute is stored in a single buffer
+            if chunks.count == 1 {
+                return chunks[0][position]
+            }
+            var i = position
+            for chunk in chunks {
+                if i < chunk.count { return chunk[i] }
+                i -= chunk.count
+            }
+            fatalError("💀 Index [\(position)] out of range [\(endIndex)]")
+        }
+
+        /// Bitwise copies all of the elements into the destination.
+        /// - Parameter destination: the destination pointer (must have room for `count` elements)
+        func copy(to destination: UnsafeMutablePointer<T>) {
+            var offset = 0
+            for chunk in chunks {
+                guard let baseAddress = chunk.baseAddress else { continue }
+                (destination + offset).initialize(from: baseAddress, count: chunk.count)
+                offset += chunk.count
+            }
+        }
+    }
 }
 
 extension Array where Element == Geometry.Attribute {
@@ -39,8 +91,8 @@ extension Array where Element == Geometry.Attribute {
             return device.makeBuffer(data, type: type)
         }
 
-        if buffer.count >= Data.minMmapByteSize {
-            // Make the buffer without copying the bytes
+        if buffer.count >= Data.minMmapByteSize, buffer.isPageAligned {
+            // Make the buffer without copying the bytes (only possible on page boundaries of the mapped file)
             return device.makeBufferNoCopy(&buffer, type: type)
         } else {
             // Simply build a buffer by copying the bytes
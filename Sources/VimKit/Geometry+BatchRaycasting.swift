@@ -0,0 +1,263 @@
+//
+//  Geometry+BatchRaycasting.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import VimKitShaders
+
+extension Geometry {
+
+    /// A packet of 4 rays layed out as a struct of arrays so every box and triangle test handles all 4 rays at once.
+    ///
+    /// When fewer than 4 rays are packed the missing lanes repeat the first ray and their results are ignored.
+    struct RayPacket {
+
+        /// The ray origins.
+        var origin: (x: SIMD4<Float>, y: SIMD4<Float>, z: SIMD4<Float>)
+        /// The ray directions.
+        var direction: (x: SIMD4<Float>, y: SIMD4<Float>, z: SIMD4<Float>)
+        /// The reciprocal of the ray directions (computed once per packet).
+        var inverseDirection: (x: SIMD4<Float>, y: SIMD4<Float>, z: SIMD4<Float>)
+
+        /// Initializes the packet from up to 4 queries (any missing lanes repeat the first query).
+        /// - Parameter queries: the queries to pack
+        init<C: Collection>(_ queries: C) where C.Element == RaycastQuery {
+            let first = queries.first!
+            var o = (x: SIMD4<Float>(repeating: first.origin.x), y: SIMD4<Float>(repeating: first.origin.y), z: SIMD4<Float>(repeating: first.origin.z))
+            var d = (x: SIMD4<Float>(repeating: first.direction.x), y: SIMD4<Float>(repeating: first.direction.y), z: SIMD4<Float>(repeating: first.direction.z))
+            for (lane, query) in queries.prefix(4).enumerated() {
+                o.x[lane] = query.origin.x
+                o.y[lane] = query.origin.y
+                o.z[lane] = query.origin.z
+                d.x[lane] = query.direction.x
+                d.y[lane] = query.direction.y
+                d.z[lane] = query.direction.z
+            }
+            self.init(origin: o, direction: d)
+        }
+
+        /// Initializes the packet with the ray origins and directions.
+        /// - Parameters:
+        ///   - origin: the ray origins
+        ///   - direction: the ray directions
+        init(origin: (x: SIMD4<Float>, y: SIMD4<Float>, z: SIMD4<Float>), direction: (x: SIMD4<Float>, y: SIMD4<Float>, z: SIMD4<Float>)) {
+            self.origin = origin
+            self.direction = direction
+            self.inverseDirection = (1 / direction.x, 1 / direction.y, 1 / direction.z)
+        }
+
+        /// Performs a branchless slab test of every ray against the bounds.
+        /// - Parameters:
+        ///   - minBounds: the min bounds
+        ///   - maxBounds: the max bounds
+        ///   - closest: the closest hit of each ray (rays can't enter the bounds any farther than this)
+        /// - Returns: the mask of rays that enter the bounds before their closest hit
+        func intersects(_ minBounds: SIMD3<Float>, _ maxBounds: SIMD3<Float>, closest: SIMD4<Float>) -> SIMDMask<SIMD4<Int32>> {
+            let x0 = (minBounds.x - origin.x) * inverseDirection.x
+            let x1 = (maxBounds.x - origin.x) * inverseDirection.x
+            let y0 = (minBounds.y - origin.y) * inverseDirection.y
+            let y1 = (maxBounds.y - origin.y) * inverseDirection.y
+            let z0 = (minBounds.z - origin.z) * inverseDirection.z
+            let z1 = (maxBounds.z - origin.z) * inverseDirection.z
+            let near = simd_max(simd_max(simd_min(x0, x1), simd_min(y0, y1)), simd_max(simd_min(z0, z1), .zero))
+            let far = simd_min(simd_min(simd_max(x0, x1), simd_max(y0, y1)), simd_min(simd_max(z0, z1), closest))
+            return near .<= far
+        }
+
+        /// Performs a branchless Möller–Trumbore test of every ray against the triangle.
+        /// - SeeAlso: https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+        /// - Parameters:
+        ///   - pa: the first point of the triange
+        ///   - pb: the second point of the triangle
+        ///   - pc: the third point of the triangle
+        ///   - closest: the closest hit of each ray which is replaced wherever the triangle is closer
+        /// - Returns: the mask of rays whose closest hit was replaced
+        @discardableResult
+        func hitTest(_ pa: SIMD3<Float>, _ pb: SIMD3<Float>, _ pc: SIMD3<Float>, closest: inout SIMD4<Float>) -> SIMDMask<SIMD4<Int32>> {
+            let edgeA = pb - pa
+            let edgeB = pc - pa
+            let epsilon: Float = .ulpOfOne
+
+            // h = cross(direction, edgeB)
+            let hx = direction.y * edgeB.z - direction.z * edgeB.y
+            let hy = direction.z * edgeB.x - direction.x * edgeB.z
+            let hz = direction.x * edgeB.y - direction.y * edgeB.x
+            let det = edgeA.x * hx + edgeA.y * hy + edgeA.z * hz
+            let invDet = 1 / det
+
+            // s = origin - pa
+            let sx = origin.x - pa.x
+            let sy = origin.y - pa.y
+            let sz = origin.z - pa.z
+            let u = invDet * (sx * hx + sy * hy + sz * hz)
+
+            // q = cross(s, edgeA)
+            let qx = sy * edgeA.z - sz * edgeA.y
+            let qy = sz * edgeA.x - sx * edgeA.z
+            let qz = sx * edgeA.y - sy * edgeA.x
+            let v = invDet * (direction.x * qx + direction.y * qy + direction.z * qz)
+            let distance = invDet * (edgeB.x * qx + edgeB.y * qy + edgeB.z * qz)
+
+            let mask = simd_abs(det) .>= epsilon .& u .>= 0 .& v .>= 0 .& (u + v) .<= 1 .& distance .> epsilon .& distance .< closest
+            closest.replace(with: distance, where: mask)
+            return mask
+        }
+
+        /// Convenience operator that transforms every ray in the packet.
+        /// - Parameters:
+        ///   - transform: the transform
+        ///   - packet: the ray packet
+        /// - Returns: a new ray packet multiplied by the transform.
+        static func * (transform: float4x4, packet: RayPacket) -> RayPacket {
+            let (c0, c1, c2, c3) = transform.columns
+            let o = packet.origin
+            let d = packet.direction
+            let origin = (x: c0.x * o.x + c1.x * o.y + c2.x * o.z + c3.x,
+                          y: c0.y * o.x + c1.y * o.y + c2.y * o.z + c3.y,
+                          z: c0.z * o.x + c1.z * o.y + c2.z * o.z + c3.z)
+            let direction = (x: c0.x * d.x + c1.x * d.y + c2.x * d.z,
+                             y: c0.y * d.x + c1.y * d.y + c2.y * d.z,
+                             z: c0.z * d.x + c1.z * d.y + c2.z * d.z)
+            return RayPacket(origin: origin, direction: direction)
+        }
+    }
+}
+
+// MARK: Packet Traversal
+
+extension Geometry.MeshHierarchy {
+
+    /// Finds the closest triangle intersection of every ray in the packet.
+    ///
+    /// A node is visited as long as any ray in the packet enters it before that ray's closest hit.
+    /// - Parameters:
+    ///   - packet: the ray packet in mesh space
+    ///   - closest: the closest hit of each ray which is replaced wherever a triangle is closer
+    /// - Returns: the mask of rays whose closest hit was replaced
+    @discardableResult
+    func raycast(_ packet: Geometry.RayPacket, closest: inout SIMD4<Float>) -> SIMDMask<SIMD4<Int32>> {
+        var hits = SIMDMask<SIMD4<Int32>>(repeating: false)
+        guard nodes.isNotEmpty else { return hits }
+
+        var stack = [Int]()
+        stack.reserveCapacity(64)
+        stack.append(0)
+        while let i = stack.popLast() {
+            let node = nodes[i]
+            guard any(packet.intersects(node.minBounds.vector, node.maxBounds.vector, closest: closest)) else { continue }
+            if node.isLeaf {
+                for t in node.range {
+                    hits .|= packet.hitTest(vertices[t * 3], vertices[t * 3 + 1], vertices[t * 3 + 2], closest: &closest)
+                }
+            } else {
+                stack.append(Int(node.offset))
+                stack.append(i + 1)
+            }
+        }
+        return hits
+    }
+}
+
+extension Geometry.BoundingVolumeHierarchy {
+
+    /// Walks the nodes that any ray in the packet enters before it's closest hit found so far.
+    /// - Parameters:
+    ///   - packet: the ray packet
+    ///   - closest: returns the closest hit of each ray found so far
+    ///   - visit: called for every instance of every visited leaf
+    func closestHits(_ packet: Geometry.RayPacket, closest: () -> SIMD4<Float>, visit: (Int) -> Void) {
+        guard nodes.isNotEmpty else { return }
+        var stack = [Int]()
+        stack.reserveCapacity(64)
+        stack.append(0)
+        while let i = stack.popLast() {
+            let node = nodes[i]
+            guard !hidden.contains(i),
+                  any(packet.intersects(node.minBounds.vector, node.maxBounds.vector, closest: closest())) else { continue }
+            if node.isLeaf {
+                for j in node.range {
+                    visit(Int(instances[j]))
+                }
+            } else {
+                stack.append(Int(node.offset))
+                stack.append(i + 1)
+            }
+        }
+    }
+}
+
+// MARK: Batch Raycasting
+
+extension Geometry {
+
+    /// Finds the closest instance that intersects each query.
+    ///
+    /// The queries are grouped into packets of 4 rays that traverse the instance and mesh hierarchies together
+    /// with SIMD box and triangle tests, and the packets are spread across all of the cores. Packets of
+    /// coherent rays (such as a sampling grid) visit nearly the same nodes, so neighbouring queries should be adjacent.
+    /// - Parameter queries: the raycast queries in world space
+    /// - Returns: the slot of the closest instance hit and the raycast result of each query (nil if nothing was hit)
+    public func raycast(batch queries: [RaycastQuery]) -> [(slot: Int, result: RaycastResult)?] {
+        guard queries.isNotEmpty else { return [] }
+
+        // Resolve the lazy buffers before fanning out across threads
+        let instances = UnsafeBufferPointer(self.instances)
+        _ = (meshes, positions, indices, submeshes)
+        return Geometry.raycast(batch: queries, instances: instances, bvh: bvh, hierarchy: meshHierarchy)
+    }
+
+    /// Finds the closest instance that intersects each query with packets of 4 rays spread across all of the cores.
+    /// - Parameters:
+    ///   - queries: the raycast queries in world space
+    ///   - instances: the instances to test
+    ///   - bvh: the instance hierarchy (every instance box is tested if nil)
+    ///   - hierarchy: returns the triangle hierarchy of a mesh (called concurrently)
+    /// - Returns: the slot of the closest instance hit and the raycast result of each query (nil if nothing was hit)
+    static func raycast(batch queries: [RaycastQuery],
+                        instances: UnsafeBufferPointer<Instance>,
+                        bvh: BVH?,
+                        hierarchy: (Int) -> MeshHierarchy?) -> [(slot: Int, result: RaycastResult)?] {
+        guard queries.isNotEmpty else { return [] }
+
+        let packetCount = (queries.count + 3) / 4
+        let chunkCount = Swift.min(ProcessInfo.processInfo.activeProcessorCount * 4, packetCount)
+
+        return [(slot: Int, result: RaycastResult)?](unsafeUninitializedCapacity: queries.count) { buffer, count in
+            let results = buffer
+            DispatchQueue.concurrentPerform(iterations: chunkCount) { chunk in
+                for p in Geometry.chunkRange(chunk, of: chunkCount, count: packetCount) {
+                    let range = (p * 4)..<Swift.min(p * 4 + 4, queries.count)
+                    let packet = RayPacket(queries[range])
+                    var closest = SIMD4<Float>(repeating: .infinity)
+                    var slots = SIMD4<Int32>(repeating: .empty)
+
+                    func test(_ i: Int) {
+                        let instance = instances[i]
+                        guard instance.state != .hidden, let meshHierarchy = hierarchy(instance.mesh) else { return }
+                        // Transform the packet into mesh space (the distance along an affinely transformed ray is unchanged)
+                        let hits = meshHierarchy.raycast(instance.matrix.inverse * packet, closest: &closest)
+                        slots.replace(with: Int32(i), where: hits)
+                    }
+
+                    if let bvh {
+                        bvh.closestHits(packet, closest: { closest }, visit: test)
+                    } else {
+                        for i in instances.indices where any(packet.intersects(instances[i].minBounds, instances[i].maxBounds, closest: closest)) {
+                            test(i)
+                        }
+                    }
+
+                    for (lane, q) in range.enumerated() {
+                        let result: (slot: Int, result: RaycastResult)? = slots[lane] == .empty ? nil : (Int(slots[lane]), RaycastResult(query: queries[q], distance: closest[lane]))
+                        results.initializeElement(at: q, to: result)
+                    }
+                }
+            }
+            count = queries.count
+        }
+    }
+}
@@ -0,0 +1,112 @@
+//
+//  Geometry+Bounds.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import VimKitShaders
+
+extension Geometry {
+
+    /// Computes the local (object space) bounding box of every mesh in parallel.
+    ///
+    /// Each mesh is walked exactly once no matter how many instances share it.
+    /// - Parameters:
+    ///   - positions: the vertex positions layed out in slices of [x,y,z]
+    ///   - indices: the corner indices
+    ///   - meshes: the meshes
+    ///   - submeshes: the submeshes
+    /// - Returns: the local bounding box of each mesh (nil if the mesh contains no vertices)
+    static func meshBounds(positions: UnsafeBufferPointer<Float>,
+                           indices: UnsafeBufferPointer<UInt32>,
+                           meshes: UnsafeBufferPointer<Mesh>,
+                           submeshes: UnsafeBufferPointer<Submesh>) -> [MDLAxisAlignedBoundingBox?] {
+
+        let chunkCount = ProcessInfo.processInfo.activeProcessorCount * 4
+        let vertexCount = positions.count / 3
+
+        return [MDLAxisAlignedBoundingBox?](unsafeUninitializedCapacity: meshes.count) { buffer, count in
+            let results = buffer
+            DispatchQueue.concurrentPerform(iterations: chunkCount) { chunk in
+                for m in chunkRange(chunk, of: chunkCount, count: meshes.count) {
+                    var minBounds = SIMD3<Float>(repeating: .greatestFiniteMagnitude)
+                    var maxBounds = SIMD3<Float>(repeating: -.greatestFiniteMagnitude)
+                    var isEmpty = true
+                    let submeshRange = meshes[m].submeshes.range.clamped(to: submeshes.indices)
+                    for s in submeshRange {
+                        let range = submeshes[s].indices.range.clamped(to: indices.indices)
+                        for i in range {
+                            let v = Int(indices[i])
+                            guard v < vertexCount else { continue }
+                            let position = SIMD3<Float>(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2])
+                            minBounds = simd_min(minBounds, position)
+                            maxBounds = simd_max(maxBounds, position)
+                            isEmpty = false
+                        }
+                    }
+                    let box: MDLAxisAlignedBoundingBox? = isEmpty ? nil : .init(maxBounds: maxBounds, minBounds: minBounds)
+                    results.initializeElement(at: m, to: box)
+                }
+            }
+            count = meshes.count
+        }
+    }
+
+    /// Transforms the local mesh bounds into world space bounds for every instance in parallel
+    /// and writes them into the instances.
+    ///
+    /// The world bounds are the exact axis aligned bounds of the transformed local box (Arvo's method),
+    /// which is equivalent to transforming all 8 corners of the box.
+    /// See: https://github.com/erich666/GraphicsGems/blob/master/gems/TransBox.c
+    /// - Parameters:
+    ///   - instances: the instances to update
+    ///   - meshBounds: the local bounds of each mesh
+    /// - Returns: the combined bounds of all of the instances
+    static func computeBounds(instances: UnsafeMutableBufferPointer<Instance>,
+                              meshBounds: [MDLAxisAlignedBoundingBox?]) -> MDLAxisAlignedBoundingBox {
+
+        let chunkCount = ProcessInfo.processInfo.activeProcessorCount * 4
+
+        // Each chunk reduces it's own bounds which are then folded together in chunk order
+        var partials = [MDLAxisAlignedBoundingBox?](repeating: nil, count: chunkCount)
+        partials.withUnsafeMutableBufferPointer { partials in
+            DispatchQueue.concurrentPerform(iterations: chunkCount) { chunk in
+                var partial: MDLAxisAlignedBoundingBox?
+                for i in chunkRange(chunk, of: chunkCount, count: instances.count) {
+                    let mesh = instances[i].mesh
+                    guard meshBounds.indices.contains(mesh), let local = meshBounds[mesh] else {
+                        instances[i].minBounds = .zero
+                        instances[i].maxBounds = .zero
+                        continue
+                    }
+
+                    let matrix = instances[i].matrix
+                    let center = (matrix * SIMD4<Float>(local.center, 1)).xyz
+                    let halfExtents = local.extents * .half
+                    let extents = abs(matrix.columns.0.xyz) * halfExtents.x +
+                                  abs(matrix.columns.1.xyz) * halfExtents.y +
+                                  abs(matrix.columns.2.xyz) * halfExtents.z
+
+                    let minBounds = center - extents
+                    let maxBounds = center + extents
+                    instances[i].minBounds = minBounds
+                    instances[i].maxBounds = maxBounds
+
+                    if let current = partial {
+                        partial = .init(maxBounds: simd_max(current.maxBounds, maxBounds), minBounds: simd_min(current.minBounds, minBounds))
+                    } else {
+                        partial = .init(maxBounds: maxBounds, minBounds: minBounds)
+                    }
+                }
+                partials[chunk] = partial
+            }
+        }
+
+        let boxes = partials.compactMap { $0 }
+        guard boxes.isNotEmpty else { return .zero }
+        return .init(containing: boxes)
+    }
+}
@@ -0,0 +1,287 @@
+//
+//  Geometry+Culling.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import simd
+import VimKitShaders
+
+extension Geometry {
+
+    /// A CPU reference of the visibility rules applied by the `encodeIndirectRenderCommands` kernel (see Indirect.metal).
+    ///
+    /// The same hidden state, frustum plane, clip plane and contribution rules are applied to the instance bounds
+    /// 4 instances at a time. The planes are read from the packed camera culling data, so just like the kernel only
+    /// the corner farthest along each active plane normal is tested.
+    /// Depth testing is only applied when a depth pyramid is provided (see `makeDepthPyramid`).
+    struct Culler {
+
+        /// The active frustum + clip planes (all facing inward) and the corner selection of each plane.
+        let planes: [(plane: SIMD4<Float>, positive: SIMD3<UInt32>)]
+        /// The camera projection view matrix.
+        let projectionViewMatrix: float4x4
+        /// Flag indicating if contribution culling should be performed.
+        let enableContributionTesting: Bool
+        /// The minimum area an instance must cover to contribute to the final image.
+        let minContributionArea: Float
+        /// The depth pyramid to test the instances against if depth testing is enabled.
+        let depthPyramid: DepthPyramid?
+
+        /// Initializes the culler from the per frame data that is passed to the GPU.
+        /// - Parameters:
+        ///   - frame: the per frame data
+        ///   - depthPyramid: the depth pyramid used for depth testing
+        init(_ frame: Frame, depthPyramid: DepthPyramid? = nil) {
+            let culling = frame.cameras.0.culling
+            planes = culling.activePlanes
+            projectionViewMatrix = culling.projectionViewMatrix
+            enableContributionTesting = frame.enableContributionTesting
+            minContributionArea = frame.minContributionArea
+            self.depthPyramid = frame.enableDepthTesting ? depthPyramid : nil
+        }
+
+        /// Culls the instances and writes the visibility of each instance (1 if visible, otherwise 0).
+        /// - Parameters:
+        ///   - instances: the instances to cull
+        ///   - range: the range of instances to cull (the lower bound should be a multiple of 4)
+        ///   - results: the results to write into (indexed the same as the instances)
+        func cull(_ instances: UnsafeBufferPointer<Instance>, range: Range<Int>, into results: UnsafeMutableBufferPointer<UInt8>) {
+            for i in stride(from: range.lowerBound, to: range.upperBound, by: 4) {
+                let count = Swift.min(4, range.upperBound - i)
+                let culled = cull(count) { instances[i + $0] }
+                for lane in 0..<count {
+                    results[i + lane] = culled[lane] ? 0 : 1
+                }
+            }
+        }
+
+        /// Culls the instances at the specified indices (such as the instances inside the leaves a BVH traversal visits).
+        /// - Parameters:
+        ///   - instances: the instances
+        ///   - indices: the indices of the instances to cull
+        /// - Returns: the indices of the visible instances in the same order they were given
+        func cull(_ instances: UnsafeBufferPointer<Instance>, indices: [Int]) -> [Int] {
+            var visible = [Int]()
+            for i in stride(from: 0, to: indices.count, by: 4) {
+                let count = Swift.min(4, indices.count - i)
+                let culled = cull(count) { instances[indices[i + $0]] }
+                for lane in 0..<count where !culled[lane] {
+                    visible.append(indices[i + lane])
+                }
+            }
+            return visible
+        }
+
+        /// Returns true if the box isn't completely outside of any of the frustum or clip planes.
+        /// This is the same plane test the instances go through and is used to prune BVH nodes.
+        /// - Parameter box: the box to test
+        /// - Returns: true if the box is inside or intersects the frustum and clip planes
+        func contains(_ box: MDLAxisAlignedBoundingBox) -> Bool {
+            for (plane, positive) in planes {
+                let corner = SIMD3<Float>(positive.x != 0 ? box.maxBounds.x : box.minBounds.x,
+                                          positive.y != 0 ? box.maxBounds.y : box.minBounds.y,
+                                          positive.z != 0 ? box.maxBounds.z : box.minBounds.z)
+                if dot(plane, SIMD4<Float>(corner, 1)) < 0 {
+                    return false
+                }
+            }
+            return true
+        }
+
+        /// Culls up to 4 instances at a time.
+        /// - Parameters:
+        ///   - count: the number of instances to cull (at most 4)
+        ///   - instance: returns the instance for the specified lane
+        /// - Returns: the lanes of the instances that were culled
+        private func cull(_ count: Int, _ instance: (Int) -> Instance) -> SIMDMask<SIMD4<Int32>> {
+
+            // 1) Load the bounds and hidden state of up to 4 instances
+            var minX = SIMD4<Float>.zero, minY = SIMD4<Float>.zero, minZ = SIMD4<Float>.zero
+            var maxX = SIMD4<Float>.zero, maxY = SIMD4<Float>.zero, maxZ = SIMD4<Float>.zero
+            var culled = SIMDMask<SIMD4<Int32>>(repeating: false)
+            for lane in 0..<count {
+                let instance = instance(lane)
+                let minBounds = instance.minBounds
+                let maxBounds = instance.maxBounds
+                minX[lane] = minBounds.x
+                minY[lane] = minBounds.y
+                minZ[lane] = minBounds.z
+                maxX[lane] = maxBounds.x
+                maxY[lane] = maxBounds.y
+                maxZ[lane] = maxBounds.z
+                culled[lane] = instance.state == .hidden
+            }
+
+            // 2) Frustum + clip planes (culled if the corner farthest along the plane normal is behind the plane)
+            for (plane, positive) in planes {
+                let x = positive.x != 0 ? maxX : minX
+                let y = positive.y != 0 ? maxY : minY
+                let z = positive.z != 0 ? maxZ : minZ
+                culled .|= (plane.x * x + plane.y * y + plane.z * z + plane.w) .< 0
+            }
+
+            // 3) Contribution (culled if the projected bounds cover too small of an area)
+            if enableContributionTesting {
+                let boxMin = project(minX, minY, minZ)
+                let boxMax = project(maxX, maxY, maxZ)
+                let length = boxMax.x - boxMin.x
+                let width = boxMax.y - boxMin.y
+                let height = boxMax.z - boxMin.z
+                let area = simd_abs(2 * (length * width + width * height + height * length))
+                culled .|= area .< minContributionArea
+            }
+
+            // 4) Depth (culled if the bounds are completely behind the depth pyramid)
+            if let depthPyramid {
+                for lane in 0..<count where !culled[lane] {
+                    let minBounds = SIMD3<Float>(minX[lane], minY[lane], minZ[lane])
+                    let maxBounds = SIMD3<Float>(maxX[lane], maxY[lane], maxZ[lane])
+                    culled[lane] = depthPyramid.isOccluded(minBounds: minBounds, maxBounds: maxBounds, projectionViewMatrix: projectionViewMatrix)
+                }
+            }
+
+            // Padded lanes are always culled
+            for lane in count..<4 {
+                culled[lane] = true
+            }
+            return culled
+        }
+
+        /// Transforms 4 points by the projection view matrix and performs the perspective divide.
+        private func project(_ x: SIMD4<Float>, _ y: SIMD4<Float>, _ z: SIMD4<Float>) -> (x: SIMD4<Float>, y: SIMD4<Float>, z: SIMD4<Float>) {
+            let (c0, c1, c2, c3) = projectionViewMatrix.columns
+            let w = c0.w * x + c1.w * y + c2.w * z + c3.w
+            return ((c0.x * x + c1.x * y + c2.x * z + c3.x) / w,
+                    (c0.y * x + c1.y * y + c2.y * z + c3.y) / w,
+                    (c0.z * x + c1.z * y + c2.z * z + c3.z) / w)
+        }
+    }
+
+    /// Culls every instance on the CPU with the same rules as the indirect command buffer kernel.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - depthPyramid: the depth pyramid used for depth testing
+    /// - Returns: the visibility of each instance (1 if visible, otherwise 0)
+    func cullInstances(_ frame: Frame, depthPyramid: DepthPyramid? = nil) -> [UInt8] {
+        Geometry.cullInstances(frame, instances: UnsafeBufferPointer(instances), depthPyramid: depthPyramid)
+    }
+
+    /// Culls the instances on the CPU across all available cores.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - instances: the instances to cull
+    ///   - depthPyramid: the depth pyramid used for depth testing
+    /// - Returns: the visibility of each instance (1 if visible, otherwise 0)
+    static func cullInstances(_ frame: Frame, instances: UnsafeBufferPointer<Instance>, depthPyramid: DepthPyramid? = nil) -> [UInt8] {
+        let culler = Culler(frame, depthPyramid: depthPyramid)
+        let groupCount = (instances.count + 3) / 4
+        let chunkCount = Swift.max(1, Swift.min(ProcessInfo.processInfo.activeProcessorCount * 4, groupCount))
+
+        return [UInt8](unsafeUninitializedCapacity: instances.count) { buffer, count in
+            let results = buffer
+            DispatchQueue.concurrentPerform(iterations: chunkCount) { chunk in
+                let groups = Geometry.chunkRange(chunk, of: chunkCount, count: groupCount)
+                let range = (groups.lowerBound * 4)..<Swift.min(groups.upperBound * 4, instances.count)
+                culler.cull(instances, range: range, into: results)
+            }
+            count = instances.count
+        }
+    }
+
+    /// Compacts the visible instances of each instanced mesh with the same layout as the `compactVisibleInstances` kernel.
+    ///
+    /// Each instanced mesh owns the range of ids starting at it's base instance and the ids of it's visible
+    /// instances are packed to the front of that range in their original order.
+    /// - Parameters:
+    ///   - visible: the visibility of each instance (1 if visible, otherwise 0)
+    ///   - instancedMeshes: the instanced meshes
+    /// - Returns: the compacted instance ids (only the first `counts[i]` ids of each range are valid) and the visible instance count of each instanced mesh
+    static func compact(_ visible: [UInt8], instancedMeshes: [InstancedMesh]) -> (ids: [UInt32], counts: [UInt32]) {
+        var ids = [UInt32](repeating: .zero, count: visible.count)
+        var counts = [UInt32](repeating: .zero, count: instancedMeshes.count)
+        for (i, instanced) in instancedMeshes.enumerated() {
+            let lowerBound = instanced.baseInstance
+            var count = 0
+            for j in lowerBound..<(lowerBound + instanced.instanceCount) where visible[j] == 1 {
+                ids[lowerBound + count] = UInt32(j)
+                count += 1
+            }
+            counts[i] = UInt32(count)
+        }
+        return (ids, counts)
+    }
+
+    /// Culls the instances on the CPU and compacts the survivors the same way the indirect command buffer kernels do.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - depthPyramid: the depth pyramid used for depth testing
+    /// - Returns: the compacted instance ids and the visible instance count of each instanced mesh
+    public func compactVisibleInstances(_ frame: Frame, depthPyramid: DepthPyramid? = nil) -> (ids: [UInt32], counts: [UInt32]) {
+        Geometry.compact(cullInstances(frame, depthPyramid: depthPyramid), instancedMeshes: instancedMeshes)
+    }
+
+    /// Returns the instanced meshes that have at least one instance that passes the CPU culling rules.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - depthPyramid: the depth pyramid used for depth testing
+    /// - Returns: the indices of the visible instanced meshes in ascending order
+    public func visibleInstancedMeshes(_ frame: Frame, depthPyramid: DepthPyramid? = nil) -> [Int] {
+        let visible = cullInstances(frame, depthPyramid: depthPyramid)
+        return instancedMeshes.indices.filter { i in
+            let instanced = instancedMeshes[i]
+            return visible[instanced.baseInstance..<(instanced.baseInstance + instanced.instanceCount)].contains(1)
+        }
+    }
+
+    /// Returns the instanced meshes that have at least one instance that passes the CPU culling rules,
+    /// using the bounding volume hierarchy as the broad phase.
+    ///
+    /// Only the nodes that pass the frustum + clip plane tests (and aren't fully hidden) are walked and only the
+    /// instances inside the visited leaves are culled, so the result is the same as `visibleInstancedMeshes(_:depthPyramid:)`
+    /// without testing every instance.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - bvh: the bounding volume hierarchy
+    /// - Returns: the indices of the visible instanced meshes in ascending order
+    func visibleInstancedMeshes(_ frame: Frame, bvh: BVH) -> [Int] {
+        let culler = Culler(frame)
+        var candidates = [Int]()
+        bvh.traverse { node in
+            culler.contains(node.box)
+        } visit: { instance in
+            candidates.append(instance)
+        }
+
+        var results = Set<Int>()
+        for i in culler.cull(UnsafeBufferPointer(instances), indices: candidates) {
+            if let index = instancedMeshesMap[i] {
+                results.insert(index)
+            }
+        }
+        return results.sorted()
+    }
+
+    /// Culls the instances on the CPU and returns the same executed commands that the indirect command buffer kernel writes.
+    ///
+    /// The commands are layed out over the `gridSize` where the command at `y + x * height` is executed (1) if
+    /// the instanced mesh `y` is visible, otherwise 0.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - depthPyramid: the depth pyramid used for depth testing
+    /// - Returns: the executed commands
+    public func executedCommands(_ frame: Frame, depthPyramid: DepthPyramid? = nil) -> [UInt8] {
+        let width = gridSize.width
+        let height = gridSize.height
+        var commands = [UInt8](repeating: .zero, count: width * height)
+        for y in visibleInstancedMeshes(frame, depthPyramid: depthPyramid) {
+            for x in 0..<width {
+                commands[y + x * height] = 1
+            }
+        }
+        return commands
+    }
+}
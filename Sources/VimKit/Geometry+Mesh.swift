@@ -25,6 +25,58 @@ extension InstancedMesh {
 
 extension Instance {
 
+    /// The index of the instance.
+    public var index: Int {
+        get { Int(__index) }
+        set { __index = UInt32(newValue) }
+    }
+
+    /// The index of the color override to use from the colors buffer (-1 indicates no override).
+    public var colorIndex: Int {
+        get { Int(__colorIndex) }
+        set { __colorIndex = Int16(newValue) }
+    }
+
+    /// The 4x4 matrix representing the node's world-space transform.
+    /// The matrix is stored as it's first 3 rows as the last row of an affine transform is always [0, 0, 0, 1].
+    public var matrix: float4x4 {
+        get { float4x4(__matrix.columns.0, __matrix.columns.1, __matrix.columns.2, [0, 0, 0, 1]).transpose }
+        set {
+            let rows = newValue.transpose
+            __matrix = .init(rows.columns.0, rows.columns.1, rows.columns.2)
+        }
+    }
+
+    /// The state of the instance.
+    public var state: InstanceState {
+        get { InstanceState(rawValue: Int(__state)) ?? .default }
+        set { __state = UInt8(newValue.rawValue) }
+    }
+
+    /// The instance min bounds (in world space).
+    public var minBounds: SIMD3<Float> {
+        get { __minBounds.vector }
+        set { __minBounds = .init(newValue) }
+    }
+
+    /// The instance max bounds (in world space).
+    public var maxBounds: SIMD3<Float> {
+        get { __maxBounds.vector }
+        set { __maxBounds = .init(newValue) }
+    }
+
+    /// The parent index of the instance (-1 indicates no parent).
+    public var parent: Int {
+        get { Int(__parent) }
+        set { __parent = Int32(newValue) }
+    }
+
+    /// The mesh index (-1 indicates no mesh).
+    public var mesh: Int {
+        get { Int(__mesh) }
+        set { __mesh = Int32(newValue) }
+    }
+
     /// Convenience var that returns the bounding box.
     public var boundingBox: MDLAxisAlignedBoundingBox {
         .init(maxBounds: maxBounds, minBounds: minBounds)
@@ -44,17 +96,15 @@ extension Instance {
     ///   - mesh: the mesh index (-1 indicates this instance has no mesh)
     ///   - transparent: Flag indicating if the instance is transparent or not.
     init(index: Int, matrix: float4x4, flags: Int16, parent: Int, mesh: Int, transparent: Bool) {
-        self.init(index: index,
-                  colorIndex: .empty,
-                  matrix: matrix,
-                  state: flags != .zero ? .hidden : .default,
-                  minBounds: .zero,
-                  maxBounds: .zero,
-                  parent: parent,
-                  mesh: mesh,
-                  flags: flags,
-                  transparent: transparent
-        )
+        self.init()
+        self.index = index
+        self.colorIndex = .empty
+        self.matrix = matrix
+        self.state = flags != .zero ? .hidden : .default
+        self.parent = parent
+        self.mesh = mesh
+        self.flags = flags
+        self.transparent = transparent
     }
 }
 
@@ -73,6 +123,12 @@ extension Mesh {
 
 extension Submesh {
 
+    /// The material index (-1 indicates no material).
+    public var material: Int {
+        get { Int(__material) }
+        set { __material = Int32(newValue) }
+    }
+
     /// The submesh's byte offset into the index buffer.
     public var indexBufferOffset: Int {
         Int(indices.lowerBound) * MemoryLayout<UInt32>.size
@@ -86,6 +142,6 @@ extension Submesh {
     ///   - material: The submesh's material index (-1 denotes no material).
     ///   - indices: The range of values in the index buffer.
     init(_ material: Int32, _ indices: Range<Int>) {
-        self.init(material: Int(material), indices: .init(indices))
+        self.init(__material: material, indices: .init(indices))
     }
 }
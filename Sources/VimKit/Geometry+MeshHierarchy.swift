@@ -0,0 +1,235 @@
+//
+//  Geometry+MeshHierarchy.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import VimKitShaders
+
+/// The maximum number of triangles contained in a mesh hierarchy leaf node.
+let meshLeafSize = 4
+/// The maximum number of bytes the cached mesh hierarchies can hold before they start being evicted (512MB).
+let meshHierarchiesByteLimit = 512 * 1024 * 1024
+
+extension Geometry {
+
+    /// A bottom level hierarchy over the triangles of a single mesh.
+    ///
+    /// Together with the instance hierarchy this forms a two level hierarchy: every instance of a mesh shares
+    /// the same triangle hierarchy, so raycasts transform the query into mesh space instead of transforming the triangles.
+    /// The triangle corners are copied out in leaf order so every leaf tests a contiguous run of triangles.
+    struct MeshHierarchy: Sendable {
+
+        /// The flattened nodes (see `BVH.Node`) where the leaf ranges index the triangles.
+        let nodes: [BVH.Node]
+        /// The triangle corners in mesh space (3 per triangle) in leaf order.
+        let vertices: [SIMD3<Float>]
+
+        /// The approximate number of bytes held by the hierarchy.
+        var byteCount: Int {
+            nodes.count * MemoryLayout<BVH.Node>.stride + vertices.count * MemoryLayout<SIMD3<Float>>.stride
+        }
+
+        /// Builds the triangle hierarchy of a mesh.
+        /// - Parameters:
+        ///   - mesh: the mesh to build the hierarchy for
+        ///   - positions: the vertex positions layed out in slices of [x,y,z]
+        ///   - indices: the corner indices
+        ///   - submeshes: the submeshes
+        ///   - leafSize: the maximum number of triangles contained in a leaf node
+        init(mesh: Mesh,
+             positions: UnsafeBufferPointer<Float>,
+             indices: UnsafeBufferPointer<UInt32>,
+             submeshes: UnsafeBufferPointer<Submesh>,
+             leafSize: Int = meshLeafSize) {
+
+            // 1) Gather the triangles of every submesh
+            let vertexCount = positions.count / 3
+            var corners = [SIMD3<Float>]()
+            var data = [(index: Int, box: MDLAxisAlignedBoundingBox)]()
+            for s in mesh.submeshes.range.clamped(to: submeshes.indices) {
+                let range = submeshes[s].indices.range.clamped(to: indices.indices)
+                for i in stride(from: range.lowerBound, to: range.upperBound - 2, by: 3) {
+                    let a = Int(indices[i]), b = Int(indices[i + 1]), c = Int(indices[i + 2])
+                    guard a < vertexCount, b < vertexCount, c < vertexCount else { continue }
+                    let pa = SIMD3<Float>(positions[a * 3], positions[a * 3 + 1], positions[a * 3 + 2])
+                    let pb = SIMD3<Float>(positions[b * 3], positions[b * 3 + 1], positions[b * 3 + 2])
+                    let pc = SIMD3<Float>(positions[c * 3], positions[c * 3 + 1], positions[c * 3 + 2])
+                    let box = MDLAxisAlignedBoundingBox(maxBounds: simd_max(simd_max(pa, pb), pc), minBounds: simd_min(simd_min(pa, pb), pc))
+                    data.append((index: data.count, box: box))
+                    corners.append(pa)
+                    corners.append(pb)
+                    corners.append(pc)
+                }
+            }
+
+            // 2) Build the hierarchy and copy the triangle corners out in leaf order
+            let builder = BVH.Builder(data, leafSize: leafSize)
+            nodes = builder.buildSerially()
+            var vertices = [SIMD3<Float>]()
+            vertices.reserveCapacity(corners.count)
+            for t in builder.instances {
+                let i = Int(t) * 3
+                vertices.append(corners[i])
+                vertices.append(corners[i + 1])
+                vertices.append(corners[i + 2])
+            }
+            self.vertices = vertices
+        }
+
+        /// Finds the closest triangle intersection of the query.
+        ///
+        /// The nearest child is always visited first so the closest hit found so far can cull the farther subtrees.
+        /// - Parameters:
+        ///   - query: the raycast query in mesh space
+        ///   - maxDistance: only intersections closer than this distance along the query are considered
+        /// - Returns: the distance along the query to the closest intersection or nil if nothing was hit
+        func raycast(_ query: RaycastQuery, maxDistance: Float = .infinity) -> Float? {
+            guard nodes.isNotEmpty else { return nil }
+            let inverseDirection = 1 / query.direction
+            var closest = maxDistance
+            var isHit = false
+
+            var stack = [Int]()
+            stack.reserveCapacity(64)
+            stack.append(0)
+            while let i = stack.popLast() {
+                let node = nodes[i]
+                guard let entry = node.intersection(query, inverseDirection), entry < closest else { continue }
+                if node.isLeaf {
+                    for t in node.range {
+                        guard let result = query.hitTest(vertices[t * 3], vertices[t * 3 + 1], vertices[t * 3 + 2]),
+                              result.distance < closest else { continue }
+                        closest = result.distance
+                        isHit = true
+                    }
+                } else {
+                    let left = i + 1
+                    let right = Int(node.offset)
+                    let leftEntry = nodes[left].intersection(query, inverseDirection) ?? .infinity
+                    let rightEntry = nodes[right].intersection(query, inverseDirection) ?? .infinity
+                    // Push the farther child first so the nearer child is popped next
+                    if leftEntry < rightEntry {
+                        stack.append(right)
+                        stack.append(left)
+                    } else {
+                        stack.append(left)
+                        stack.append(right)
+                    }
+                }
+            }
+            return isHit ? closest : nil
+        }
+    }
+
+    /// Returns the triangle hierarchy of the specified mesh, building and caching it if needed.
+    /// - Parameter mesh: the mesh index
+    /// - Returns: the mesh triangle hierarchy or nil if the mesh doesn't exist
+    func meshHierarchy(_ mesh: Int) -> MeshHierarchy? {
+        guard meshes.indices.contains(mesh) else { return nil }
+        if let hierarchy = meshHierarchies[mesh] {
+            return hierarchy
+        }
+        let hierarchy = MeshHierarchy(mesh: meshes[mesh],
+                                      positions: UnsafeBufferPointer(positions),
+                                      indices: UnsafeBufferPointer(indices),
+                                      submeshes: UnsafeBufferPointer(submeshes))
+        meshHierarchies.insert(hierarchy, for: mesh, cost: hierarchy.byteCount)
+        return hierarchy
+    }
+}
+
+// MARK: Instance Hierarchy Raycasting
+
+extension Geometry {
+
+    /// Finds the closest instance that intersects the query.
+    ///
+    /// The instance hierarchy is walked nearest node first and every candidate instance is tested against the
+    /// shared triangle hierarchy of it's mesh, so the search stops descending as soon as nothing closer can be hit.
+    /// If the instance hierarchy hasn't been built every instance box is tested instead.
+    /// - Parameter query: the raycast query in world space
+    /// - Returns: the slot of the closest instance hit and the raycast result or nil if nothing was hit
+    public func raycast(_ query: RaycastQuery) -> (slot: Int, result: RaycastResult)? {
+        Geometry.raycast(query, instances: UnsafeBufferPointer(instances), bvh: bvh, hierarchy: meshHierarchy)
+    }
+
+    /// Finds the closest instance that intersects the query.
+    /// - Parameters:
+    ///   - query: the raycast query in world space
+    ///   - instances: the instances to test
+    ///   - bvh: the instance hierarchy (every instance box is tested if nil)
+    ///   - hierarchy: returns the triangle hierarchy of a mesh
+    /// - Returns: the slot of the closest instance hit and the raycast result or nil if nothing was hit
+    static func raycast(_ query: RaycastQuery,
+                        instances: UnsafeBufferPointer<Instance>,
+                        bvh: BVH?,
+                        hierarchy: (Int) -> MeshHierarchy?) -> (slot: Int, result: RaycastResult)? {
+        var closest: Float = .infinity
+        var slot: Int = .empty
+
+        func test(_ i: Int) {
+            let instance = instances[i]
+            guard instance.state != .hidden,
+                  let meshHierarchy = hierarchy(instance.mesh),
+                  let result = instance.raycast(meshHierarchy, query: query, maxDistance: closest) else { return }
+            closest = result.distance
+            slot = i
+        }
+
+        if let bvh {
+            bvh.closestHit(query, closest: { closest }, visit: test)
+        } else {
+            let inverseDirection = 1 / query.direction
+            for i in instances.indices {
+                guard let entry = query.entry(minBounds: instances[i].minBounds, maxBounds: instances[i].maxBounds, inverseDirection: inverseDirection),
+                      entry < closest else { continue }
+                test(i)
+            }
+        }
+        guard slot != .empty else { return nil }
+        return (slot, RaycastResult(query: query, distance: closest))
+    }
+}
+
+extension Geometry.BoundingVolumeHierarchy {
+
+    /// Walks the nodes nearest first, skipping any node that is farther away than the closest hit found so far.
+    /// - Parameters:
+    ///   - query: the raycast query
+    ///   - closest: returns the distance to the closest hit found so far
+    ///   - visit: called for every instance of every visited leaf
+    func closestHit(_ query: Geometry.RaycastQuery, closest: () -> Float, visit: (Int) -> Void) {
+        guard nodes.isNotEmpty else { return }
+        let inverseDirection = 1 / query.direction
+
+        var stack = [Int]()
+        stack.reserveCapacity(64)
+        stack.append(0)
+        while let i = stack.popLast() {
+            let node = nodes[i]
+            guard !hidden.contains(i),
+                  let entry = node.intersection(query, inverseDirection), entry < closest() else { continue }
+            if node.isLeaf {
+                for j in node.range {
+                    visit(Int(instances[j]))
+                }
+            } else {
+                let left = i + 1
+                let right = Int(node.offset)
+                let leftEntry = nodes[left].intersection(query, inverseDirection) ?? .infinity
+                let rightEntry = nodes[right].intersection(query, inverseDirection) ?? .infinity
+                if leftEntry < rightEntry {
+                    stack.append(right)
+                    stack.append(left)
+                } else {
+                    stack.append(left)
+                    stack.append(right)
+                }
+            }
+        }
+    }
+}
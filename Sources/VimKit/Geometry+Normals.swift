@@ -0,0 +1,128 @@
+//
+//  Geometry+Normals.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import simd
+
+extension Geometry {
+
+    /// Computes the vertex normals on the CPU across all available cores.
+    ///
+    /// The normal of every vertex is the normalized sum of the (area weighted) normals of the faces that
+    /// reference it. The faces of each vertex are found through a vertex → face adjacency list (CSR) that is built
+    /// in ascending face order, so every vertex always accumulates its faces in the same order and the results are
+    /// bit for bit identical no matter how many threads the work is spread across.
+    ///
+    /// The results are laid out in slices of [x,y,z] (one slice per vertex) which is the layout of the cached normals file.
+    /// See: https://iquilezles.org/articles/normals/
+    /// - Parameters:
+    ///   - positions: the vertex positions layed out in slices of [x,y,z]
+    ///   - indices: the corner indices (3 per face)
+    /// - Returns: the vertex normals data
+    public static func vertexNormals(positions: UnsafeBufferPointer<Float>, indices: UnsafeBufferPointer<UInt32>) -> Data {
+        vertexNormals(positions: positions, indices: indices, chunkCount: ProcessInfo.processInfo.activeProcessorCount * 4)
+    }
+
+    /// Computes the vertex normals with the work split into the specified number of chunks.
+    ///
+    /// The adjacency list (steps 1 + 2) is built with a single linear pass over the indices, only the face normals
+    /// and the per vertex sums are spread across the chunks.
+    /// - Parameters:
+    ///   - positions: the vertex positions layed out in slices of [x,y,z]
+    ///   - indices: the corner indices (3 per face)
+    ///   - chunkCount: the number of chunks to split the face and vertex work into
+    /// - Returns: the vertex normals data
+    static func vertexNormals(positions: UnsafeBufferPointer<Float>, indices: UnsafeBufferPointer<UInt32>, chunkCount: Int) -> Data {
+
+        let vertexCount = positions.count / 3
+        let faceCount = indices.count / 3
+        var data = Data(count: MemoryLayout<Float>.stride * vertexCount * 3)
+        guard vertexCount > 0 else { return data }
+
+        // 1) Build the vertex → face adjacency offsets by counting the corners that reference each vertex
+        var offsets = [Int](repeating: 0, count: vertexCount + 1)
+        for i in 0..<faceCount * 3 {
+            let vertex = Int(indices[i])
+            guard vertex < vertexCount else { continue }
+            offsets[vertex + 1] += 1
+        }
+        for i in 0..<vertexCount {
+            offsets[i + 1] += offsets[i]
+        }
+
+        // 2) Fill the adjacency list with the face indices in ascending order
+        var adjacency = [UInt32](repeating: 0, count: offsets[vertexCount])
+        var cursors = offsets
+        for face in 0..<faceCount {
+            for corner in 0..<3 {
+                let vertex = Int(indices[face * 3 + corner])
+                guard vertex < vertexCount else { continue }
+                adjacency[cursors[vertex]] = UInt32(face)
+                cursors[vertex] += 1
+            }
+        }
+
+        let chunkCount = Swift.max(1, chunkCount)
+
+        // 3) Calculate the face normals in parallel
+        let faceNormals = [SIMD3<Float>](unsafeUninitializedCapacity: faceCount) { buffer, count in
+            let faceNormals = buffer
+            DispatchQueue.concurrentPerform(iterations: chunkCount) { chunk in
+                for face in chunkRange(chunk, of: chunkCount, count: faceCount) {
+                    let a = vertex(positions, indices[face * 3], vertexCount)
+                    let b = vertex(positions, indices[face * 3 + 1], vertexCount)
+                    let c = vertex(positions, indices[face * 3 + 2], vertexCount)
+                    faceNormals.initializeElement(at: face, to: cross(b - a, c - a))
+                }
+            }
+            count = faceCount
+        }
+
+        // 4) Sum the normals of the faces of each vertex and normalize them in parallel
+        data.withUnsafeMutableBytes { pointer in
+            let normals = pointer.bindMemory(to: Float.self)
+            DispatchQueue.concurrentPerform(iterations: chunkCount) { chunk in
+                for vertex in chunkRange(chunk, of: chunkCount, count: vertexCount) {
+                    var sum: SIMD3<Float> = .zero
+                    for i in offsets[vertex]..<offsets[vertex + 1] {
+                        sum += faceNormals[Int(adjacency[i])]
+                    }
+                    let n = normalize(sum)
+                    normals[vertex * 3] = n.x
+                    normals[vertex * 3 + 1] = n.y
+                    normals[vertex * 3 + 2] = n.z
+                }
+            }
+        }
+        return data
+    }
+
+    /// Returns the range of elements a chunk is responsible for.
+    /// - Parameters:
+    ///   - chunk: the chunk index
+    ///   - chunkCount: the total number of chunks
+    ///   - count: the total number of elements
+    /// - Returns: the range of elements inside the chunk
+    static func chunkRange(_ chunk: Int, of chunkCount: Int, count: Int) -> Range<Int> {
+        let size = (count + chunkCount - 1) / chunkCount
+        let lowerBound = Swift.min(chunk * size, count)
+        let upperBound = Swift.min(lowerBound + size, count)
+        return lowerBound..<upperBound
+    }
+
+    /// Returns the vertex position at the specified vertex index (or zero if the index is out of range).
+    /// - Parameters:
+    ///   - positions: the vertex positions layed out in slices of [x,y,z]
+    ///   - index: the vertex index
+    ///   - vertexCount: the total number of vertices
+    /// - Returns: the vertex position
+    private static func vertex(_ positions: UnsafeBufferPointer<Float>, _ index: UInt32, _ vertexCount: Int) -> SIMD3<Float> {
+        let i = Int(index)
+        guard i < vertexCount else { return .zero }
+        return .init(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2])
+    }
+}
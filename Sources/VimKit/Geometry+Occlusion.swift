@@ -0,0 +1,342 @@
+//
+//  Geometry+Occlusion.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import VimKitShaders
+
+extension Geometry {
+
+    /// A CPU reference of the depth pyramid (Hi-Z) built by the `depthPyramid` kernels (see DepthPyramid.metal).
+    ///
+    /// The first level is half the size of the depth buffer and every level after that is half the level before it
+    /// (rounded down like metal mipmaps). Each texel holds the farthest depth of every texel it covers in the level below.
+    public struct DepthPyramid: Sendable {
+
+        /// The size of each level.
+        public let sizes: [SIMD2<Int>]
+        /// The depth values of each level layed out in rows.
+        let levels: [[Float]]
+
+        /// Builds the depth pyramid from a depth buffer.
+        /// - Parameters:
+        ///   - depth: the depth buffer layed out in rows (top row first)
+        ///   - width: the depth buffer width
+        ///   - height: the depth buffer height
+        public init(depth: [Float], width: Int, height: Int) {
+            var size = SIMD2<Int>(Swift.max(1, width / 2), Swift.max(1, height / 2))
+            var sizes = [size]
+            var levels = [DepthPyramid.reduce(depth, from: [width, height], to: size)]
+            while size.x > 1 || size.y > 1 {
+                let next = SIMD2<Int>(Swift.max(1, size.x / 2), Swift.max(1, size.y / 2))
+                levels.append(DepthPyramid.reduce(levels[levels.count - 1], from: size, to: next))
+                sizes.append(next)
+                size = next
+            }
+            self.sizes = sizes
+            self.levels = levels
+        }
+
+        /// Returns the depth of the texel at the specified level.
+        /// - Parameters:
+        ///   - level: the pyramid level
+        ///   - x: the texel column
+        ///   - y: the texel row
+        /// - Returns: the farthest depth covered by the texel
+        public func depth(level: Int, x: Int, y: Int) -> Float {
+            levels[level][y * sizes[level].x + x]
+        }
+
+        /// Checks if the bounds are completely behind the depth pyramid with the same rules as the `isOccluded` shader function.
+        ///
+        /// The projected bounds are tested against the first level where they cover no more than 2x2 texels.
+        /// Bounds that cross the near plane are never occluded.
+        /// - Parameters:
+        ///   - minBounds: the min bounds
+        ///   - maxBounds: the max bounds
+        ///   - projectionViewMatrix: the camera projection view matrix
+        /// - Returns: true if the bounds are occluded
+        public func isOccluded(minBounds: SIMD3<Float>, maxBounds: SIMD3<Float>, projectionViewMatrix: float4x4) -> Bool {
+            var uvMin = SIMD2<Float>(repeating: 1)
+            var uvMax = SIMD2<Float>.zero
+            var minDepth: Float = 1
+
+            for i in 0..<8 {
+                let corner = SIMD4<Float>(i & 1 == 0 ? minBounds.x : maxBounds.x,
+                                          i & 2 == 0 ? minBounds.y : maxBounds.y,
+                                          i & 4 == 0 ? minBounds.z : maxBounds.z, 1)
+                let clip = projectionViewMatrix * corner
+                guard clip.w > 0 else { return false }
+                let ndc = clip.xyz / clip.w
+                let uv = SIMD2<Float>(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5)
+                uvMin = simd_min(uvMin, uv)
+                uvMax = simd_max(uvMax, uv)
+                minDepth = Swift.min(minDepth, ndc.z)
+            }
+
+            uvMin = simd_clamp(uvMin, .zero, .one)
+            uvMax = simd_clamp(uvMax, .zero, .one)
+            let extent = uvMax - uvMin
+
+            var level = 0
+            while level + 1 < sizes.count, any(extent * SIMD2<Float>(sizes[level]) .> 1) {
+                level += 1
+            }
+
+            let size = sizes[level]
+            let x0 = Swift.min(Int(uvMin.x * Float(size.x)), size.x - 1)
+            let y0 = Swift.min(Int(uvMin.y * Float(size.y)), size.y - 1)
+            let x1 = Swift.min(Int(uvMax.x * Float(size.x)), size.x - 1)
+            let y1 = Swift.min(Int(uvMax.y * Float(size.y)), size.y - 1)
+            let maxDepth = Swift.max(Swift.max(depth(level: level, x: x0, y: y0), depth(level: level, x: x1, y: y0)),
+                                     Swift.max(depth(level: level, x: x0, y: y1), depth(level: level, x: x1, y: y1)))
+            return minDepth > maxDepth
+        }
+
+        /// Reduces a level by keeping the farthest depth of every source texel each destination texel covers.
+        /// - Parameters:
+        ///   - source: the source depth values
+        ///   - sourceSize: the source size
+        ///   - size: the destination size
+        /// - Returns: the destination depth values
+        private static func reduce(_ source: [Float], from sourceSize: SIMD2<Int>, to size: SIMD2<Int>) -> [Float] {
+            var results = [Float](repeating: 0, count: size.x * size.y)
+            for y in 0..<size.y {
+                let lowerY = y * sourceSize.y / size.y
+                let upperY = Swift.min(((y + 1) * sourceSize.y + size.y - 1) / size.y, sourceSize.y)
+                for x in 0..<size.x {
+                    let lowerX = x * sourceSize.x / size.x
+                    let upperX = Swift.min(((x + 1) * sourceSize.x + size.x - 1) / size.x, sourceSize.x)
+                    var depth: Float = 0
+                    for sy in lowerY..<upperY {
+                        for sx in lowerX..<upperX {
+                            depth = Swift.max(depth, source[sy * sourceSize.x + sx])
+                        }
+                    }
+                    results[y * size.x + x] = depth
+                }
+            }
+            return results
+        }
+    }
+
+    /// A coarse software depth rasterizer used to render occluders without a GPU.
+    ///
+    /// Coverage is inner conservative: a pixel is only written if all 4 of it's corners are inside the triangle and it
+    /// receives the farthest depth of those corners, so the depth buffer never claims to hide anything the GPU would draw.
+    /// Triangles that cross the near plane are skipped.
+    struct DepthRasterizer {
+
+        /// The depth buffer width.
+        let width: Int
+        /// The depth buffer height.
+        let height: Int
+        /// The depth buffer layed out in rows (top row first) and cleared to the far plane.
+        private(set) var depth: [Float]
+
+        /// Initializes the rasterizer with a cleared depth buffer.
+        /// - Parameters:
+        ///   - width: the depth buffer width
+        ///   - height: the depth buffer height
+        init(width: Int, height: Int) {
+            self.width = width
+            self.height = height
+            self.depth = .init(repeating: 1, count: width * height)
+        }
+
+        /// Rasterizes the triangle into the depth buffer.
+        /// - Parameters:
+        ///   - pa: the first point of the triangle
+        ///   - pb: the second point of the triangle
+        ///   - pc: the third point of the triangle
+        ///   - projectionViewMatrix: the camera projection view matrix
+        mutating func rasterize(_ pa: SIMD3<Float>, _ pb: SIMD3<Float>, _ pc: SIMD3<Float>, projectionViewMatrix: float4x4) {
+            guard let a = project(pa, projectionViewMatrix),
+                  var b = project(pb, projectionViewMatrix),
+                  var c = project(pc, projectionViewMatrix) else { return }
+
+            var area = edge(a, b, c)
+            guard area != 0, area.isFinite else { return }
+            if area < 0 {
+                swap(&b, &c)
+                area = -area
+            }
+
+            // The pixels whose corners all lie inside the triangle bounds
+            let minX = Swift.max(0, Int(Swift.min(a.x, b.x, c.x).rounded(.up)))
+            let minY = Swift.max(0, Int(Swift.min(a.y, b.y, c.y).rounded(.up)))
+            let maxX = Swift.min(width, Int(Swift.max(a.x, b.x, c.x).rounded(.down)))
+            let maxY = Swift.min(height, Int(Swift.max(a.y, b.y, c.y).rounded(.down)))
+            guard minX < maxX, minY < maxY else { return }
+
+            for y in minY..<maxY {
+                for x in minX..<maxX {
+                    var farthest: Float = 0
+                    var isInside = true
+                    for j in 0..<4 {
+                        let corner = SIMD2<Float>(Float(x + (j & 1)), Float(y + (j >> 1)))
+                        let w0 = edge(b, c, corner)
+                        let w1 = edge(c, a, corner)
+                        let w2 = edge(a, b, corner)
+                        guard w0 >= 0, w1 >= 0, w2 >= 0 else {
+                            isInside = false
+                            break
+                        }
+                        farthest = Swift.max(farthest, (w0 * a.z + w1 * b.z + w2 * c.z) / area)
+                    }
+                    guard isInside else { continue }
+                    let i = y * width + x
+                    depth[i] = Swift.min(depth[i], farthest)
+                }
+            }
+        }
+
+        /// Projects the point into pixel space (x, y) and depth (z).
+        /// - Returns: the projected point or nil if the point is behind the near plane
+        private func project(_ point: SIMD3<Float>, _ projectionViewMatrix: float4x4) -> SIMD3<Float>? {
+            let clip = projectionViewMatrix * SIMD4<Float>(point, 1)
+            guard clip.w > 0 else { return nil }
+            let ndc = clip.xyz / clip.w
+            guard ndc.z >= 0 else { return nil }
+            return [(ndc.x * 0.5 + 0.5) * Float(width), (0.5 - ndc.y * 0.5) * Float(height), ndc.z]
+        }
+
+        /// The signed edge function of the point against the edge from a to b.
+        private func edge(_ a: SIMD3<Float>, _ b: SIMD3<Float>, _ p: SIMD3<Float>) -> Float {
+            (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)
+        }
+
+        /// The signed edge function of the point against the edge from a to b.
+        private func edge(_ a: SIMD3<Float>, _ b: SIMD3<Float>, _ p: SIMD2<Float>) -> Float {
+            (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)
+        }
+    }
+}
+
+// MARK: Occlusion Culling
+
+extension Geometry {
+
+    /// The culling results of a single frame.
+    public struct CullingResults: Sendable {
+        /// The total number of instances.
+        public let instanceCount: Int
+        /// The number of instances that pass the hidden state, frustum, clip plane and contribution tests.
+        public let frustumVisibleCount: Int
+        /// The number of instances that also pass the depth pyramid test.
+        public let visibleCount: Int
+
+        /// The fraction of instances removed by the hidden state, frustum, clip plane and contribution tests.
+        public var frustumCullRate: Double {
+            instanceCount > 0 ? Double(instanceCount - frustumVisibleCount) / Double(instanceCount) : 0
+        }
+
+        /// The fraction of the frustum visible instances removed by the depth pyramid test.
+        public var occlusionCullRate: Double {
+            frustumVisibleCount > 0 ? Double(frustumVisibleCount - visibleCount) / Double(frustumVisibleCount) : 0
+        }
+    }
+
+    /// Builds a depth pyramid on the CPU by rasterizing the largest instances on screen.
+    ///
+    /// The opaque instances that pass the frustum tests are ranked by the size of their bounds relative to their
+    /// distance from the camera and the triangles of the top `occluderCount` instances are rasterized.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - width: the depth buffer width (the first pyramid level is half of this)
+    ///   - height: the depth buffer height (the first pyramid level is half of this)
+    ///   - occluderCount: the maximum number of instances to rasterize
+    /// - Returns: the depth pyramid of the occluders
+    public func makeDepthPyramid(_ frame: Frame, width: Int = 512, height: Int = 256, occluderCount: Int = 64) -> DepthPyramid {
+        Geometry.makeDepthPyramid(frame, instances: UnsafeBufferPointer(instances), width: width, height: height, occluderCount: occluderCount, hierarchy: meshHierarchy)
+    }
+
+    /// Builds a depth pyramid on the CPU by rasterizing the largest of the specified instances on screen.
+    /// - Parameters:
+    ///   - frame: the per frame data
+    ///   - instances: the instances
+    ///   - width: the depth buffer width (the first pyramid level is half of this)
+    ///   - height: the depth buffer height (the first pyramid level is half of this)
+    ///   - occluderCount: the maximum number of instances to rasterize
+    ///   - hierarchy: returns the triangle hierarchy of a mesh
+    /// - Returns: the depth pyramid of the occluders
+    static func makeDepthPyramid(_ frame: Frame,
+                                 instances: UnsafeBufferPointer<Instance>,
+                                 width: Int,
+                                 height: Int,
+                                 occluderCount: Int,
+                                 hierarchy: (Int) -> MeshHierarchy?) -> DepthPyramid {
+        var frustumFrame = frame
+        frustumFrame.enableDepthTesting = false
+        let visible = cullInstances(frustumFrame, instances: instances)
+
+        // 1) Rank the visible opaque instances by their approximate screen size
+        let camera = frame.cameras.0
+        let position = camera.position
+        var occluders = [(index: Int, score: Float)]()
+        for (i, instance) in instances.enumerated() where visible[i] == 1 && !instance.transparent {
+            let extents = instance.maxBounds - instance.minBounds
+            let center = (instance.maxBounds + instance.minBounds) * 0.5
+            let distance = Swift.max(length_squared(center - position), .ulpOfOne)
+            occluders.append((i, length_squared(extents) / distance))
+        }
+        occluders.sort { $0.score > $1.score }
+
+        // 2) Rasterize the occluder triangles
+        let projectionViewMatrix = camera.culling.projectionViewMatrix
+        var rasterizer = DepthRasterizer(width: width, height: height)
+        for occluder in occluders.prefix(occluderCount) {
+            let instance = instances[occluder.index]
+            guard let meshHierarchy = hierarchy(instance.mesh) else { continue }
+            let matrix = projectionViewMatrix * instance.matrix
+            let vertices = meshHierarchy.vertices
+            for t in stride(from: 0, to: vertices.count, by: 3) {
+                rasterizer.rasterize(vertices[t], vertices[t + 1], vertices[t + 2], projectionViewMatrix: matrix)
+            }
+        }
+        return DepthPyramid(depth: rasterizer.depth, width: width, height: height)
+    }
+
+    /// Measures how many instances the frustum and occlusion tests remove over a recorded camera path.
+    ///
+    /// Every frame gets it's own depth pyramid rasterized from it's largest occluders (see `makeDepthPyramid`).
+    /// - Parameters:
+    ///   - frames: the per frame data of every frame in the camera path
+    ///   - occluderCount: the maximum number of instances to rasterize per frame
+    /// - Returns: the culling results of each frame
+    public func cullingResults(_ frames: [Frame], occluderCount: Int = 64) -> [CullingResults] {
+        let start = Date.now
+        defer {
+            let timeInterval = abs(start.timeIntervalSinceNow)
+            debugPrint("􀬨 Culled [\(frames.count)] frames in [\(timeInterval.stringFromTimeInterval())]")
+        }
+        return Geometry.cullingResults(frames, instances: UnsafeBufferPointer(instances), occluderCount: occluderCount, hierarchy: meshHierarchy)
+    }
+
+    /// Measures how many of the specified instances the frustum and occlusion tests remove over a recorded camera path.
+    /// - Parameters:
+    ///   - frames: the per frame data of every frame in the camera path
+    ///   - instances: the instances
+    ///   - occluderCount: the maximum number of instances to rasterize per frame
+    ///   - hierarchy: returns the triangle hierarchy of a mesh
+    /// - Returns: the culling results of each frame
+    static func cullingResults(_ frames: [Frame],
+                               instances: UnsafeBufferPointer<Instance>,
+                               occluderCount: Int,
+                               hierarchy: (Int) -> MeshHierarchy?) -> [CullingResults] {
+        frames.map { frame in
+            var frustumFrame = frame
+            frustumFrame.enableDepthTesting = false
+            var depthFrame = frame
+            depthFrame.enableDepthTesting = true
+            let depthPyramid = makeDepthPyramid(frame, instances: instances, width: 512, height: 256, occluderCount: occluderCount, hierarchy: hierarchy)
+            let frustumVisibleCount = cullInstances(frustumFrame, instances: instances).reduce(0) { $0 + Int($1) }
+            let visibleCount = cullInstances(depthFrame, instances: instances, depthPyramid: depthPyramid).reduce(0) { $0 + Int($1) }
+            return CullingResults(instanceCount: instances.count, frustumVisibleCount: frustumVisibleCount, visibleCount: visibleCount)
+        }
+    }
+}
@@ -49,22 +49,18 @@ extension Geometry {
             return RaycastQuery(origin: o, direction: d)
         }
 
-        /// Returns the plane intersection result if found.
-        /// - Parameter plane: the plane to intersect
-        /// - Returns: the plane intersection result.
-        fileprivate func intersection(plane: SIMD4<Float>) -> SIMD4<Float>? {
-            let directionDotNorm = dot(direction, plane.xyz)
-            guard directionDotNorm != .zero else { return nil }
-            let distance = -(dot(origin, plane.xyz) + plane.w) / dot(direction, plane.xyz)
-            let location = origin + distance * direction
-            return .init(location, distance)
-        }
-
-        /// Convenience method that tests if the query intersects the face.
-        /// - Parameter face: the face to test
-        /// - Returns: the raycast result if the face intersects.
-        fileprivate func hitTest(face: Geometry.Face) -> Geometry.RaycastResult? {
-            hitTest(face.a, face.b, face.c)
+        /// Performs a slab test of the query against the bounds.
+        /// - Parameters:
+        ///   - minBounds: the min bounds
+        ///   - maxBounds: the max bounds
+        ///   - inverseDirection: the reciprocal of the query direction (computed once per query)
+        /// - Returns: the distance along the query where it enters the bounds (zero if the origin is inside) or nil if the bounds are missed.
+        func entry(minBounds: SIMD3<Float>, maxBounds: SIMD3<Float>, inverseDirection: SIMD3<Float>) -> Float? {
+            let t0 = (minBounds - origin) * inverseDirection
+            let t1 = (maxBounds - origin) * inverseDirection
+            let near = Swift.max(simd_min(t0, t1).max(), .zero)
+            let far = simd_max(t0, t1).min()
+            return near <= far ? near : nil
         }
 
         /// Tests if the query intersects the triangle.
@@ -74,7 +70,7 @@ extension Geometry {
         ///   - pb: the second point of the triangle
         ///   - pc: the third point of the triangle
         /// - Returns: the raycast result if the triangle intersects.
-        fileprivate func hitTest(_ pa: SIMD3<Float>, _ pb: SIMD3<Float>, _ pc: SIMD3<Float>) -> Geometry.RaycastResult? {
+        func hitTest(_ pa: SIMD3<Float>, _ pb: SIMD3<Float>, _ pc: SIMD3<Float>) -> Geometry.RaycastResult? {
 
             let edgeA = pb - pa
             let edgeB = pc - pa
@@ -155,25 +151,38 @@ extension Instance {
     /// - Parameters:
     ///   - geometry: the geometry container that holds the instance mesh and submesh
     ///   - query: the raycast query.
+    ///   - maxDistance: only intersections closer than this distance along the query are considered
     /// - Returns: the result of the query.
-    func raycast(_ geometry: Geometry, query: Geometry.RaycastQuery) -> Geometry.RaycastResult? {
-
-        guard let faces = geometry.faces(for: self), faces.isNotEmpty else { return nil }
-        var results = [Geometry.RaycastResult]()
+    func raycast(_ geometry: Geometry, query: Geometry.RaycastQuery, maxDistance: Float = .infinity) -> Geometry.RaycastResult? {
+        guard let hierarchy = geometry.meshHierarchy(mesh) else { return nil }
+        return raycast(hierarchy, query: query, maxDistance: maxDistance)
+    }
 
-        // Transform the query into local space
+    /// Performs an intersection test of the instance against the query using the triangle hierarchy of it's mesh.
+    /// - Parameters:
+    ///   - hierarchy: the triangle hierarchy of the instance mesh
+    ///   - query: the raycast query.
+    ///   - maxDistance: only intersections closer than this distance along the query are considered
+    /// - Returns: the result of the query.
+    func raycast(_ hierarchy: Geometry.MeshHierarchy, query: Geometry.RaycastQuery, maxDistance: Float = .infinity) -> Geometry.RaycastResult? {
+        // Transform the query into mesh space (the distance along an affinely transformed ray is unchanged)
         let localQuery = matrix.inverse * query
-        for face in faces {
-            if let hit = localQuery.hitTest(face: face) {
-                // Transform the result point back into world space
-                let worldPoint = matrix * SIMD4<Float>(hit.position, 1)
-                let worldDistance = query.interpolate(worldPoint)
-                let result = Geometry.RaycastResult(query: query, distance: worldDistance)
-                results.append(result)
-            }
-        }
-        // Sort the results by distance and return the first one
-        return results.sorted{ $0 < $1 }.first
+        guard let distance = hierarchy.raycast(localQuery, maxDistance: maxDistance) else { return nil }
+        return Geometry.RaycastResult(query: query, distance: distance)
+    }
+}
+
+// MARK: BVH Node Querying
+
+extension Geometry.BoundingVolumeHierarchy.Node {
+
+    /// Performs a slab test of the node bounds against the query.
+    /// - Parameters:
+    ///   - query: the raycast query
+    ///   - inverseDirection: the reciprocal of the query direction
+    /// - Returns: the distance along the query where it enters the node or nil if the node is missed.
+    func intersection(_ query: Geometry.RaycastQuery, _ inverseDirection: SIMD3<Float>) -> Float? {
+        query.entry(minBounds: minBounds.vector, maxBounds: maxBounds.vector, inverseDirection: inverseDirection)
     }
 }
 
@@ -185,88 +194,20 @@ extension MDLAxisAlignedBoundingBox {
     /// - Parameter query: the raycast query
     /// - Returns: true if the ray intersects this box.
     func intersects(_ query: Geometry.RaycastQuery) -> Bool {
-
-        var xMin = (minBounds.x - query.origin.x) / query.direction.x
-        var xMax = (maxBounds.x - query.origin.x) / query.direction.x
-        if xMin > xMax {
-            swap(&xMin, &xMax)
-        }
-
-        var yMin = (minBounds.y - query.origin.y) / query.direction.y
-        var yMax = (maxBounds.y - query.origin.y) / query.direction.y
-        if yMin > yMax {
-            swap(&yMin, &yMax)
-        }
-
-        if (xMin > yMax) || (yMin > xMax) {
-            return false
-        }
-
-        if yMin > xMin {
-            xMin = yMin
-        }
-
-        if yMax < xMax {
-            xMax = yMax
-        }
-
-        var zMin = (minBounds.z - query.origin.z) / query.direction.z
-        var zMax = (maxBounds.z - query.origin.z) / query.direction.z
-
-        if zMin > zMax {
-            swap(&zMin, &zMax)
-        }
-
-        if (xMin > zMax) || (zMin > xMax) {
-            return false
-        }
-
-        if zMin > xMin {
-            xMin = zMin
-        }
-
-        if zMax < xMax {
-            xMax = zMax
-        }
-        return true
+        query.entry(minBounds: minBounds, maxBounds: maxBounds, inverseDirection: 1 / query.direction) != nil
     }
 
     /// Performs an intersection test of the bounding box against the query.
+    /// If the query origin is inside the box the result is where the ray leaves the box.
     /// - Parameter query: the raycast query.
     /// - Returns: the raycast result of the query.
     func raycast(_ query: Geometry.RaycastQuery) -> Geometry.RaycastResult? {
-        var position: SIMD4<Float> = .invalid
-        intersection(query, sideNormal: .xpositive, position: &position)
-        intersection(query, sideNormal: .xnegative, position: &position)
-        intersection(query, sideNormal: .ypositive, position: &position)
-        intersection(query, sideNormal: .ynegative, position: &position)
-        intersection(query, sideNormal: .zpositive, position: &position)
-        intersection(query, sideNormal: .znegative, position: &position)
-        guard position != .invalid else { return nil }
-        let d = distance(query.origin, position.xyz)
-        return Geometry.RaycastResult(query: query, distance: d)
-    }
-
-    /// Performs an intersection test of the bounding box against the query.
-    /// - Parameters:
-    ///   - query: the ray cast query.
-    ///   - sideNormal: the side normal
-    ///   - hit: the updated hit
-    private func intersection(_ query: Geometry.RaycastQuery, sideNormal: SIMD3<Float>, position: inout SIMD4<Float>) {
-        let corner = sideNormal.x + sideNormal.y + sideNormal.z > .zero ? maxBounds : minBounds
-        let sidePlane = SIMD4<Float>(sideNormal, -dot(corner, sideNormal))
-
-        guard var sideHit = query.intersection(plane: sidePlane), sideHit.w > .zero else {
-            return
-        }
-
-        if sideNormal.x == 1.0 { sideHit.x = corner.x }
-        if sideNormal.y == 1.0 { sideHit.y = corner.y }
-        if sideNormal.z == 1.0 { sideHit.z = corner.z }
-
-        if sideHit.w < position.w {
-            position = sideHit
-        }
+        let inverseDirection = 1 / query.direction
+        let t0 = (minBounds - query.origin) * inverseDirection
+        let t1 = (maxBounds - query.origin) * inverseDirection
+        let near = simd_min(t0, t1).max()
+        let far = simd_max(t0, t1).min()
+        guard near <= far, far > .zero else { return nil }
+        return Geometry.RaycastResult(query: query, distance: near > .zero ? near : far)
     }
 }
-
@@ -9,9 +9,14 @@ import Foundation
 import MetalKit
 import simd
 import Spatial
+import VimKitShaders
 
-/// The maximum number of indexes that should be contained in this node.
-private let nodeThreshold = 8
+/// The default maximum number of instances that should be contained in a leaf node.
+let defaultLeafSize = 4
+/// The number of bins used to evaluate the surface area heuristic.
+private let binCount = 16
+/// The minimum number of instances a node must contain before it's subtrees are built concurrently.
+private let parallelThreshold = 4096
 
 extension Geometry {
 
@@ -57,92 +62,198 @@ extension Geometry {
     /// a spatial index and perform raycasting to quickly find intersecting geometry
     struct BoundingVolumeHierarchy {
 
-        struct Node {
+        /// A fixed size (32 byte) node of the flattened hierarchy.
+        ///
+        /// The nodes are stored depth first in a single contiguous array where the first child of an
+        /// interior node always directly follows it's parent, so only the index of the second child is stored.
+        struct Node: Sendable {
 
-            /// The axis aligned bounding box that fully contains the geometry in this node.
-            var box: MDLAxisAlignedBoundingBox
-            /// The instanced mesh indexes that are contained in this node
-            var instances = [Int]()
-            /// The child nodes
-            var children = [Node]()
-            /// A flag denoting whether the node is a leaf.
-            var isLeaf: Bool = false
-
-            /// Initializer
-            init(_ data: inout [(index: Int, box: MDLAxisAlignedBoundingBox)]) {
-                self.box = MDLAxisAlignedBoundingBox(containing: data.map { $0.box })
-                if data.count > nodeThreshold {
-
-                    sort(&data)
+            /// The min bounds of the box that fully contains the geometry in this node.
+            var minBounds: PackedFloat3
+            /// The offset of the first instance in the `instances` array for leaf nodes
+            /// or the index of the second child for interior nodes.
+            var offset: UInt32
+            /// The max bounds of the box that fully contains the geometry in this node.
+            var maxBounds: PackedFloat3
+            /// The number of instances contained in a leaf node (zero for interior nodes).
+            var count: UInt32
 
-                    let halfed = data.split()
-                    var left = halfed.0
-                    var right = halfed.1
+            /// The axis aligned bounding box that fully contains the geometry in this node.
+            var box: MDLAxisAlignedBoundingBox {
+                .init(maxBounds: maxBounds.vector, minBounds: minBounds.vector)
+            }
 
-                    if !left.isEmpty {
-                        children.append(Node(&left))
-                    }
+            /// A flag denoting whether the node is a leaf.
+            var isLeaf: Bool {
+                count > 0
+            }
 
-                    if !right.isEmpty {
-                        children.append(Node(&right))
-                    }
+            /// The range of the node instances inside the `instances` array (empty for interior nodes).
+            var range: Range<Int> {
+                Int(offset)..<Int(offset + count)
+            }
 
-                } else {
-                    isLeaf = true
-                    instances = data.map { $0.index }
-                }
+            /// Initializes a leaf node.
+            /// - Parameters:
+            ///   - box: the box that contains all of the instances
+            ///   - range: the range of the instances inside the `instances` array
+            init(box: MDLAxisAlignedBoundingBox, range: Range<Int>) {
+                self.minBounds = .init(box.minBounds)
+                self.maxBounds = .init(box.maxBounds)
+                self.offset = UInt32(range.lowerBound)
+                self.count = UInt32(range.count)
             }
 
-            /// Sorts the nodes.
-            @discardableResult
-            private func sort(_ data: inout [(index: Int, box: MDLAxisAlignedBoundingBox)]) -> Axis3D {
-
-                // The axis to sort on
-                let axis = box.longestAxis
-
-                // 2) Sort the data along largest axis
-                data.sort {
-                    switch axis {
-                    case .x:
-                        return $0.box.center.x < $1.box.center.x
-                    case .y:
-                        return $0.box.center.y < $1.box.center.y
-                    case .z:
-                        return $0.box.center.z < $1.box.center.z
-                    default:
-                        return $0.box.center.x < $1.box.center.x
-                    }
-                }
-                return axis
+            /// Initializes an interior node.
+            /// - Parameters:
+            ///   - box: the box that contains all of the children
+            ///   - secondChild: the index of the second child
+            init(box: MDLAxisAlignedBoundingBox, secondChild: Int) {
+                self.minBounds = .init(box.minBounds)
+                self.maxBounds = .init(box.maxBounds)
+                self.offset = UInt32(secondChild)
+                self.count = .zero
             }
         }
 
         /// A weak reference to the geometry container.
         private weak var geometry: Geometry?
 
-        /// The root node of the volume hierarchy
-        private var root: Node
+        /// The flattened nodes with the root node at index 0 (empty if the hierarchy contains no instances).
+        private(set) var nodes: [Node]
+
+        /// The instance indices referenced by the leaf nodes (each leaf references a contiguous range).
+        private(set) var instances: [UInt32]
+
+        /// The parent index of each node (-1 for the root node).
+        private var parents = [Int32]()
+
+        /// The index of the leaf node that contains each instance (indexed by the instance index, -1 if not contained).
+        private var leaves = [Int32]()
+
+        /// The number of visible (not hidden) instances inside the subtree of each node.
+        private var visibleCounts = [UInt32]()
+
+        /// The nodes where every instance inside the subtree is hidden (pruned while traversing).
+        private(set) var hidden = Geometry.SlotSet(capacity: 0)
 
         /// Returns the bounds of the entire hierarchy
         var bounds: MDLAxisAlignedBoundingBox {
-            root.box
+            nodes.first?.box ?? .zero
         }
 
         /// Intializes the bounding volume with the specified geometry.
-        /// - Parameter geometry: the geomety to use
-        init(_ geometry: Geometry) async {
+        /// - Parameters:
+        ///   - geometry: the geomety to use
+        ///   - leafSize: the maximum number of instances contained in a leaf node
+        init(_ geometry: Geometry, leafSize: Int = defaultLeafSize) async {
             let start = Date.now
             defer {
                 let timeInterval = abs(start.timeIntervalSinceNow)
                 debugPrint("􀬨 BVH made in [\(timeInterval.stringFromTimeInterval())]")
             }
-            self.geometry = geometry
             var data = [(index: Int, box: MDLAxisAlignedBoundingBox)]()
             for (i, instance) in geometry.instances.enumerated() {
                 guard instance.boundingBox != .zero else { continue }
                 data.append((index: i, box: instance.boundingBox))
             }
-            root = Node(&data)
+            await self.init(data, leafSize: leafSize)
+            self.geometry = geometry
+        }
+
+        /// Intializes the bounding volume from previously built nodes (see `Geometry.restoreSpatialIndex`).
+        /// - Parameters:
+        ///   - geometry: the geomety the nodes were built from
+        ///   - nodes: the flattened nodes
+        ///   - instances: the instance indices referenced by the leaf nodes
+        init(_ geometry: Geometry, nodes: [Node], instances: [UInt32]) {
+            self.geometry = geometry
+            self.nodes = nodes
+            self.instances = instances
+            link()
+        }
+
+        /// Intializes the bounding volume from a list of instance boxes.
+        /// - Parameters:
+        ///   - data: the instance indices and their bounding boxes
+        ///   - leafSize: the maximum number of instances contained in a leaf node
+        init(_ data: [(index: Int, box: MDLAxisAlignedBoundingBox)], leafSize: Int = defaultLeafSize) async {
+            let builder = Builder(data, leafSize: leafSize)
+            nodes = await builder.build()
+            instances = builder.instances
+            link()
+        }
+
+        /// Links every node to it's parent and every instance to it's leaf and marks every instance as visible.
+        private mutating func link() {
+            parents = [Int32](repeating: .empty, count: nodes.count)
+            visibleCounts = [UInt32](repeating: .zero, count: nodes.count)
+            hidden = .init(capacity: nodes.count)
+            leaves = [Int32](repeating: .empty, count: instances.isEmpty ? 0 : Int(instances.max()!) + 1)
+
+            // Children always come after their parent so walk the nodes backwards
+            for i in nodes.indices.reversed() {
+                let node = nodes[i]
+                if node.isLeaf {
+                    visibleCounts[i] = node.count
+                    for j in node.range {
+                        leaves[Int(instances[j])] = Int32(i)
+                    }
+                } else {
+                    let left = i + 1
+                    let right = Int(node.offset)
+                    parents[left] = Int32(i)
+                    parents[right] = Int32(i)
+                    visibleCounts[i] = visibleCounts[left] + visibleCounts[right]
+                }
+            }
+        }
+
+        /// Updates the hidden state of the instance by walking from it's leaf up to the root.
+        /// Must only be called when the hidden state of the instance actually changes.
+        /// - Parameters:
+        ///   - instance: the instance index
+        ///   - isHidden: true if the instance has been hidden, false if it has been unhidden
+        mutating func setHidden(_ instance: Int, _ isHidden: Bool) {
+            guard leaves.indices.contains(instance) else { return }
+            var i = Int(leaves[instance])
+            while i != .empty {
+                if isHidden {
+                    visibleCounts[i] -= 1
+                    if visibleCounts[i] == .zero {
+                        hidden.insert(i)
+                    }
+                } else {
+                    visibleCounts[i] += 1
+                    hidden.remove(i)
+                }
+                i = Int(parents[i])
+            }
+        }
+
+        /// Refits the node bounds bottom up after the instance bounds have changed.
+        /// The tree topology is kept as is, so the quality of the tree may degrade if instances move a long way.
+        /// - Parameter box: returns the bounding box of the instance at the specified index
+        mutating func refit(_ box: (Int) -> MDLAxisAlignedBoundingBox) {
+            for i in nodes.indices.reversed() {
+                let node = nodes[i]
+                var minBounds = SIMD3<Float>(repeating: .greatestFiniteMagnitude)
+                var maxBounds = SIMD3<Float>(repeating: -.greatestFiniteMagnitude)
+                if node.isLeaf {
+                    for j in node.range {
+                        let instanceBox = box(Int(instances[j]))
+                        minBounds = simd_min(minBounds, instanceBox.minBounds)
+                        maxBounds = simd_max(maxBounds, instanceBox.maxBounds)
+                    }
+                } else {
+                    let left = nodes[i + 1]
+                    let right = nodes[Int(node.offset)]
+                    minBounds = simd_min(left.minBounds.vector, right.minBounds.vector)
+                    maxBounds = simd_max(left.maxBounds.vector, right.maxBounds.vector)
+                }
+                nodes[i].minBounds = .init(minBounds)
+                nodes[i].maxBounds = .init(maxBounds)
+            }
         }
 
         /// Traverses the BVH tree and accumulates a list of indices into the `geometry.instancedMeshes` array
@@ -153,22 +264,273 @@ extension Geometry {
         func intersectionResults(camera: Vim.Camera) -> Set<Int> {
             guard let geometry else { return [] }
             var results = Set<Int>()
-            intersections(camera: camera, node: root, results: &results)
+            traverse { node in
+                camera.contains(node.box)
+            } visit: { instance in
+                if let index = geometry.instancedMeshesMap[instance] {
+                    results.insert(index)
+                }
+            }
             results.subtract(geometry.hiddeninstancedMeshes) // Remove any hidden instanced meshes
             return results
         }
 
-        /// Recursively iterates through the BVH nodes to collect results that are inside the given frustum.
+        /// Iteratively walks the nodes depth first with an explicit stack.
+        /// Subtrees where every instance is hidden are never visited.
+        /// - Parameters:
+        ///   - predicate: returns true if the node (and it's subtree) should be visited
+        ///   - visit: called for every instance of every visited leaf
+        func traverse(_ predicate: (Node) -> Bool, visit: (Int) -> Void) {
+            guard nodes.isNotEmpty else { return }
+            var stack = [Int]()
+            stack.reserveCapacity(64)
+            stack.append(0)
+            while let i = stack.popLast() {
+                let node = nodes[i]
+                guard !hidden.contains(i), predicate(node) else { continue }
+                if node.isLeaf {
+                    for j in node.range {
+                        visit(Int(instances[j]))
+                    }
+                } else {
+                    stack.append(Int(node.offset))
+                    stack.append(i + 1)
+                }
+            }
+        }
+    }
+}
+
+// MARK: BVH Updates
+
+extension Geometry {
+
+    /// Refits the bounding volume hierarchy after the instance bounds have been modified.
+    public func refit() {
+        bvh?.refit { instances[$0].boundingBox }
+    }
+}
+
+// MARK: BVH Construction
+
+extension Geometry.BoundingVolumeHierarchy {
+
+    /// Builds the hierarchy top down by splitting each node with a binned surface area heuristic (SAH).
+    ///
+    /// The instance indices are partitioned in place, so no arrays are copied or sorted while building,
+    /// and the subtrees of large nodes are built concurrently as they never touch the same range of indices.
+    /// See: https://www.sci.utah.edu/~wald/Publications/2007/ParallelBVHBuild/fastbuild.pdf
+    final class Builder: @unchecked Sendable {
+
+        /// The maximum number of instances contained in a leaf node.
+        let leafSize: Int
+        /// The positions into the box arrays (partitioned in place while building).
+        private let indices: UnsafeMutableBufferPointer<Int>
+        /// The instance index of each box.
+        private let boxInstances: [Int]
+        /// The min bounds of each instance box.
+        private let minBounds: [SIMD3<Float>]
+        /// The max bounds of each instance box.
+        private let maxBounds: [SIMD3<Float>]
+        /// The center of each instance box.
+        private let centers: [SIMD3<Float>]
+
+        /// Initializes the builder.
+        /// - Parameters:
+        ///   - data: the instance indices and their bounding boxes
+        ///   - leafSize: the maximum number of instances contained in a leaf node
+        init(_ data: [(index: Int, box: MDLAxisAlignedBoundingBox)], leafSize: Int) {
+            let indices = UnsafeMutableBufferPointer<Int>.allocate(capacity: data.count)
+            _ = indices.initialize(from: data.indices)
+            self.leafSize = Swift.max(leafSize, 1)
+            self.indices = indices
+            self.boxInstances = data.map { $0.index }
+            self.minBounds = data.map { $0.box.minBounds }
+            self.maxBounds = data.map { $0.box.maxBounds }
+            self.centers = data.map { ($0.box.minBounds + $0.box.maxBounds) * .half }
+        }
+
+        deinit {
+            indices.deallocate()
+        }
+
+        /// Builds the hierarchy.
+        /// - Returns: the flattened nodes in depth first order
+        func build() async -> [Node] {
+            guard !indices.isEmpty else { return [] }
+            return await build(indices.indices)
+        }
+
+        /// Builds the hierarchy on the current thread (used for small hierarchies that are built on demand).
+        /// - Returns: the flattened nodes in depth first order
+        func buildSerially() -> [Node] {
+            guard !indices.isEmpty else { return [] }
+            var nodes = [Node]()
+            build(indices.indices, &nodes)
+            return nodes
+        }
+
+        /// The instance indices in leaf order (only valid once the hierarchy has been built).
+        var instances: [UInt32] {
+            indices.map { UInt32(boxInstances[$0]) }
+        }
+
+        /// Builds the subtree for the specified range of indices, building both halves concurrently if the range is large enough.
+        /// - Parameter range: the range of indices
+        /// - Returns: the flattened subtree nodes (with interior node offsets relative to the subtree root)
+        private func build(_ range: Range<Int>) async -> [Node] {
+            guard range.count >= parallelThreshold else {
+                var nodes = [Node]()
+                build(range, &nodes)
+                return nodes
+            }
+            let (box, split) = partition(range)
+            guard let split else { return [Node(box: box, range: range)] }
+
+            async let leftNodes = build(range.lowerBound..<split)
+            let right = await build(split..<range.upperBound)
+            let left = await leftNodes
+
+            // Stitch the subtrees together behind their parent and rebase the interior node offsets
+            var nodes = [Node]()
+            nodes.reserveCapacity(1 + left.count + right.count)
+            nodes.append(Node(box: box, secondChild: 1 + left.count))
+            nodes.append(contentsOf: left.map { rebase($0, by: 1) })
+            nodes.append(contentsOf: right.map { rebase($0, by: 1 + left.count) })
+            return nodes
+        }
+
+        /// Builds the subtree for the specified range of indices on the current thread.
         /// - Parameters:
-        ///   - camera: the camera data
-        ///   - node: the node to recursively look through
-        ///   - results: the results to append to
-        fileprivate func intersections(camera: Vim.Camera, node: Node, results: inout Set<Int>) {
-            guard let geometry, camera.contains(node.box) else { return }
-            let indices = node.instances.compactMap{ geometry.instancedMeshesMap[$0] }
-            results.formUnion(indices)
-            for child in node.children {
-                intersections(camera: camera, node: child, results: &results)
+        ///   - range: the range of indices
+        ///   - nodes: the nodes to append the subtree to
+        private func build(_ range: Range<Int>, _ nodes: inout [Node]) {
+            let (box, split) = partition(range)
+            guard let split else {
+                nodes.append(Node(box: box, range: range))
+                return
+            }
+            let index = nodes.count
+            nodes.append(Node(box: box, secondChild: .zero))
+            build(range.lowerBound..<split, &nodes)
+            nodes[index].offset = UInt32(nodes.count)
+            build(split..<range.upperBound, &nodes)
+        }
+
+        /// Shifts the second child index of an interior node (leaf ranges index into the shared index buffer and never move).
+        private func rebase(_ node: Node, by offset: Int) -> Node {
+            guard !node.isLeaf else { return node }
+            var node = node
+            node.offset += UInt32(offset)
+            return node
+        }
+
+        /// Computes the bounds of the range and partitions it in place along the split with the lowest SAH cost.
+        /// - Parameter range: the range of indices
+        /// - Returns: the bounds of the range and the partition index (nil if the range should become a leaf)
+        private func partition(_ range: Range<Int>) -> (MDLAxisAlignedBoundingBox, Int?) {
+
+            var boxMin = SIMD3<Float>(repeating: .greatestFiniteMagnitude)
+            var boxMax = SIMD3<Float>(repeating: -.greatestFiniteMagnitude)
+            var centerMin = boxMin
+            var centerMax = boxMax
+            for i in range {
+                let p = indices[i]
+                boxMin = simd_min(boxMin, minBounds[p])
+                boxMax = simd_max(boxMax, maxBounds[p])
+                centerMin = simd_min(centerMin, centers[p])
+                centerMax = simd_max(centerMax, centers[p])
+            }
+            let box = MDLAxisAlignedBoundingBox(maxBounds: boxMax, minBounds: boxMin)
+            guard range.count > leafSize else { return (box, nil) }
+
+            // Fall back to splitting down the middle if all of the centers are the same
+            let middle = range.lowerBound + range.count / 2
+            let extent = centerMax - centerMin
+
+            var bestCost: Float = .infinity
+            var bestAxis = -1
+            var bestBin = 0
+
+            for axis in 0..<3 where extent[axis] > .zero {
+
+                // 1) Bin the boxes by their center
+                let scale = Float(binCount) / extent[axis]
+                var bins = [Bin](repeating: .init(), count: binCount)
+                for i in range {
+                    let p = indices[i]
+                    let b = bin(centers[p][axis], centerMin[axis], scale)
+                    bins[b].insert(minBounds[p], maxBounds[p])
+                }
+
+                // 2) Sweep from the right to find the cost of every right hand side
+                var rightCosts = [Float](repeating: .zero, count: binCount)
+                var right = Bin()
+                for b in stride(from: binCount - 1, to: 0, by: -1) {
+                    right.insert(bins[b])
+                    rightCosts[b] = right.cost
+                }
+
+                // 3) Sweep from the left and find the cheapest split
+                var left = Bin()
+                for b in 0..<(binCount - 1) {
+                    left.insert(bins[b])
+                    let cost = left.cost + rightCosts[b + 1]
+                    if cost < bestCost {
+                        bestCost = cost
+                        bestAxis = axis
+                        bestBin = b
+                    }
+                }
+            }
+
+            guard bestAxis >= 0 else { return (box, middle) }
+
+            // 4) Partition the indices in place so every box left of the split comes first
+            let scale = Float(binCount) / extent[bestAxis]
+            var lo = range.lowerBound
+            var hi = range.upperBound - 1
+            while lo <= hi {
+                if bin(centers[indices[lo]][bestAxis], centerMin[bestAxis], scale) <= bestBin {
+                    lo += 1
+                } else {
+                    indices.swapAt(lo, hi)
+                    hi -= 1
+                }
+            }
+            guard lo > range.lowerBound, lo < range.upperBound else { return (box, middle) }
+            return (box, lo)
+        }
+
+        /// Returns the bin that the center falls into.
+        private func bin(_ center: Float, _ lowerBound: Float, _ scale: Float) -> Int {
+            Swift.min(Int((center - lowerBound) * scale), binCount - 1)
+        }
+
+        /// Accumulates the bounds and count of the boxes that fall into a bin.
+        private struct Bin {
+
+            var minBounds = SIMD3<Float>(repeating: .greatestFiniteMagnitude)
+            var maxBounds = SIMD3<Float>(repeating: -.greatestFiniteMagnitude)
+            var count = 0
+
+            /// The SAH cost of the bin (half the surface area of it's bounds multiplied by the number of boxes).
+            var cost: Float {
+                guard count > 0 else { return .zero }
+                let d = maxBounds - minBounds
+                return (d.x * d.y + d.y * d.z + d.z * d.x) * Float(count)
+            }
+
+            mutating func insert(_ minBounds: SIMD3<Float>, _ maxBounds: SIMD3<Float>) {
+                self.minBounds = simd_min(self.minBounds, minBounds)
+                self.maxBounds = simd_max(self.maxBounds, maxBounds)
+                count += 1
+            }
+
+            mutating func insert(_ bin: Bin) {
+                minBounds = simd_min(minBounds, bin.minBounds)
+                maxBounds = simd_max(maxBounds, bin.maxBounds)
+                count += bin.count
             }
         }
     }
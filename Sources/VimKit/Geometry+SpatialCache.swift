@@ -0,0 +1,186 @@
+//
+//  Geometry+SpatialCache.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import VimKitShaders
+
+/// The file extension of the cached spatial index.
+private let spatialIndexExtension = ".bvh"
+/// The magic number that identifies a cached spatial index file ("VBVH").
+private let spatialIndexMagic: UInt32 = 0x4856_4256
+/// The version of the cached spatial index file format.
+/// This must be bumped whenever the layout of the file, the instances or the BVH nodes change.
+private let spatialIndexVersion: UInt32 = 1
+
+extension Geometry {
+
+    /// The header of a cached spatial index file.
+    ///
+    /// The header is followed by the min + max bounds of every instance (in instance buffer order),
+    /// the flattened BVH nodes and finally the BVH instance indices.
+    struct SpatialIndexHeader {
+        /// The magic number.
+        var magic: UInt32 = spatialIndexMagic
+        /// The file format version.
+        var version: UInt32 = spatialIndexVersion
+        /// The number of instances.
+        var instanceCount: UInt32
+        /// The number of BVH nodes (zero if the hierarchy wasn't built).
+        var nodeCount: UInt32
+        /// The number of BVH instance indices.
+        var primitiveCount: UInt32
+        /// The stride of each BVH node.
+        var nodeStride: UInt32 = UInt32(MemoryLayout<BVH.Node>.stride)
+        /// The model min bounds.
+        var minBounds: PackedFloat3
+        /// The model max bounds.
+        var maxBounds: PackedFloat3
+    }
+
+    /// The name of the cached spatial index file.
+    private var spatialIndexName: String {
+        "\(sha256Hash)\(spatialIndexExtension)"
+    }
+
+    /// Attempts to restore the instance bounds, the model bounds and the BVH from the cached spatial index file.
+    /// The file is memory mapped and each section is copied straight into place.
+    /// - Parameter requiresHierarchy: if true the cached file must contain the BVH nodes
+    /// - Returns: true if the spatial index was restored, otherwise false.
+    func restoreSpatialIndex(requiresHierarchy: Bool) -> Bool {
+        let cache = Vim.DiskCache.shared
+        guard cache.contains(spatialIndexName, group: cacheGroup),
+              let data = try? Data(contentsOf: cache.url(for: spatialIndexName, group: cacheGroup), options: .alwaysMapped) else { return false }
+
+        return data.withUnsafeBytes { bytes in
+
+            // 1) Validate the header
+            let headerSize = MemoryLayout<SpatialIndexHeader>.stride
+            guard bytes.count >= headerSize else { return false }
+            let header = bytes.loadUnaligned(as: SpatialIndexHeader.self)
+            guard header.magic == spatialIndexMagic,
+                  header.version == spatialIndexVersion,
+                  header.nodeStride == MemoryLayout<BVH.Node>.stride,
+                  Int(header.instanceCount) == instances.count,
+                  !requiresHierarchy || header.nodeCount > 0 else { return false }
+
+            let boundsStride = MemoryLayout<PackedFloat3>.stride * 2
+            let boundsSize = Int(header.instanceCount) * boundsStride
+            let nodesSize = Int(header.nodeCount) * MemoryLayout<BVH.Node>.stride
+            let primitivesSize = Int(header.primitiveCount) * MemoryLayout<UInt32>.stride
+            guard bytes.count == headerSize + boundsSize + nodesSize + primitivesSize else { return false }
+
+            // 2) Validate the hierarchy before anything is restored
+            let nodesOffset = headerSize + boundsSize
+            let nodes = [BVH.Node](copying: bytes, from: nodesOffset, count: Int(header.nodeCount))
+            let primitives = [UInt32](copying: bytes, from: nodesOffset + nodesSize, count: Int(header.primitiveCount))
+            guard BVH.isValid(nodes: nodes, instances: primitives, instanceCount: instances.count) else {
+                debugPrint("💩 Discarding invalid spatial index [\(spatialIndexName)]")
+                return false
+            }
+
+            // 3) Restore the instance bounds
+            var offset = headerSize
+            for i in instances.indices {
+                instances[i].minBounds = bytes.loadUnaligned(fromByteOffset: offset, as: PackedFloat3.self).vector
+                instances[i].maxBounds = bytes.loadUnaligned(fromByteOffset: offset + boundsStride / 2, as: PackedFloat3.self).vector
+                offset += boundsStride
+            }
+            bounds = .init(maxBounds: header.maxBounds.vector, minBounds: header.minBounds.vector)
+
+            // 4) Restore the hierarchy
+            guard nodes.isNotEmpty else { return true }
+            bvh = BVH(self, nodes: nodes, instances: primitives)
+            return true
+        }
+    }
+
+    /// Writes the instance bounds, the model bounds and the BVH (if built) into the cached spatial index file.
+    func persistSpatialIndex() {
+        let nodes = bvh?.nodes ?? []
+        let primitives = bvh?.instances ?? []
+        var header = SpatialIndexHeader(instanceCount: UInt32(instances.count),
+                                        nodeCount: UInt32(nodes.count),
+                                        primitiveCount: UInt32(primitives.count),
+                                        minBounds: .init(bounds.minBounds),
+                                        maxBounds: .init(bounds.maxBounds))
+
+        var data = Data()
+        data.reserveCapacity(MemoryLayout<SpatialIndexHeader>.stride +
+                             instances.count * MemoryLayout<PackedFloat3>.stride * 2 +
+                             nodes.count * MemoryLayout<BVH.Node>.stride +
+                             primitives.count * MemoryLayout<UInt32>.stride)
+        withUnsafeBytes(of: &header) { data.append(contentsOf: $0) }
+        for instance in instances {
+            var instanceBounds = (PackedFloat3(instance.minBounds), PackedFloat3(instance.maxBounds))
+            withUnsafeBytes(of: &instanceBounds) { data.append(contentsOf: $0) }
+        }
+        nodes.withUnsafeBytes { data.append(contentsOf: $0) }
+        primitives.withUnsafeBytes { data.append(contentsOf: $0) }
+
+        do {
+            try Vim.DiskCache.shared.write(data, name: spatialIndexName, group: cacheGroup)
+        } catch let error {
+            debugPrint("💩 Unable to cache spatial index [\(error)]")
+        }
+    }
+}
+
+extension Geometry.BVH {
+
+    /// Validates the structure of nodes that were read from disk before they are trusted.
+    ///
+    /// The nodes are walked from the root and every node must be reached exactly once, the first child of an
+    /// interior node must directly follow it and the second child must come after the first child (so the walk
+    /// always terminates), every leaf range must be inside the instances array and every instance index must
+    /// reference an existing instance.
+    /// - Parameters:
+    ///   - nodes: the flattened nodes
+    ///   - instances: the instance indices referenced by the leaf nodes
+    ///   - instanceCount: the number of geometry instances
+    /// - Returns: true if the nodes form a valid hierarchy, otherwise false
+    static func isValid(nodes: [Node], instances: [UInt32], instanceCount: Int) -> Bool {
+        guard nodes.isNotEmpty else { return instances.isEmpty }
+        guard instances.allSatisfy({ Int($0) < instanceCount }) else { return false }
+
+        var visited = [Bool](repeating: false, count: nodes.count)
+        var stack = [0]
+        while let i = stack.popLast() {
+            guard !visited[i] else { return false }
+            visited[i] = true
+            let node = nodes[i]
+            if node.isLeaf {
+                guard UInt64(node.offset) + UInt64(node.count) <= UInt64(instances.count) else { return false }
+            } else {
+                let secondChild = Int(node.offset)
+                guard i + 1 < secondChild, secondChild < nodes.count else { return false }
+                stack.append(secondChild)
+                stack.append(i + 1)
+            }
+        }
+        return !visited.contains(false)
+    }
+}
+
+fileprivate extension Array {
+
+    /// Initializes the array by copying the elements straight out of the raw bytes.
+    /// - Parameters:
+    ///   - bytes: the raw bytes
+    ///   - offset: the byte offset of the first element
+    ///   - count: the number of elements to copy
+    init(copying bytes: UnsafeRawBufferPointer, from offset: Int, count: Int) {
+        self.init(unsafeUninitializedCapacity: count) { buffer, initializedCount in
+            guard let baseAddress = bytes.baseAddress, count > 0 else {
+                initializedCount = 0
+                return
+            }
+            UnsafeMutableRawPointer(buffer.baseAddress!).copyMemory(from: baseAddress + offset, byteCount: count * MemoryLayout<Element>.stride)
+            initializedCount = count
+        }
+    }
+}
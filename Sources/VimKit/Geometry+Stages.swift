@@ -0,0 +1,95 @@
+//
+//  Geometry+Stages.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+
+extension Geometry {
+
+    /// Represents a single stage of loading the geometry structures and Metal buffers.
+    /// The stages form a small dependency graph that allows independent stages to run concurrently.
+    public enum Stage: String, CaseIterable, Sendable {
+        /// Builds the positions (vertex) buffer.
+        case positions
+        /// Builds the index buffer.
+        case indices
+        /// Builds the normals buffer.
+        case normals
+        /// Builds the materials buffer.
+        case materials
+        /// Builds the submeshes buffer.
+        case submeshes
+        /// Builds the meshes buffer.
+        case meshes
+        /// Builds the instances and instanced meshes buffers.
+        case instances
+        /// Computes the instance bounding boxes.
+        case boundingBoxes
+        /// Builds the color overrides buffer.
+        case colors
+        /// Builds the bounding volume hierarchy.
+        case bvh
+
+        /// The stages that must be completed before this stage can start.
+        var dependencies: Set<Stage> {
+            switch self {
+            case .positions, .indices, .materials, .meshes, .colors:
+                return []
+            case .normals:
+                return [.positions, .indices]
+            case .submeshes:
+                // Submeshes without a material fall back to the default material
+                return [.materials]
+            case .instances:
+                // Instance transparency is determined from the mesh, submesh and material data
+                return [.materials, .submeshes, .meshes]
+            case .boundingBoxes:
+                return [.positions, .indices, .instances]
+            case .bvh:
+                return [.boundingBoxes]
+            }
+        }
+    }
+
+    /// Runs the stages on a task group where each stage is started as soon as all of its dependencies have completed.
+    /// Dependencies that aren't part of the specified stages are considered to be satisfied.
+    /// - Parameters:
+    ///   - stages: the stages to run
+    ///   - body: the work to perform for a stage
+    /// - Returns: the wall time of each completed stage.
+    func schedule(_ stages: [Stage], _ body: @escaping @Sendable (Stage) async -> Void) async -> [Stage: TimeInterval] {
+
+        await withTaskGroup(of: (Stage, TimeInterval).self) { group in
+
+            let scheduled = Set(stages)
+            var pending = scheduled
+            var completed = Set<Stage>()
+            var timings = [Stage: TimeInterval]()
+
+            while true {
+
+                // Start every pending stage whose dependencies have all completed
+                let ready = pending.filter { $0.dependencies.intersection(scheduled).isSubset(of: completed) }
+                for stage in ready {
+                    pending.remove(stage)
+                    group.addTask {
+                        let start = Date.now
+                        await body(stage)
+                        return (stage, abs(start.timeIntervalSinceNow))
+                    }
+                }
+
+                // Wait for the next stage to complete (nil once nothing is left running)
+                guard let (stage, timeInterval) = await group.next() else { break }
+                completed.insert(stage)
+                timings[stage] = timeInterval
+            }
+
+            assert(pending.isEmpty, "💩 Geometry stages [\(pending)] have unresolvable dependencies")
+            return timings
+        }
+    }
+}
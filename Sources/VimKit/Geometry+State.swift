@@ -0,0 +1,207 @@
+//
+//  Geometry+State.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import VimKitShaders
+
+extension Geometry {
+
+    /// A fixed size set of instance slots backed by a bitset that keeps it's population count incrementally.
+    struct SlotSet: Sequence {
+
+        /// The bitset words (one bit per slot).
+        private(set) var words: [UInt64]
+
+        /// The number of slots in the set.
+        private(set) var count: Int = 0
+
+        /// Initializes the set.
+        /// - Parameters:
+        ///   - capacity: the total number of slots the set can hold
+        ///   - filled: if true all of the slots will be inserted into the set
+        init(capacity: Int, filled: Bool = false) {
+            words = [UInt64](repeating: filled ? .max : .zero, count: (capacity + 63) / 64)
+            guard filled else { return }
+            count = capacity
+            // Clear the unused bits of the last word
+            let remainder = capacity % 64
+            if remainder > 0 {
+                words[words.count - 1] = (1 << UInt64(remainder)) - 1
+            }
+        }
+
+        /// Returns true if the set contains the slot.
+        /// - Parameter slot: the slot to check
+        func contains(_ slot: Int) -> Bool {
+            words[slot >> 6] & (1 << UInt64(slot & 63)) != .zero
+        }
+
+        /// Inserts the slot into the set.
+        /// - Parameter slot: the slot to insert
+        /// - Returns: true if the slot wasn't already a member of the set
+        @discardableResult
+        mutating func insert(_ slot: Int) -> Bool {
+            let mask: UInt64 = 1 << UInt64(slot & 63)
+            guard words[slot >> 6] & mask == .zero else { return false }
+            words[slot >> 6] |= mask
+            count += 1
+            return true
+        }
+
+        /// Removes the slot from the set.
+        /// - Parameter slot: the slot to remove
+        /// - Returns: true if the slot was a member of the set
+        @discardableResult
+        mutating func remove(_ slot: Int) -> Bool {
+            let mask: UInt64 = 1 << UInt64(slot & 63)
+            guard words[slot >> 6] & mask != .zero else { return false }
+            words[slot >> 6] &= ~mask
+            count -= 1
+            return true
+        }
+
+        /// Returns an iterator over the slots in ascending order.
+        func makeIterator() -> Iterator {
+            Iterator(words: words)
+        }
+
+        /// Iterates the set bits of the words in ascending order.
+        struct Iterator: IteratorProtocol {
+
+            let words: [UInt64]
+            var index: Int = 0
+            var word: UInt64 = .zero
+
+            init(words: [UInt64]) {
+                self.words = words
+                self.word = words.first ?? .zero
+            }
+
+            mutating func next() -> Int? {
+                while word == .zero {
+                    index += 1
+                    guard index < words.count else { return nil }
+                    word = words[index]
+                }
+                let bit = word.trailingZeroBitCount
+                word &= word - 1
+                return (index << 6) + bit
+            }
+        }
+    }
+
+    /// Holds the compact (struct of arrays) state and color override index of every instance slot.
+    ///
+    /// The state is the source of truth for all of the state queries and edits. Every edit records the
+    /// slot as dirty, and only the dirty slot ranges are written into the `instances` buffer when flushed.
+    struct InstanceStates {
+
+        /// The raw state of each slot.
+        private(set) var states: [UInt8]
+
+        /// The color override index of each slot (-1 indicates no override).
+        private(set) var colorIndices: [Int16]
+
+        /// The slots in each state (indexed by the state raw value).
+        private var sets: [SlotSet]
+
+        /// The slots that have a color override.
+        private(set) var colored: SlotSet
+
+        /// The number of slots that reference each color override index.
+        private var colorReferences = [Int: Int]()
+
+        /// The slot ranges that have been modified since the last flush.
+        private(set) var dirty = RangeSet<Int>()
+
+        /// Initializes the instance states with all slots in the `.default` state without color overrides.
+        /// - Parameter count: the number of instance slots
+        init(count: Int) {
+            states = [UInt8](repeating: UInt8(InstanceState.default.rawValue), count: count)
+            colorIndices = [Int16](repeating: -1, count: count)
+            sets = (0...InstanceState.isolated.rawValue).map { SlotSet(capacity: count, filled: $0 == InstanceState.default.rawValue) }
+            colored = SlotSet(capacity: count)
+        }
+
+        /// Returns the state of the instance in the specified slot.
+        /// - Parameter slot: the instance slot
+        func state(at slot: Int) -> InstanceState {
+            InstanceState(rawValue: Int(states[slot])) ?? .default
+        }
+
+        /// Returns the slots in the specified state.
+        /// - Parameter state: the state to match
+        func slots(state: InstanceState) -> SlotSet {
+            sets[state.rawValue]
+        }
+
+        /// Returns the number of slots in the specified state.
+        /// - Parameter state: the state to match
+        func count(state: InstanceState) -> Int {
+            sets[state.rawValue].count
+        }
+
+        /// Sets the state of the instance in the specified slot.
+        /// - Parameters:
+        ///   - state: the new state
+        ///   - slot: the instance slot
+        /// - Returns: the previous state
+        @discardableResult
+        mutating func set(_ state: InstanceState, at slot: Int) -> InstanceState {
+            let previous = self.state(at: slot)
+            guard previous != state else { return previous }
+            states[slot] = UInt8(state.rawValue)
+            sets[previous.rawValue].remove(slot)
+            sets[state.rawValue].insert(slot)
+            dirty.insert(contentsOf: slot..<slot+1)
+            return previous
+        }
+
+        /// Returns the color override index of the instance in the specified slot.
+        /// - Parameter slot: the instance slot
+        func colorIndex(at slot: Int) -> Int {
+            Int(colorIndices[slot])
+        }
+
+        /// Sets the color override index of the instance in the specified slot.
+        /// - Parameters:
+        ///   - colorIndex: the color override index (-1 removes the override)
+        ///   - slot: the instance slot
+        /// - Returns: the previous color override index if it's no longer referenced by any slot
+        @discardableResult
+        mutating func set(colorIndex: Int, at slot: Int) -> Int? {
+            let previous = Int(colorIndices[slot])
+            guard previous != colorIndex else { return nil }
+            colorIndices[slot] = Int16(colorIndex)
+            dirty.insert(contentsOf: slot..<slot+1)
+
+            if colorIndex != .empty {
+                colored.insert(slot)
+                colorReferences[colorIndex, default: 0] += 1
+            } else {
+                colored.remove(slot)
+            }
+            guard previous != .empty else { return nil }
+            colorReferences[previous, default: 0] -= 1
+            guard colorReferences[previous] == .zero else { return nil }
+            colorReferences[previous] = nil
+            return previous
+        }
+
+        /// Writes the state and color override index of the dirty slots into the instances.
+        /// - Parameter instances: the instances to update
+        mutating func flush(to instances: UnsafeMutableBufferPointer<Instance>) {
+            for range in dirty.ranges {
+                for slot in range {
+                    instances[slot].state = state(at: slot)
+                    instances[slot].colorIndex = Int(colorIndices[slot])
+                }
+            }
+            dirty = RangeSet()
+        }
+    }
+}
@@ -10,10 +10,6 @@ import MetalKit
 import struct SwiftUI.Color
 import VimKitShaders
 
-// The MPS function name for computing the vertex normals on the GPU
-private let computeVertexNormalsFunctionName = "computeVertexNormals"
-// The MPS function name for computing the bounding boxes on the GPU
-private let computeBoundingBoxesFunctionName = "computeBoundingBoxes"
 // File extensions for mmap'd metal buffers
 private let normalsBufferExtension = ".normals"
 // The max number of color overrides to apply (4MB worth of colors)
@@ -78,6 +74,13 @@ public class Geometry: ObservableObject, @unchecked Sendable {
     /// The Geometry Bounding Volume Hierarchy
     var bvh: BVH?
 
+    /// The triangle hierarchies of each mesh (keyed by mesh index) that are built on demand by raycasts.
+    let meshHierarchies: Cache<Int, MeshHierarchy> = {
+        let cache = Cache<Int, MeshHierarchy>()
+        cache.totalCostLimit = meshHierarchiesByteLimit
+        return cache
+    }()
+
     /// The data container
     private let bfast: BFast
     private var attributes = [Attribute]()
@@ -85,15 +88,26 @@ public class Geometry: ObservableObject, @unchecked Sendable {
     /// Cancellable tasks.
     var tasks = [Task<(), Never>]()
 
-    /// Convenience var for accessing the SHA 256 hash of this geometry data.
-    public lazy var sha256Hash: String = {
-        bfast.sha256Hash
-    }()
+    /// The wall time each load stage took to complete.
+    public private(set) var stageTimings = [Stage: TimeInterval]()
+
+    /// The SHA 256 hash of this geometry data.
+    /// Initialized eagerly as the load stages that build cache keys from it run concurrently.
+    public let sha256Hash: String
+
+    /// The disk cache group that the geometry cache files are written into.
+    var cacheGroup: String {
+        bfast.fileHash
+    }
+
+    /// Flag indicating if the instance bounds (and BVH) were restored from the disk cache.
+    private var restoredSpatialIndex = false
 
     /// Initializer
     init(_ bfast: BFast) {
         self.device = MTLContext.device
         self.bfast = bfast
+        self.sha256Hash = bfast.sha256Hash
         for (index, buffer) in bfast.buffers.enumerated() {
             // Skip the first buffer as it is only meta information
             // See: https://github.com/vimaec/g3d/#meta-information
@@ -128,52 +142,64 @@ public class Geometry: ObservableObject, @unchecked Sendable {
 
         publish(state: .loading)
 
-        // 1) Build the positions (vertex) buffer
-        makePositionsBuffer()
-        incrementProgressCount()
-
-        // 2) Build the index buffer
-        makeIndexBuffer()
-        incrementProgressCount()
-
-        // 3) Build the normals buffer
-        await computeVertexNormals()
-        incrementProgressCount()
-
-        // 4) Build the materials buffer
-        await makeMaterialsBuffer()
-        incrementProgressCount()
-
-        // 5) Build the submeshes buffer
-        await makeSubmeshesBuffer()
-        incrementProgressCount()
-
-        // 6) Build the meshes buffer
-        await makeMeshesBuffer()
-        incrementProgressCount()
+        // Don't bother building the bvh tree if indirect command buffers are supported
+        var stages = Stage.allCases
+        if supportsIndirectCommandBuffers {
+            stages.removeAll { $0 == .bvh }
+            incrementProgressCount()
+        }
 
-        // 7) Build the instances buffer
-        await makeInstancesBuffer()
-        incrementProgressCount()
+        // Run the stages concurrently as soon as their dependencies are ready
+        stageTimings = await schedule(stages) { [weak self] stage in
+            guard let self else { return }
+            await run(stage)
+            incrementProgressCount()
+        }
 
-        // 8) Compute the bounding boxes
-        await computeBoundingBoxes()
-        incrementProgressCount()
+        for (stage, timeInterval) in stageTimings.sorted(by: { $0.value > $1.value }) {
+            debugPrint("􀬨 Stage [\(stage.rawValue)] completed in [\(timeInterval.stringFromTimeInterval())]")
+        }
 
-        // 9) Build the colors buffer
-        await makeColorsBuffer()
-        incrementProgressCount()
+        guard !Task.isCancelled else { return }
 
-        // 10 Start indexing the file
-        publish(state: .indexing)
+        // Cache the instance bounds and BVH so they don't need to be computed the next time the file is opened
+        if !restoredSpatialIndex {
+            persistSpatialIndex()
+        }
+        publish(state: .ready)
+    }
 
-        // Don't bother building the bvh tree if indirect command buffers are supported
-        if !supportsIndirectCommandBuffers {
+    /// Performs the work of a single load stage.
+    /// - Parameter stage: the stage to run
+    private func run(_ stage: Stage) async {
+        switch stage {
+        case .positions:
+            makePositionsBuffer()
+        case .indices:
+            makeIndexBuffer()
+        case .normals:
+            await computeVertexNormals()
+        case .materials:
+            await makeMaterialsBuffer()
+        case .submeshes:
+            await makeSubmeshesBuffer()
+        case .meshes:
+            await makeMeshesBuffer()
+        case .instances:
+            await makeInstancesBuffer()
+        case .boundingBoxes:
+            // Skip computing the bounds (and building the BVH) if they were cached by a previous load
+            restoredSpatialIndex = restoreSpatialIndex(requiresHierarchy: !supportsIndirectCommandBuffers)
+            guard !restoredSpatialIndex else { return }
+            await computeBoundingBoxes()
+        case .colors:
+            await makeColorsBuffer()
+        case .bvh:
+            guard bvh == nil else { return }
+            // Start indexing the file
+            publish(state: .indexing)
             await bvh = BVH(self)
         }
-        incrementProgressCount()
-
-        publish(state: .ready)
     }
 
     /// Publishes the geometry buffer state onto the main thread.
@@ -259,24 +285,19 @@ public class Geometry: ObservableObject, @unchecked Sendable {
     }
 
     lazy var vertexTangents: [SIMD4<Float>] = {
-        var results = [SIMD4<Float>]()
-        let attributes = attributes(association: .vertex, semantic: .tangent)
-        for attribute in attributes {
-            let array: [Float] = attribute.buffer.data.unsafeTypeArray()
-            let values = array.chunked(into: 4).map { SIMD4<Float>($0) }
-            results.append(contentsOf: values)
+        let tangents: AttributeElements<SIMD4<Float>> = elements(association: .vertex, semantic: .tangent)
+        return Array(unsafeUninitializedCapacity: tangents.count) { buffer, count in
+            if let baseAddress = buffer.baseAddress {
+                tangents.copy(to: baseAddress)
+            }
+            count = tangents.count
         }
-        return results
     }()
 
     /// Represents the (U,V) values associated with each vertex used for texture mapping.
     lazy var vertexUVs: [Float] = {
-        var results = [Float]()
-        let attributes = attributes(association: .vertex, semantic: .uv)
-        for attribute in attributes {
-            let array: [Float] = attribute.buffer.data.unsafeTypeArray()
-            results.append(contentsOf: array)
-        }
+        let uvs: AttributeElements<Float> = elements(association: .vertex, semantic: .uv)
+        var results = Array(uvs)
 
         // TODO: Not sure what to do here - we can't create a buffer of zero length so create empty coordinates??
         if results.isEmpty {
@@ -289,39 +310,35 @@ public class Geometry: ObservableObject, @unchecked Sendable {
 
     /// Material indices per face,
     lazy var faceMaterials: [Int32] = {
-        let attributes = attributes(association: .face, semantic: .material)
-        return attributes.data.unsafeTypeArray()
+        let materials: AttributeElements<Int32> = elements(association: .face, semantic: .material)
+        return Array(materials)
     }()
 
     /// If not provided, will be computed dynamically as the average of all vertex normals,
     /// NOTE: This is not lazy as we can truly discard it from memory once done with it.
     @available(*, deprecated, message: "Use computeVertexNormals(device:cacheDirectory) to build vertex normals.")
     var faceNormals: [SIMD3<Float>] {
-        var results = [SIMD3<Float>]()
-        let attributes = attributes(association: .face, semantic: .normal)
-        for attribute in attributes {
-            let array: [Float] = attribute.buffer.data.unsafeTypeArray()
-            let values = array.chunked(into: 3).map { SIMD3<Float>($0) }
-            results.append(contentsOf: values)
+        // Face normals are packed as [x,y,z] floats (SIMD3 has a 16 byte stride so it can't be bound in place)
+        let normals: AttributeElements<Float> = elements(association: .face, semantic: .normal)
+        if normals.isNotEmpty {
+            return stride(from: 0, to: normals.count - 2, by: 3).map {
+                SIMD3<Float>(normals[$0], normals[$0 + 1], normals[$0 + 2])
+            }
         }
 
         // Compute the values
-        if results.isEmpty {
-            var faceNormals = positions.chunked(into: 3).map { _ in SIMD3<Float>.zero }
-            let vertices = positions.chunked(into: 3).map { SIMD3<Float>($0) }
-            for i in stride(from: 0, to: indices.count, by: 3) {
-                let a = vertices[Int(indices[i])]
-                let b = vertices[Int(indices[i+1])]
-                let c = vertices[Int(indices[i+2])]
-                let crossProduct = cross(b - a, c - a)
-
-                faceNormals[Int(indices[i])] += crossProduct
-                faceNormals[Int(indices[i+1])] += crossProduct
-                faceNormals[Int(indices[i+2])] += crossProduct
-            }
-            results.append(contentsOf: faceNormals)
+        var faceNormals = [SIMD3<Float>](repeating: .zero, count: positions.count / 3)
+        for i in stride(from: 0, to: indices.count, by: 3) {
+            let a = vertex(at: i)
+            let b = vertex(at: i+1)
+            let c = vertex(at: i+2)
+            let crossProduct = cross(b - a, c - a)
+
+            faceNormals[Int(indices[i])] += crossProduct
+            faceNormals[Int(indices[i+1])] += crossProduct
+            faceNormals[Int(indices[i+2])] += crossProduct
         }
-        return results
+        return faceNormals
     }
 
     // MARK: Meshes
@@ -335,23 +352,26 @@ public class Geometry: ObservableObject, @unchecked Sendable {
             debugPrint("􀬨 Meshes [\(meshes.count)] made in [\(timeInterval.stringFromTimeInterval())]")
         }
 
-        let meshSubmeshOffsets: [Int32] = unsafeTypeArray(association: .mesh, semantic: .submeshoffset)
-        var meshes = [Mesh]()
+        let meshSubmeshOffsets: AttributeElements<Int32> = elements(association: .mesh, semantic: .submeshoffset)
+        guard let lastOffset = meshSubmeshOffsets.last,
+              let meshesBuffer = device.makeBuffer(
+                length: MemoryLayout<Mesh>.stride * meshSubmeshOffsets.count,
+                options: [.storageModeShared]) else { return }
 
-        for (i, offset) in meshSubmeshOffsets.enumerated() {
+        // Decode the meshes straight into the buffer
+        let destination: UnsafeMutablePointer<Mesh> = meshesBuffer.toUnsafeMutablePointer()
+        for i in meshSubmeshOffsets.indices {
 
             // Calculate the range of submeshes contained inside this mesh
-            let start = Int(offset)
-            let nextOffset = i < meshSubmeshOffsets.endIndex - 1 ? meshSubmeshOffsets[Int(i+1)] : meshSubmeshOffsets.last!
-            let end = i < meshSubmeshOffsets.endIndex - 1 ? Int(nextOffset): Int(meshSubmeshOffsets.last!)
+            let start = Int(meshSubmeshOffsets[i])
+            let end = i < meshSubmeshOffsets.endIndex - 1 ? Int(meshSubmeshOffsets[i+1]): Int(lastOffset)
             let range: Range<Int> = start..<end
 
             // Build the mesh
-            let mesh = Mesh(range)
-            meshes.append(mesh)
+            (destination + i).initialize(to: Mesh(range))
         }
 
-        self.meshesBuffer = device.makeBuffer(bytes: &meshes, length: MemoryLayout<Mesh>.stride * meshes.count, options: [.storageModeShared])
+        self.meshesBuffer = meshesBuffer
     }
 
     /// Provides a buffered pointer to the meshes.
@@ -371,26 +391,28 @@ public class Geometry: ObservableObject, @unchecked Sendable {
             debugPrint("􀬨 Submeshes [\(submeshes.count)] made in [\(timeInterval.stringFromTimeInterval())]")
         }
 
-        let submeshIndexOffsets: [Int32] = unsafeTypeArray(association: .submesh, semantic: .indexoffset)
-        let submeshMaterials: [Int32] = unsafeTypeArray(association: .submesh, semantic: .material)
+        let submeshIndexOffsets: AttributeElements<Int32> = elements(association: .submesh, semantic: .indexoffset)
+        let submeshMaterials: AttributeElements<Int32> = elements(association: .submesh, semantic: .material)
+        guard let lastOffset = submeshIndexOffsets.last,
+              let submeshesBuffer = device.makeBuffer(
+                length: MemoryLayout<Submesh>.stride * submeshIndexOffsets.count,
+                options: [.storageModeShared]) else { return }
 
-        var submeshes = [Submesh]()
-
-        for (i, offset) in submeshIndexOffsets.enumerated() {
+        // Decode the submeshes straight into the buffer
+        let destination: UnsafeMutablePointer<Submesh> = submeshesBuffer.toUnsafeMutablePointer()
+        for i in submeshIndexOffsets.indices {
 
             // Calculate the range of values in the index buffer
-            let start = Int(offset)
-            let nextOffset = i < submeshIndexOffsets.endIndex - 1 ? submeshIndexOffsets[Int(i+1)] : submeshIndexOffsets.last!
-            let end = i < submeshIndexOffsets.endIndex - 1 ? Int(nextOffset): Int(submeshIndexOffsets.last!)
+            let start = Int(submeshIndexOffsets[i])
+            let end = i < submeshIndexOffsets.endIndex - 1 ? Int(submeshIndexOffsets[i+1]): Int(lastOffset)
             let range: Range<Int> = start..<end
 
             // Account for a submesh with an empty material
             let material = submeshMaterials[i] == .empty ? Int32(defaultMaterial): submeshMaterials[i]
-            let submesh = Submesh(material, range)
-            submeshes.append(submesh)
+            (destination + i).initialize(to: Submesh(material, range))
         }
 
-        self.submeshesBuffer = device.makeBuffer(bytes: &submeshes, length: MemoryLayout<Submesh>.stride * submeshes.count, options: [.storageModeShared])
+        self.submeshesBuffer = submeshesBuffer
     }
 
     /// Provides a buffered pointer to the submeshes.
@@ -402,22 +424,10 @@ public class Geometry: ObservableObject, @unchecked Sendable {
     // MARK: Instances
 
     /// Returns the 4x4 row-major transform matrix values associated with their respective instances.
-    private func instanceTransforms() -> [float4x4] {
-        var results = [float4x4]()
-        let attributes = attributes(association: .instance, semantic: .transform)
-        for attribute in attributes {
-            let array: [Float] = attribute.buffer.data.unsafeTypeArray()
-            let values = array.chunked(into: 16).map {
-                simd_float4x4(
-                    SIMD4<Float>($0[0], $0[1], $0[2], $0[3]),
-                    SIMD4<Float>($0[4], $0[5], $0[6], $0[7]),
-                    SIMD4<Float>($0[8], $0[9], $0[10], $0[11]),
-                    SIMD4<Float>($0[12], $0[13], $0[14], $0[15])
-                )
-            }
-            results.append(contentsOf: values)
-        }
-        return results
+    /// The 16 floats of each transform are laid out exactly like the columns of a `float4x4`,
+    /// so the matrices are bound in place instead of being rebuilt from chunks of floats.
+    private func instanceTransforms() -> AttributeElements<float4x4> {
+        elements(association: .instance, semantic: .transform)
     }
 
     /// Holds a hash of mesh indexes and an array of instance indexes that share the mesh.
@@ -430,9 +440,20 @@ public class Geometry: ObservableObject, @unchecked Sendable {
     /// Returns the instance offsets (used for instancing).
     private(set) var instanceOffsets = [Int]()
 
+    /// Provides a dense reverse lookup of instance indices (ids) into their slot in the `instances` buffer.
+    /// The array is indexed by the instance id and holds `.empty` for instances that aren't renderable.
+    private(set) var instanceSlots = [Int]()
+
     /// Holds a set of hidden instanced meshes.
     private(set) var hiddeninstancedMeshes = Set<Int>()
 
+    /// Holds the number of visible (not hidden) instances of each instanced mesh.
+    /// The counts are updated incrementally as instance states change.
+    private var visibleInstanceCounts = [Int]()
+
+    /// Holds the compact state and color override index of every instance slot.
+    private var instanceStates = InstanceStates(count: 0)
+
     /// Makes the instance buffer.
     private func makeInstancesBuffer() async {
 
@@ -444,51 +465,60 @@ public class Geometry: ObservableObject, @unchecked Sendable {
             debugPrint("􀬨 Instances [\(instances.count)] made in [\(timeInterval.stringFromTimeInterval())]")
         }
 
-        var instances = [Instance]()
-        let instanceFlags: [Int16] = unsafeTypeArray(association: .instance, semantic: .flags)
-        let instanceParents: [Int32] = unsafeTypeArray(association: .instance, semantic: .parent)
-        let instanceMeshes: [Int32] = unsafeTypeArray(association: .instance, semantic: .mesh)
+        let instanceFlags: AttributeElements<Int16> = elements(association: .instance, semantic: .flags)
+        let instanceParents: AttributeElements<Int32> = elements(association: .instance, semantic: .parent)
+        let instanceMeshes: AttributeElements<Int32> = elements(association: .instance, semantic: .mesh)
         let transforms = instanceTransforms()
 
-        // 1) Build the array of instances
-        for (i, transform) in transforms.enumerated() {
-
-            var flags: Int16 = 0
-            if instanceFlags.indices.contains(i) {
-                flags = instanceFlags[i]
-            }
+        // Drop any instances that don't have empty mesh data or are hidden by default
+        let isRenderable: (Int) -> Bool = { i in
+            let flags: Int16 = instanceFlags.indices.contains(i) ? instanceFlags[i] : .zero
+            return instanceMeshes[i] != .empty && flags == .zero
+        }
 
+        // 1) Count the renderable instances so the buffer can be allocated up front
+        let instanceCount = transforms.indices.reduce(into: 0) { count, i in
+            if isRenderable(i) { count += 1 }
+        }
+        guard instanceCount > 0, let instancesBuffer = device.makeBuffer(
+            length: MemoryLayout<Instance>.stride * instanceCount,
+            options: [.storageModeShared]) else { return }
+
+        // 2) Decode the instances straight into the buffer
+        var instances: UnsafeMutableBufferPointer<Instance> = instancesBuffer.toUnsafeMutableBufferPointer()
+        var offset = 0
+        meshInstances.reserveCapacity(meshes.count)
+        for i in transforms.indices where isRenderable(i) {
             let mesh = Int(instanceMeshes[i])
             let parent = Int(instanceParents[i])
             let transparent = isTransparent(mesh)
-            let instance = Instance(index: i, matrix: transform, flags: flags, parent: parent, mesh: mesh, transparent: transparent)
-
-            // Drop any instances that don't have empty mesh data or are hidden by default
-            guard mesh != .empty, flags == .zero else { continue }
+            let instance = Instance(index: i, matrix: transforms[i], flags: .zero, parent: parent, mesh: mesh, transparent: transparent)
 
             // Add this instance to the mesh map
-            if meshInstances[mesh] != nil {
-                meshInstances[mesh]?.append(i)
-            } else {
-                meshInstances[mesh] = [i]
-            }
-            instances.append(instance)
+            meshInstances[mesh, default: []].append(i)
+            instances.initializeElement(at: offset, to: instance)
+            offset += 1
         }
 
-        // 2) Sort the instances by transparency & mesh index
+        // 3) Sort the instances in place by transparency & mesh index
         instances.sort {
             ($0.transparent ? 0 : 1, $0.mesh) > ($1.transparent ? 0 : 1, $1.mesh)
         }
 
-        // 3) Make the array of instancedMeshes
+        // 4) Make the array of instancedMeshes
         var instancedMeshes = [InstancedMesh]()
+        instancedMeshes.reserveCapacity(meshInstances.count)
+        instanceOffsets.reserveCapacity(instances.count)
+        instancedMeshesMap.reserveCapacity(instances.count)
+        instanceSlots = [Int](repeating: .empty, count: transforms.count)
         var currentMesh = -1
         for (i, instance) in instances.enumerated() {
 
             let mesh = instance.mesh
 
-            // Map the offset
+            // Map the offset and the reverse lookup slot
             instanceOffsets.append(instance.index)
+            instanceSlots[instance.index] = i
 
             // If we have a new mesh, insert it into the array
             if currentMesh != mesh {
@@ -505,8 +535,9 @@ public class Geometry: ObservableObject, @unchecked Sendable {
             instancedMeshesMap[i] = instancedMeshes.indices.last
         }
 
-        // 4) Make the instances buffer
-        self.instancesBuffer = device.makeBuffer(bytes: &instances, length: MemoryLayout<Instance>.stride * instances.count, options: [.storageModeShared])
+        self.instancesBuffer = instancesBuffer
+        visibleInstanceCounts = instancedMeshes.map { $0.instanceCount }
+        instanceStates = .init(count: instanceCount)
 
         // 5) Make the instanced meshes buffer
         self.instancedMeshesBuffer = device.makeBuffer(bytes: &instancedMeshes, length: MemoryLayout<InstancedMesh>.stride * instancedMeshes.count, options: [.storageModeShared])
@@ -590,24 +621,23 @@ public class Geometry: ObservableObject, @unchecked Sendable {
             debugPrint("􀬨 Materials [\(materials.count)] made in [\(timeInterval.stringFromTimeInterval())]")
         }
 
-        let colors: [Float] = unsafeTypeArray(association: .material, semantic: .color)
-        let materialColors: [SIMD4<Float>] = colors.chunked(into: 4).map { SIMD4<Float>($0) }
-        let materialGlossiness: [Float] = unsafeTypeArray(association: .material, semantic: .glossiness)
-        let materialSmoothness: [Float] = unsafeTypeArray(association: .material, semantic: .smoothness)
-
-        var materials = [Material]()
-        for (i, color) in materialColors.enumerated() {
-            let glossiness = materialGlossiness[i]
-            let smoothness = materialSmoothness[i]
-            let material = Material(glossiness: glossiness, smoothness: smoothness, rgba: color)
-            materials.append(material)
-        }
+        let materialColors: AttributeElements<SIMD4<Float>> = elements(association: .material, semantic: .color)
+        let materialGlossiness: AttributeElements<Float> = elements(association: .material, semantic: .glossiness)
+        let materialSmoothness: AttributeElements<Float> = elements(association: .material, semantic: .smoothness)
 
-        self.materialsBuffer = device.makeBuffer(
-            bytes: &materials,
-            length: MemoryLayout<Material>.stride * materials.count,
+        guard let materialsBuffer = device.makeBuffer(
+            length: MemoryLayout<Material>.stride * materialColors.count,
             options: [.storageModeShared]
-        )
+        ) else { return }
+
+        // Decode the materials straight into the buffer
+        let destination: UnsafeMutablePointer<Material> = materialsBuffer.toUnsafeMutablePointer()
+        for i in materialColors.indices {
+            let material = Material(glossiness: materialGlossiness[i], smoothness: materialSmoothness[i], rgba: materialColors[i])
+            (destination + i).initialize(to: material)
+        }
+
+        self.materialsBuffer = materialsBuffer
     }
 
     /// Provides a buffered pointer to the materials.
@@ -647,7 +677,7 @@ extension Geometry {
 
     }
 
-    /// Computes the vertiex normals on the GPU using Metal Performance Shaders.
+    /// Computes the vertex normals in parallel on the CPU and caches the results.
     private func computeVertexNormals() async {
 
         let start = Date.now
@@ -657,74 +687,35 @@ extension Geometry {
         }
 
         // If the normals file has already been generated, just make the MTLBuffer from it
-        let cacheDirectory = FileManager.default.cacheDirectory
-        let normalsBufferFile = cacheDirectory.appending(path: "\(sha256Hash)\(normalsBufferExtension)")
+        let cache = Vim.DiskCache.shared
+        let normalsBufferName = "\(sha256Hash)\(normalsBufferExtension)"
+        let normalsBufferFile = cache.url(for: normalsBufferName, group: cacheGroup)
         if FileManager.default.fileExists(atPath: normalsBufferFile.path) {
-            guard let normalsBuffer = device.makeBufferNoCopy(normalsBufferFile, type: Float.self) else {
-                fatalError("💀 Unable to make MTLBuffer from normals file.")
+            // Fall back to copying the cached normals if the file can't be wrapped without a copy (such as a page misaligned file)
+            if let normalsBuffer = device.makeBufferNoCopy(normalsBufferFile, type: Float.self) ??
+                (try? Data(contentsOf: normalsBufferFile, options: .alwaysMapped)).flatMap({ device.makeBuffer($0, type: Float.self) }) {
+                self.normalsBuffer = normalsBuffer
+                return
             }
-            self.normalsBuffer = normalsBuffer
-            return
-        }
-
-        let commandQueue = device.makeCommandQueue()
-        var positionsCount = positions.count
-        var indicesCount = indices.count
-
-        guard !Task.isCancelled,
-              let library = MTLContext.makeLibrary(),
-              let function = library.makeFunction(name: computeVertexNormalsFunctionName),
-              let pipelineState = try? await device.makeComputePipelineState(function: function),
-              let positionsBuffer,
-              let indexBuffer,
-              let faceNormalsBuffer = device.makeBuffer(
-                length: MemoryLayout<SIMD3<Float>>.stride * (positionsCount/3),
-                options: [.storageModeShared]),
-              let resultsBuffer = device.makeBuffer(
-                length: MemoryLayout<Float>.stride * positionsCount,
-                options: [.storageModeShared]),
-              let commandBuffer = commandQueue?.makeCommandBuffer(),
-              let computeEncoder = commandBuffer.makeComputeCommandEncoder() else {
-            debugPrint("💩 Unable to compute normals.")
-            return
-        }
-
-        computeEncoder.setComputePipelineState(pipelineState)
-
-        // Encode the buffers to pass to the GPU
-        computeEncoder.setBuffer(positionsBuffer, offset: 0, index: 0)
-        computeEncoder.setBuffer(indexBuffer, offset: 0, index: 1)
-        computeEncoder.setBuffer(faceNormalsBuffer, offset: 0, index: 2)
-        computeEncoder.setBuffer(resultsBuffer, offset: 0, index: 3)
-        computeEncoder.setBytes(&positionsCount, length: MemoryLayout<Int>.size, index: 4)
-        computeEncoder.setBytes(&indicesCount, length: MemoryLayout<Int>.size, index: 5)
-
-        // Set the thread group size and dispatch
-        let gridSize: MTLSize = .init(width: 1, height: 1, depth: 1)
-        let width = pipelineState.threadExecutionWidth
-        let height = pipelineState.maxTotalThreadsPerThreadgroup / width
-        let threadsPerThreadgroup: MTLSize = .init(width: width, height: height, depth: 1)
-
-        if supportsNonUniformThreadGroupSizes {
-            computeEncoder.dispatchThreads(gridSize, threadsPerThreadgroup: threadsPerThreadgroup)
-        } else {
-            computeEncoder.dispatchThreadgroups(gridSize, threadsPerThreadgroup: threadsPerThreadgroup)
+            debugPrint("💩 Unable to make MTLBuffer from normals file, recomputing the normals.")
         }
 
-        computeEncoder.endEncoding()
-        commandBuffer.commit()
-        await commandBuffer.completed()
+        guard !Task.isCancelled else { return }
 
-        // Finally, write the results to a cache file and create the MTLBuffer from it
-        let data = Data(bytes: resultsBuffer.contents(), count: resultsBuffer.length)
-        try? data.write(to: normalsBufferFile)
-        guard let normalsBuffer = device.makeBufferNoCopy(normalsBufferFile, type: Float.self) else {
-            fatalError("💀 Unable to make MTLBuffer from normals file.")
+        // Compute the normals, write the results to a cache file and create the MTLBuffer from it
+        let data = Geometry.vertexNormals(positions: UnsafeBufferPointer(positions), indices: UnsafeBufferPointer(indices))
+        guard (try? cache.write(data, name: normalsBufferName, group: cacheGroup)) != nil,
+              let normalsBuffer = device.makeBufferNoCopy(normalsBufferFile, type: Float.self) else {
+            // Fall back to copying the normals if they couldn't be cached
+            self.normalsBuffer = device.makeBuffer(data, type: Float.self)
+            return
         }
         self.normalsBuffer = normalsBuffer
     }
 
-    /// Computes all of the instance bounding boxes on the GPU via Metal Performance Shaders.
+    /// Computes all of the instance bounding boxes and the model bounds in parallel on the CPU.
+    /// The local bounds of each mesh are computed once and then transformed into world space for
+    /// every instance that shares the mesh.
     private func computeBoundingBoxes() async {
         let start = Date.now
         defer {
@@ -732,61 +723,31 @@ extension Geometry {
             debugPrint("􀬨 Bounding boxes computed in [\(timeInterval.stringFromTimeInterval())]")
         }
 
-        let commandQueue = device.makeCommandQueue()
-        let instanceCount = instances.count - 1
-
-        guard !Task.isCancelled,
-              let library = MTLContext.makeLibrary(),
-              let function = library.makeFunction(name: computeBoundingBoxesFunctionName),
-              let pipelineState = try? await device.makeComputePipelineState(function: function),
-              let positionsBuffer, let indexBuffer, let instancesBuffer, let meshesBuffer, let submeshesBuffer,
-              let commandBuffer = commandQueue?.makeCommandBuffer(),
-              let computeEncoder = commandBuffer.makeComputeCommandEncoder() else {
+        guard !Task.isCancelled, positionsBuffer != nil, indexBuffer != nil, instancesBuffer != nil,
+              meshesBuffer != nil, submeshesBuffer != nil else {
             debugPrint("💩 Unable to compute bounding boxes.")
             return
         }
 
-        computeEncoder.setComputePipelineState(pipelineState)
-
-        // Encode the buffers to pass to the GPU
-        computeEncoder.setBuffer(positionsBuffer, offset: 0, index: 0)
-        computeEncoder.setBuffer(indexBuffer, offset: 0, index: 1)
-        computeEncoder.setBuffer(instancesBuffer, offset: 0, index: 2)
-        computeEncoder.setBuffer(meshesBuffer, offset: 0, index: 3)
-        computeEncoder.setBuffer(submeshesBuffer, offset: 0, index: 4)
-
-        // Set the thread group size and dispatch
-        let gridSize: MTLSize = .init(width: instanceCount, height: 1, depth: 1)
-        let width = pipelineState.threadExecutionWidth
-        let height = pipelineState.maxTotalThreadsPerThreadgroup / width
-        let threadsPerThreadgroup: MTLSize = .init(width: width, height: height, depth: 1)
+        // 1) Compute the local bounds of each mesh
+        let meshBounds = Geometry.meshBounds(
+            positions: UnsafeBufferPointer(positions),
+            indices: UnsafeBufferPointer(indices),
+            meshes: UnsafeBufferPointer(meshes),
+            submeshes: UnsafeBufferPointer(submeshes)
+        )
 
-        if supportsNonUniformThreadGroupSizes {
-            computeEncoder.dispatchThreads(gridSize, threadsPerThreadgroup: threadsPerThreadgroup)
-        } else {
-            computeEncoder.dispatchThreadgroups(gridSize, threadsPerThreadgroup: threadsPerThreadgroup)
-        }
+        guard !Task.isCancelled else { return }
 
-        computeEncoder.endEncoding()
-        commandBuffer.commit()
-        await commandBuffer.completed()
-
-        // For now, just loop through the instances on the CPU to calculate the world bounds
-        // In the future we could do this on the GPU but juice really isn't worth the squeeze
-        var minMounds: SIMD3<Float> = .zero
-        var maxMounds: SIMD3<Float> = .zero
-        for instance in instances {
-            minMounds = min(instance.boundingBox.minBounds, minMounds)
-            maxMounds = max(instance.boundingBox.maxBounds, maxMounds)
-        }
-        bounds = .init(maxBounds: maxMounds, minBounds: minMounds)
+        // 2) Transform the mesh bounds into the instance world bounds and reduce them into the model bounds
+        bounds = Geometry.computeBounds(instances: instances, meshBounds: meshBounds)
     }
 
     /// Calculates the bounding box for the specified instance.
     /// - Parameters:
     ///   - instance: the instance to calculate the bounding box for
     /// - Returns: the axis aligned bounding box for the specified instance or nil if the instance has no mesh information.
-    @available(*, deprecated, message: "Use computeBoundingBoxes(device:cacheDirectory).")
+    @available(*, deprecated, message: "Instance bounds are computed while loading the geometry.")
     func calculateBoundingBox(_ instance: Instance) -> MDLAxisAlignedBoundingBox? {
         guard !Task.isCancelled, let vertices = vertices(for: instance), vertices.isNotEmpty else { return nil }
         let matrix = instance.matrix
@@ -829,22 +790,10 @@ extension Geometry {
         let mesh = meshes[instance.mesh]
         let range = mesh.submeshes.range
         var results = [SIMD3<Float>]()
-        let indexes = submeshes[range].map { indices[$0.indices].map { Int($0) * 3} }.reduce( [], + )
-        for i in indexes {
-            let vertex: SIMD3<Float> = .init(positions[i..<(i+3)])
-            results.append(vertex)
-        }
-        return results
-    }
-
-    /// Helper method that returns all of the faces that are contained in the specified instance.
-    /// - Parameter instance: the instance to return all of the faces for
-    /// - Returns: all faces contained in the specified instance
-    func faces(for instance: Instance) -> [Face]? {
-        guard let vertices = vertices(for: instance)?.chunked(into: 3), vertices.isNotEmpty else { return nil }
-        var results = [Face]()
-        for vertex in vertices {
-            results.append(Face(a: vertex[0], b: vertex[1], c: vertex[2]))
+        for submesh in submeshes[range] {
+            for i in submesh.indices.range {
+                results.append(vertex(at: i))
+            }
         }
         return results
     }
@@ -858,14 +807,35 @@ extension Geometry {
         attributes.filter { $0.descriptor.association == association && $0.descriptor.semantic == semantic }
     }
 
-    /// Convenience method for accessing attribute data into an array of the specified type.
+    /// Convenience method for accessing attribute data as a zero-copy collection of the specified type.
     /// - Parameters:
     ///   - association: the aatribute descriptotor association to match against
     ///   - semantic: the aatribute descriptotor semantic to match against
-    /// - Returns: the attribute data as an array of the specified type.
-    private func unsafeTypeArray<T>(association: AttributeDescriptor.Association, semantic: AttributeDescriptor.Semantic) -> [T] {
-        let attributes = attributes(association: association, semantic: semantic)
-        return attributes.data.unsafeTypeArray()
+    /// - Returns: the attribute elements reinterpreted as the specified type.
+    private func elements<T>(association: AttributeDescriptor.Association, semantic: AttributeDescriptor.Semantic) -> AttributeElements<T> {
+        AttributeElements(attributes(association: association, semantic: semantic))
+    }
+}
+
+// MARK: Instance Lookup
+
+extension Geometry {
+
+    /// Returns the slot of the instance with the specified id inside the `instances` buffer.
+    /// - Parameter id: the instance id
+    /// - Returns: the index into the instances buffer or nil if the instance isn't renderable
+    public func slot(id: Int) -> Int? {
+        guard instanceSlots.indices.contains(id) else { return nil }
+        let slot = instanceSlots[id]
+        return slot != .empty ? slot : nil
+    }
+
+    /// Returns the slots of all of the instances with the specified ids inside the `instances` buffer.
+    /// Any ids that don't map to a renderable instance are skipped.
+    /// - Parameter ids: the instance ids
+    /// - Returns: the indices into the instances buffer
+    public func slots<S: Sequence>(ids: S) -> [Int] where S.Element == Int {
+        ids.compactMap { slot(id: $0) }
     }
 }
 
@@ -877,17 +847,47 @@ extension Geometry {
     ///   - from: the instance state to match
     ///   - to: the iinstance state to switch to
     public func toggle(from: InstanceState, to: InstanceState) {
-        for (i, value) in instances.enumerated() {
-            if value.state == from {
-                instances[i].state = to
-            }
+        guard from != to else { return }
+        for slot in instanceStates.slots(state: from) {
+            setState(to, slot: slot)
         }
+        flush()
     }
 
     /// Convenience func that returns a count of the instances in the specified state.
     /// - Parameter state: the state to match
     public func count(state: InstanceState) -> Int {
-        instances.filter{ $0.state == state }.count
+        instanceStates.count(state: state)
+    }
+
+    /// Sets the state of the instance in the specified slot and incrementally updates
+    /// the visible instance count of it's instanced mesh (and the hidden instanced meshes).
+    /// - Parameters:
+    ///   - state: the new instance state
+    ///   - slot: the slot of the instance in the instances buffer
+    private func setState(_ state: InstanceState, slot: Int) {
+        let previous = instanceStates.set(state, at: slot)
+        guard previous != state else { return }
+
+        guard previous == .hidden || state == .hidden else { return }
+        bvh?.setHidden(slot, state == .hidden)
+
+        guard let instanced = instancedMeshesMap[slot] else { return }
+        if state == .hidden {
+            visibleInstanceCounts[instanced] -= 1
+            if visibleInstanceCounts[instanced] == .zero {
+                hiddeninstancedMeshes.insert(instanced)
+            }
+        } else {
+            visibleInstanceCounts[instanced] += 1
+            hiddeninstancedMeshes.remove(instanced)
+        }
+    }
+
+    /// Writes the dirty instance states and color override indices into the instances buffer.
+    private func flush() {
+        guard instanceStates.dirty.isEmpty == false else { return }
+        instanceStates.flush(to: instances)
     }
 }
 
@@ -901,47 +901,29 @@ extension Geometry {
     ///   - ids: the ids of the instances to hide
     /// - Returns: the total count of hidden instances.
     public func hide(ids: Set<Int>) -> Int {
-        for id in ids {
-            guard let index = instanceOffsets.firstIndex(of: id) else { continue }
-            instances[index].state = .hidden
+        for index in slots(ids: ids) {
+            setState(.hidden, slot: index)
         }
-
-        let hidden = instances.filter{ $0.state == .hidden }.map { Int($0.index) }
-        let hiddenSet = Set<Int>(hidden)
-
-        // Hide all of the instanced meshes where all shared instances are hidden
-        for (i, instanced) in instancedMeshes.enumerated() {
-            let instancesSet = Set<Int>(meshInstances[instanced.mesh] ?? [])
-            if instancesSet.isSubset(of: hiddenSet) {
-                hiddeninstancedMeshes.insert(i)
-            }
-        }
-        return hidden.count
+        flush()
+        return count(state: .hidden)
     }
 
     /// Toggles all instance
     /// - Parameters:
     ///   - ids: the ids of the instances not to hide
     public func hide(excluding: Set<Int>) {
-        let excluded = excluding.compactMap{ instanceOffsets.firstIndex(of: $0) }
-
-        for (i, _) in instances.enumerated() {
-            if excluded.contains(i) {
-                instances[i].state = .default
-            } else {
-                instances[i].state = .hidden
-            }
+        for i in instances.indices {
+            setState(.hidden, slot: i)
+        }
+        for index in slots(ids: excluding) {
+            setState(.default, slot: index)
         }
+        flush()
     }
 
     /// Unhides all hidden instances.
     public func unhide() {
-        for (i, value) in instances.enumerated() {
-            if value.state == .hidden {
-                instances[i].state = .default
-            }
-        }
-        hiddeninstancedMeshes.removeAll()
+        toggle(from: .hidden, to: .default)
     }
 }
 
@@ -953,7 +935,7 @@ extension Geometry {
     /// - Parameter id: the instance id
     /// - Returns: the instance with the specified id or nil
     public func instance(id: Int) -> Instance? {
-        guard let index = instanceOffsets.firstIndex(of: id) else { return nil }
+        guard let index = slot(id: id) else { return nil }
         return instances[index]
     }
 
@@ -962,29 +944,56 @@ extension Geometry {
     ///   - id: the index of the instances to select or deselect
     /// - Returns: true if the instance was selected, otherwise false
     public func select(id: Int) -> Bool {
-        guard let index = instanceOffsets.firstIndex(of: id) else { return false }
-        let instance = instances[index]
-        switch instance.state {
+        guard let index = slot(id: id) else { return false }
+        defer { flush() }
+        switch instanceStates.state(at: index) {
         case .default, .hidden, .isolated:
-            instances[index].state = .selected
+            setState(.selected, slot: index)
             return true
         case .selected:
-            instances[index].state = .default
+            setState(.default, slot: index)
             return false
         @unknown default:
             return false
         }
     }
+
+    /// Toggles the instance state to `.selected` for all instances in the specified ids.
+    /// - Parameters:
+    ///   - ids: the ids of the instances to select
+    /// - Returns: the total count of selected instances.
+    public func select(ids: Set<Int>) -> Int {
+        for index in slots(ids: ids) {
+            setState(.selected, slot: index)
+        }
+        flush()
+        return count(state: .selected)
+    }
 }
 
 // MARK: Instance Isolation
 
 extension Geometry {
 
+    /// Toggles the instance state to `.isolated` for all instances in the specified ids and hides all other instances.
+    /// - Parameters:
+    ///   - ids: the ids of the instances to isolate
     public func isolate(ids: Set<Int>) {
-        for (i, value) in instances.enumerated() {
-            instances[i].state = ids.contains(value.index) ? .isolated : .hidden
+        let isolated = Set(slots(ids: ids))
+        if count(state: .hidden) + count(state: .isolated) == instances.count {
+            // Everything else is already hidden, so only the previously isolated instances need to be hidden
+            for slot in instanceStates.slots(state: .isolated) where !isolated.contains(slot) {
+                setState(.hidden, slot: slot)
+            }
+        } else {
+            for i in instances.indices where !isolated.contains(i) {
+                setState(.hidden, slot: i)
+            }
         }
+        for slot in isolated {
+            setState(.isolated, slot: slot)
+        }
+        flush()
     }
 }
 
@@ -1039,45 +1048,34 @@ extension Geometry {
         }
 
         // Update the instances buffer with the color override index
-        for id in ids {
-            guard let index = instanceOffsets.firstIndex(of: id) else { continue }
-            instances[index].colorIndex = colorIndex
+        for index in slots(ids: ids) {
+            if let unreferenced = instanceStates.set(colorIndex: colorIndex, at: index), unreferenced > 0 {
+                // Erase the previous color override as it's no longer referenced
+                colors[unreferenced] = .zero
+            }
         }
+        flush()
     }
 
     /// Unapplies the color override to all instances in the specified ids
     /// - Parameter ids: the ids of the instances to apply this color override for
     public func unapply(ids: Set<Int>) {
-        var erasables = Set<Int>() // Collect the erasable color indices
-        for id in ids {
-            guard let index = instanceOffsets.firstIndex(of: id) else { continue }
-            let instance = instances[index]
-            if instance.colorIndex != .empty {
-                erasables.insert(instance.colorIndex)
+        for index in slots(ids: ids) {
+            // Erase any color overrides that are no longer referenced
+            if let unreferenced = instanceStates.set(colorIndex: .empty, at: index), unreferenced > 0 {
+                colors[unreferenced] = .zero
             }
-            instances[index].colorIndex = .empty
-        }
-
-        // Check no other instances have a reference to the same color override
-        for (_, value) in instances.enumerated() {
-            let index = value.colorIndex
-            if erasables.contains(index) {
-                erasables.remove(index)
-            }
-        }
-
-        // Finally, erase any unused color overrides
-        for i in erasables {
-            colors[i] = .zero
         }
+        flush()
     }
 
     /// Removes all color overrides.
     public func unapplyAll() {
         // Erase all of the color indices from the instances
-        for (i, _) in instances.enumerated() {
-            instances[i].colorIndex = .empty
+        for slot in instanceStates.colored {
+            instanceStates.set(colorIndex: .empty, at: slot)
         }
+        flush()
 
         for (i, _) in colors.enumerated() {
             if i > 0 {
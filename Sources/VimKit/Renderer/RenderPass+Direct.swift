@@ -115,7 +115,7 @@ class RenderPassDirect: RenderPass {
 
         renderEncoder.pushDebugGroup(labelGeometryDebugGroupName)
 
-        let results = visibilityResults(geometry)
+        let results = visibilityResults(geometry, descriptor: descriptor)
         let start = Date.now
 
         // Draw the instanced meshes
@@ -172,15 +172,21 @@ class RenderPassDirect: RenderPass {
         )
     }
 
-    /// Query the bvh tree for frustum intersection results.
-    /// - Parameter geometry: the geometry to query
-    /// - Returns: a set of instanced meshes that are visibile within the view frustum
-    private func visibilityResults(_ geometry: Geometry) -> [Int] {
-        guard let bvh = geometry.bvh else { return .init() }
-        if minFrustumCullingThreshold <= geometry.instancedMeshes.count {
-            return bvh.intersectionResults(camera: camera).sorted()
-        } else {
+    /// Query the bvh tree for the instances inside the view frustum and clip planes and culls them on the CPU
+    /// with the same rules the indirect command buffers apply on the GPU.
+    /// - Parameters:
+    ///   - geometry: the geometry to query
+    ///   - descriptor: the draw descriptor that holds the per frame data
+    /// - Returns: the instanced meshes that are visible within the view frustum and clip planes
+    private func visibilityResults(_ geometry: Geometry, descriptor: DrawDescriptor) -> [Int] {
+        guard minFrustumCullingThreshold <= geometry.instancedMeshes.count else {
             return Array(0..<geometry.instancedMeshes.count)
         }
+        guard let framesBuffer = descriptor.framesBuffer else { return .init() }
+        let frame = framesBuffer.contents().advanced(by: descriptor.framesBufferOffset).assumingMemoryBound(to: Frame.self).pointee
+        guard let bvh = geometry.bvh else {
+            return geometry.visibleInstancedMeshes(frame)
+        }
+        return geometry.visibleInstancedMeshes(frame, bvh: bvh)
     }
 }
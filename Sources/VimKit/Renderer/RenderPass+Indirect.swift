@@ -8,18 +8,23 @@ import Combine
 import MetalKit
 import VimKitShaders
 
-private let functionNameVertex = "vertexMain"
-private let functionNameVertexDepthOnly = "vertexDepthOnly"
+private let functionNameVertex = "vertexIndirect"
 private let functionNameFragment = "fragmentMain"
 private let functionNameEncodeIndirectRenderCommands = "encodeIndirectRenderCommands"
+private let functionNameEncodeOccluderRenderCommands = "encodeOccluderRenderCommands"
+private let functionNameCompactVisibleInstances = "compactVisibleInstances"
+private let functionNameCompactOccluderInstances = "compactOccluderInstances"
 private let functionNameDepthPyramid = "depthPyramid"
+private let functionNameDepthPyramidFromDepth = "depthPyramidFromDepth"
+private let labelDepthPyramid = "DepthPyramid"
+private let labelRenderEncoderOccluders = "RenderEncoderOccluders"
 private let labelICB = "IndirectCommandBuffer"
 private let labelICBAlphaMask = "IndirectCommandBufferAlphaMask"
 private let labelICBTransparent = "IndirectCommandBufferTransparent"
 private let labelICBDepthOnly = "IndirectCommandBufferDepthOnly"
 private let labelICBDepthOnlyAlphaMask = "IndirectCommandBufferDepthOnlyAlphaMask"
 private let labelPipeline = "IndirectRendererPipeline"
-private let labelPipelineNoDepth = "IndirectRendererPipelineNoDepth"
+private let labelPipelineDepthOnly = "IndirectRendererPipelineDepthOnly"
 private let maxBufferBindCount = 24
 private let maxCommandCount = 1024 * 64
 private let maxExecutionRange = 1024 * 16
@@ -46,6 +51,12 @@ class RenderPassIndirect: RenderPass {
         var argumentEncoderTransparent: MTLBuffer
         /// A metal buffer for keep track of executed commands storing a single byte per command.
         var executedCommandsBuffer: MTLBuffer?
+        /// A metal buffer that carries the visibility of each instanced mesh over to the next frame (a single byte per instanced mesh).
+        var visibilityBuffer: MTLBuffer?
+        /// A metal buffer of the per frame compacted instance ids where each instanced mesh owns the range starting at it's base instance.
+        var instanceIdsBuffer: MTLBuffer?
+        /// A metal buffer of the number of compacted instances of each instanced mesh.
+        var instanceCountsBuffer: MTLBuffer?
     }
 
     /// The context that provides all of the data we need
@@ -60,14 +71,23 @@ class RenderPassIndirect: RenderPass {
     /// The icb container.
     var icb: ICB?
 
-    /// The compute pipeline state.
+    /// The compute pipeline states.
     private var computeFunction: MTLFunction?
     private var computePipelineState: MTLComputePipelineState?
+    private var occluderPipelineState: MTLComputePipelineState?
+    private var compactPipelineState: MTLComputePipelineState?
+    private var compactOccluderPipelineState: MTLComputePipelineState?
     /// The render pipeline stae.
     private var pipelineState: MTLRenderPipelineState?
     private var pipelineStateDepthOnly: MTLRenderPipelineState?
     private var depthStencilState: MTLDepthStencilState?
-    private var samplerState: MTLSamplerState?
+    /// The depth pyramid pipeline states.
+    private var depthPyramidPipelineState: MTLComputePipelineState?
+    private var depthPyramidFromDepthPipelineState: MTLComputePipelineState?
+    /// The depth pyramid (Hi-Z) where each texel holds the farthest depth of the texels it covers.
+    private var depthPyramid: MTLTexture?
+    /// Single level views of the depth pyramid that the reduction kernels read from and write into.
+    private var depthPyramidLevels = [MTLTexture]()
 
     /// Combine subscribers.
     var subscribers = Set<AnyCancellable>()
@@ -80,10 +100,10 @@ class RenderPassIndirect: RenderPass {
 
         let vertexDescriptor = makeVertexDescriptor()
         self.pipelineState = makeRenderPipelineState(context, vertexDescriptor, labelPipeline, functionNameVertex, functionNameFragment)
-        self.pipelineStateDepthOnly = makeDepthOnlyPipelineState(library)
+        self.pipelineStateDepthOnly = makeDepthOnlyPipelineState(library, vertexDescriptor)
         self.depthStencilState = makeDepthStencilState()
-        self.samplerState = makeSamplerState()
         makeComputePipelineState(library)
+        makeDepthPyramidPipelineStates(library)
 
         context.vim.geometry?.$state.sink { [weak self] state in
             guard let self, let geometry else { return }
@@ -102,7 +122,7 @@ class RenderPassIndirect: RenderPass {
 
                 let totalCommands = gridSize.width * gridSize.height
                 debugPrint("􀬨 Building indirect command buffers [\(totalCommands)]")
-                makeIndirectCommandBuffers(totalCommands)
+                makeIndirectCommandBuffers(totalCommands, geometry.instancedMeshes.count, geometry.instances.count)
             case .indexing, .loading, .unknown, .error:
                 break
             }
@@ -110,6 +130,16 @@ class RenderPassIndirect: RenderPass {
     }
 
     /// Performs all encoding and setup options before drawing.
+    ///
+    /// Every instance is culled on it's own and the survivors of each instanced mesh are compacted into a per frame
+    /// list of instance ids, so an instanced mesh only draws the instances that are actually visible.
+    ///
+    /// When depth testing is enabled culling happens in two phases. Phase one draws the depth of the instanced meshes
+    /// that were visible in the previous frame and builds the depth pyramid from it. Phase two tests every instance
+    /// against that depth pyramid, encodes the visible ones for drawing and keeps their visibility for the next frame.
+    /// Since the occluders come from the current frame's camera, anything that becomes visible is drawn the same frame.
+    /// If the depth pyramid couldn't be built this frame (no depth texture, missing pipeline states or a failed encoder)
+    /// phase two falls back to the frustum tests only, since the pyramid would hold stale or uninitialized depth.
     /// - Parameters:
     ///   - descriptor: the draw descriptor
     func willDraw(descriptor: DrawDescriptor) {
@@ -117,12 +147,30 @@ class RenderPassIndirect: RenderPass {
         // 1) Reset the commands in the icb
         reset(descriptor: descriptor);
 
-        guard let computeEncoder = descriptor.commandBuffer.makeComputeCommandEncoder() else { return }
+        // 2) Phase one: draw the depth of the previously visible instanced meshes and build the depth pyramid
+        var isDepthPyramidBuilt = false
+        if enableDepthTesting, let compactOccluderPipelineState, let occluderPipelineState {
+            if depthPyramid == nil, let depthTexture = descriptor.depthTexture {
+                makeDepthPyramid([Float(depthTexture.width), Float(depthTexture.height)])
+            }
+            if let computeEncoder = descriptor.commandBuffer.makeComputeCommandEncoder() {
+                encode(descriptor: descriptor, computeEncoder: computeEncoder)
+                dispatchInstances(computeEncoder: computeEncoder, pipelineState: compactOccluderPipelineState)
+                dispatchCommands(computeEncoder: computeEncoder, pipelineState: occluderPipelineState)
+                computeEncoder.endEncoding()
+                isDepthPyramidBuilt = drawOccluders(descriptor: descriptor) && buildDepthPyramid(descriptor: descriptor)
+            }
+        }
+        if !isDepthPyramidBuilt {
+            disableDepthTesting(descriptor: descriptor)
+        }
 
-        // 2) Encode the buffers onto the comute encoder
+        // 3) Phase two: test every instance against the depth pyramid and encode the visible instances
+        guard let compactPipelineState, let computePipelineState,
+              let computeEncoder = descriptor.commandBuffer.makeComputeCommandEncoder() else { return }
         encode(descriptor: descriptor, computeEncoder: computeEncoder)
-
-        // 3) End the compute encoding
+        dispatchInstances(computeEncoder: computeEncoder, pipelineState: compactPipelineState)
+        dispatchCommands(computeEncoder: computeEncoder, pipelineState: computePipelineState)
         computeEncoder.endEncoding()
 
         // 4) Optimize the icb commands (optional but let's do it anyway)
@@ -150,18 +198,27 @@ class RenderPassIndirect: RenderPass {
         collect()
     }
 
+    /// Rebuilds the depth pyramid when the view is resized.
+    /// - Parameters:
+    ///   - viewportSize: the new viewport size
+    ///   - physicalSize: the new physical size
+    func resize(viewportSize: SIMD2<Float>, physicalSize: SIMD2<Float>) {
+        makeDepthPyramid(viewportSize)
+    }
+
     /// Encodes the buffer data into the compute encoder.
     /// - Parameters:
     ///   - descriptor: the draw descriptor to use
-    ///   - renderEncoder: the compute encoder to use
+    ///   - computeEncoder: the compute encoder to use
     private func encode(descriptor: DrawDescriptor, computeEncoder: MTLComputeCommandEncoder) {
         guard let geometry,
-              let computePipelineState,
               let icb,
               let framesBuffer = descriptor.framesBuffer,
               let lightsBuffer = descriptor.lightsBuffer,
-              let depthTexture = descriptor.depthTexture,
               let executedCommandsBuffer = icb.executedCommandsBuffer,
+              let visibilityBuffer = icb.visibilityBuffer,
+              let instanceIdsBuffer = icb.instanceIdsBuffer,
+              let instanceCountsBuffer = icb.instanceCountsBuffer,
               let positionsBuffer = geometry.positionsBuffer,
               let normalsBuffer = geometry.normalsBuffer,
               let indexBuffer = geometry.indexBuffer,
@@ -173,7 +230,6 @@ class RenderPassIndirect: RenderPass {
               let colorsBuffer = geometry.colorsBuffer else { return }
 
         // 1) Encode
-        computeEncoder.setComputePipelineState(computePipelineState)
         computeEncoder.setBuffer(framesBuffer, offset: descriptor.framesBufferOffset, index: .frames)
         computeEncoder.setBuffer(lightsBuffer, offset: 0, index: .lights)
         computeEncoder.setBuffer(positionsBuffer, offset: 0, index: .positions)
@@ -187,12 +243,18 @@ class RenderPassIndirect: RenderPass {
         computeEncoder.setBuffer(colorsBuffer, offset: 0, index: .colors)
         computeEncoder.setBuffer(icb.argumentEncoder, offset: 0, index: .commandBufferContainer)
         computeEncoder.setBuffer(executedCommandsBuffer, offset: 0, index: .executedCommands)
-        computeEncoder.setSamplerState(samplerState, index: 0)
-        computeEncoder.setTexture(depthTexture, index: 0)
+        computeEncoder.setBuffer(visibilityBuffer, offset: 0, index: .visibility)
+        computeEncoder.setBuffer(instanceIdsBuffer, offset: 0, index: .instanceIds)
+        computeEncoder.setBuffer(instanceCountsBuffer, offset: 0, index: .instanceCounts)
+        computeEncoder.setTexture(depthPyramid, index: 0)
 
         // 2) Use Resources
         computeEncoder.useResource(icb.commandBuffer, usage: .read)
+        computeEncoder.useResource(icb.commandBufferDepthOnly, usage: .read)
         computeEncoder.useResource(executedCommandsBuffer, usage: .write)
+        computeEncoder.useResource(visibilityBuffer, usage: [.read, .write])
+        computeEncoder.useResource(instanceIdsBuffer, usage: [.read, .write])
+        computeEncoder.useResource(instanceCountsBuffer, usage: [.read, .write])
         computeEncoder.useResource(framesBuffer, usage: .read)
         computeEncoder.useResource(materialsBuffer, usage: .read)
         computeEncoder.useResource(instancesBuffer, usage: .read)
@@ -201,13 +263,34 @@ class RenderPassIndirect: RenderPass {
         computeEncoder.useResource(submeshesBuffer, usage: .read)
         computeEncoder.useResource(meshesBuffer, usage: .read)
         computeEncoder.useResource(indexBuffer, usage: .read)
-        computeEncoder.useResource(depthTexture, usage: .read)
+        if let depthPyramid {
+            computeEncoder.useResource(depthPyramid, usage: .read)
+        }
+    }
 
-        // 3) Dispatch the threads
+    /// Dispatches a compaction kernel with one simdgroup sized threadgroup per instanced mesh.
+    /// - Parameters:
+    ///   - computeEncoder: the compute encoder to use
+    ///   - pipelineState: the compaction pipeline state
+    private func dispatchInstances(computeEncoder: MTLComputeCommandEncoder, pipelineState: MTLComputePipelineState) {
+        guard let geometry, geometry.instancedMeshes.isNotEmpty else { return }
+        let threadgroups: MTLSize = .init(width: geometry.instancedMeshes.count, height: 1, depth: 1)
+        let threadgroupSize: MTLSize = .init(width: pipelineState.threadExecutionWidth, height: 1, depth: 1)
+        computeEncoder.setComputePipelineState(pipelineState)
+        computeEncoder.dispatchThreadgroups(threadgroups, threadsPerThreadgroup: threadgroupSize)
+    }
+
+    /// Dispatches a command encoding kernel over the grid of instanced meshes and their submeshes.
+    /// - Parameters:
+    ///   - computeEncoder: the compute encoder to use
+    ///   - pipelineState: the command encoding pipeline state
+    private func dispatchCommands(computeEncoder: MTLComputeCommandEncoder, pipelineState: MTLComputePipelineState) {
+        guard let geometry else { return }
         let gridSize = geometry.gridSize
-        let w = computePipelineState.threadExecutionWidth
-        let h = computePipelineState.maxTotalThreadsPerThreadgroup / w
+        let w = pipelineState.threadExecutionWidth
+        let h = pipelineState.maxTotalThreadsPerThreadgroup / w
         let threadgroupSize: MTLSize = .init(width: w, height: h, depth: 1)
+        computeEncoder.setComputePipelineState(pipelineState)
         computeEncoder.dispatchThreads(gridSize, threadsPerThreadgroup: threadgroupSize)
     }
 
@@ -230,6 +313,9 @@ class RenderPassIndirect: RenderPass {
     ///   - renderEncoder: the render encoder to use
     private func drawIndirect(descriptor: DrawDescriptor, renderEncoder: MTLRenderCommandEncoder) {
         guard let icb else { return }
+        if let instanceIdsBuffer = icb.instanceIdsBuffer {
+            renderEncoder.useResource(instanceIdsBuffer, usage: .read, stages: .vertex)
+        }
         for i in 0..<icb.indirectRangeCount {
             let offset = MemoryLayout<MTLIndirectCommandBufferExecutionRange>.size * i
             renderEncoder.executeCommandsInBuffer(icb.commandBuffer, indirectBuffer: icb.indirectRangeBuffer, offset: offset)
@@ -244,6 +330,7 @@ class RenderPassIndirect: RenderPass {
         guard let icb, let blitEncoder = descriptor.commandBuffer.makeBlitCommandEncoder() else { return }
         let range = 0..<icb.commandBuffer.size
         blitEncoder.resetCommandsInBuffer(icb.commandBuffer, range: range)
+        blitEncoder.resetCommandsInBuffer(icb.commandBufferDepthOnly, range: 0..<icb.commandBufferDepthOnly.size)
         blitEncoder.endEncoding()
     }
 
@@ -257,6 +344,45 @@ class RenderPassIndirect: RenderPass {
         blitEncoder.endEncoding()
     }
 
+    /// Builds the depth pyramid from the depth of the phase one occluders.
+    ///
+    /// The first level keeps the farthest depth of every 2x2 block of the depth texture and every
+    /// following level keeps the farthest depth of every 2x2 block of the level before it.
+    /// - Parameters:
+    ///   - descriptor: the draw descriptor
+    /// - Returns: true if the depth pyramid was encoded
+    private func buildDepthPyramid(descriptor: DrawDescriptor) -> Bool {
+        guard let depthTexture = descriptor.depthTexture,
+              let depthPyramidPipelineState,
+              let depthPyramidFromDepthPipelineState,
+              depthPyramidLevels.isNotEmpty,
+              let computeEncoder = descriptor.commandBuffer.makeComputeCommandEncoder() else { return false }
+
+        computeEncoder.label = labelDepthPyramid
+        let threadgroupSize: MTLSize = .init(width: 8, height: 8, depth: 1)
+        for (i, level) in depthPyramidLevels.enumerated() {
+            let source = i == 0 ? depthTexture : depthPyramidLevels[i - 1]
+            computeEncoder.setComputePipelineState(i == 0 ? depthPyramidFromDepthPipelineState : depthPyramidPipelineState)
+            computeEncoder.setTexture(source, index: 0)
+            computeEncoder.setTexture(level, index: 1)
+            computeEncoder.dispatchThreads(.init(width: level.width, height: level.height, depth: 1), threadsPerThreadgroup: threadgroupSize)
+        }
+        computeEncoder.endEncoding()
+        return true
+    }
+
+    /// Clears the depth testing flag of this frame's uniforms so phase two only performs the frustum tests.
+    /// The frame uniforms live in shared memory and are written before any of the render passes are encoded.
+    /// - Parameters:
+    ///   - descriptor: the draw descriptor
+    private func disableDepthTesting(descriptor: DrawDescriptor) {
+        guard let framesBuffer = descriptor.framesBuffer else { return }
+        let frame = framesBuffer.contents()
+            .advanced(by: descriptor.framesBufferOffset)
+            .assumingMemoryBound(to: Frame.self)
+        frame.pointee.enableDepthTesting = false
+    }
+
     /// Consumes the culling results from the icb and publishes the stats.
     private func collect() {
         guard let icb else { return }
@@ -267,49 +393,68 @@ class RenderPassIndirect: RenderPass {
                 context.vim.stats.executedCommands = count
             }
         }
+        if let instanceCountsBuffer = icb.instanceCountsBuffer {
+            Task {
+                let range: UnsafeMutableBufferPointer<UInt32> = instanceCountsBuffer.toUnsafeMutableBufferPointer()
+                let count = range.reduce(0) { $0 + Int($1) }
+                context.vim.stats.visibleInstanceCount = count
+            }
+        }
     }
 
-    /// Draws the depth pyramid offscreen.
+    /// Draws the depth of the phase one occluders into the depth texture.
+    ///
+    /// The main pass clears this depth and draws the occluders again. Loading it instead would need a `lessEqual`
+    /// depth compare and bit identical positions from the depth only and the shaded pipelines, which Metal doesn't
+    /// guarantee without position invariance, so the occluders would z-fight with themselves. The extra pass is cheap
+    /// compared to what it saves: it only draws the instances that were visible last frame, without a fragment
+    /// function or color attachments, while the depth pyramid built from it keeps every occluded instance out of
+    /// the main pass.
     /// - Parameters:
     ///   - descriptor: the draw descriptor to use
-    ///   - renderEncoder: the render encoder to use
-    private func drawDepthOffscreen(descriptor: DrawDescriptor, renderEncoder: MTLRenderCommandEncoder) {
-
-        guard let geometry,
-              let pipelineStateDepthOnly,
-              let positionsBuffer = geometry.positionsBuffer,
-              let indexBuffer = geometry.indexBuffer else { return }
-
+    /// - Returns: true if the occluders were encoded
+    private func drawOccluders(descriptor: DrawDescriptor) -> Bool {
+        guard let icb, let pipelineStateDepthOnly, let depthTexture = descriptor.depthTexture else { return false }
+
+        let renderPassDescriptor = MTLRenderPassDescriptor()
+        renderPassDescriptor.depthAttachment.texture = depthTexture
+        renderPassDescriptor.depthAttachment.loadAction = .clear
+        renderPassDescriptor.depthAttachment.storeAction = .store
+        renderPassDescriptor.depthAttachment.clearDepth = 1.0
+        renderPassDescriptor.stencilAttachment.texture = depthTexture
+
+        guard let renderEncoder = descriptor.commandBuffer.makeRenderCommandEncoder(descriptor: renderPassDescriptor) else { return false }
+        renderEncoder.label = labelRenderEncoderOccluders
         renderEncoder.setRenderPipelineState(pipelineStateDepthOnly)
         renderEncoder.setDepthStencilState(depthStencilState)
-        renderEncoder.setCullMode(.back)
-        renderEncoder.setTriangleFillMode(fillMode)
-
-        // Setup the per frame buffers to pass to the GPU
-        renderEncoder.setVertexBuffer(descriptor.framesBuffer, offset: descriptor.framesBufferOffset, index: .frames)
-        renderEncoder.setVertexBuffer(positionsBuffer, offset: 0, index: .positions)
-
-        renderEncoder.drawIndexedPrimitives(
-            type: .triangle,
-            indexCount: geometry.indices.count,
-            indexType: .uint32,
-            indexBuffer: indexBuffer, indexBufferOffset: 0
-        )
+        renderEncoder.setFrontFacing(.counterClockwise)
+        renderEncoder.setCullMode(options.cullMode)
+        if let instanceIdsBuffer = icb.instanceIdsBuffer {
+            renderEncoder.useResource(instanceIdsBuffer, usage: .read, stages: .vertex)
+        }
+        for i in 0..<icb.indirectRangeCount {
+            let offset = MemoryLayout<MTLIndirectCommandBufferExecutionRange>.size * i
+            renderEncoder.executeCommandsInBuffer(icb.commandBufferDepthOnly, indirectBuffer: icb.indirectRangeBuffer, offset: offset)
+        }
+        renderEncoder.endEncoding()
+        return true
     }
 
-    /// Makes a depth only pipeline state
-    /// - Parameter library: the library to use
+    /// Makes a depth only pipeline state that draws the depth only indirect commands.
+    /// - Parameters:
+    ///   - library: the library to use
+    ///   - vertexDescriptor: the vertex descriptor
     /// - Returns: the depth only pipeline state
-    private func makeDepthOnlyPipelineState(_ library: MTLLibrary) -> MTLRenderPipelineState? {
-
-        let vertexFunction = makeFunction(library, functionNameVertexDepthOnly)
-
+    private func makeDepthOnlyPipelineState(_ library: MTLLibrary, _ vertexDescriptor: MTLVertexDescriptor) -> MTLRenderPipelineState? {
         let pipelineDescriptor = MTLRenderPipelineDescriptor()
-        pipelineDescriptor.vertexFunction = vertexFunction
+        pipelineDescriptor.label = labelPipelineDepthOnly
+        pipelineDescriptor.vertexFunction = makeFunction(library, functionNameVertex)
+        pipelineDescriptor.vertexDescriptor = vertexDescriptor
         pipelineDescriptor.colorAttachments[0].pixelFormat = .invalid
-        pipelineDescriptor.colorAttachments[0].isBlendingEnabled = false
-        pipelineDescriptor.depthAttachmentPixelFormat = .depth32Float
-        pipelineDescriptor.label = labelPipelineNoDepth
+        pipelineDescriptor.depthAttachmentPixelFormat = context.destinationProvider.depthFormat
+        pipelineDescriptor.stencilAttachmentPixelFormat = context.destinationProvider.depthFormat
+        pipelineDescriptor.vertexBuffers[.positions].mutability = .mutable
+        pipelineDescriptor.supportIndirectCommandBuffers = true
 
         return try? device.makeRenderPipelineState(descriptor: pipelineDescriptor)
     }
@@ -328,11 +473,60 @@ class RenderPassIndirect: RenderPass {
               let computePipelineState = try? device.makeComputePipelineState(function: computeFunction) else { return }
         self.computePipelineState = computePipelineState
         self.computeFunction = computeFunction
+
+        // Make the phase one occluder pipeline state
+        guard let occluderFunction = library.makeFunction(name: functionNameEncodeOccluderRenderCommands) else { return }
+        occluderPipelineState = try? device.makeComputePipelineState(function: occluderFunction)
+
+        // Make the instance compaction pipeline states
+        guard let compactFunction = library.makeFunction(name: functionNameCompactVisibleInstances),
+              let compactOccluderFunction = library.makeFunction(name: functionNameCompactOccluderInstances) else { return }
+        compactPipelineState = try? device.makeComputePipelineState(function: compactFunction)
+        compactOccluderPipelineState = try? device.makeComputePipelineState(function: compactOccluderFunction)
+    }
+
+    /// Makes the depth pyramid compute pipeline states.
+    /// - Parameter library: the metal library
+    private func makeDepthPyramidPipelineStates(_ library: MTLLibrary) {
+        guard let depthPyramidFunction = library.makeFunction(name: functionNameDepthPyramid),
+              let depthPyramidFromDepthFunction = library.makeFunction(name: functionNameDepthPyramidFromDepth) else { return }
+        depthPyramidPipelineState = try? device.makeComputePipelineState(function: depthPyramidFunction)
+        depthPyramidFromDepthPipelineState = try? device.makeComputePipelineState(function: depthPyramidFromDepthFunction)
+    }
+
+    /// Makes the depth pyramid and it's level views for the viewport size.
+    /// The first level is half the viewport size and every level after that is half the level before it.
+    /// - Parameter viewportSize: the viewport size
+    private func makeDepthPyramid(_ viewportSize: SIMD2<Float>) {
+        depthPyramid = nil
+        depthPyramidLevels.removeAll()
+        guard viewportSize != .zero else { return }
+
+        let width = Swift.max(1, Int(viewportSize.x) / 2)
+        let height = Swift.max(1, Int(viewportSize.y) / 2)
+        let textureDescriptor = MTLTextureDescriptor.texture2DDescriptor(
+            pixelFormat: .r32Float,
+            width: width,
+            height: height,
+            mipmapped: true
+        )
+        textureDescriptor.storageMode = .private
+        textureDescriptor.usage = [.shaderRead, .shaderWrite]
+        guard let texture = device.makeTexture(descriptor: textureDescriptor) else { return }
+        texture.label = labelDepthPyramid
+
+        depthPyramid = texture
+        depthPyramidLevels = (0..<texture.mipmapLevelCount).compactMap { level in
+            texture.makeTextureView(pixelFormat: .r32Float, textureType: .type2D, levels: level..<(level + 1), slices: 0..<1)
+        }
     }
 
     /// Makes the indirect command buffer struct.
-    /// - Parameter totalCommands: the total amount of commands the indirect command buffer supports.
-    private func makeIndirectCommandBuffers(_ totalCommands: Int = maxCommandCount) {
+    /// - Parameters:
+    ///   - totalCommands: the total amount of commands the indirect command buffer supports.
+    ///   - instancedMeshCount: the number of instanced meshes to keep visibility for.
+    ///   - instanceCount: the number of instances that can be compacted.
+    private func makeIndirectCommandBuffers(_ totalCommands: Int = maxCommandCount, _ instancedMeshCount: Int = 1, _ instanceCount: Int = 1) {
 
         guard let computeFunction else { return }
 
@@ -382,6 +576,14 @@ class RenderPassIndirect: RenderPass {
 
         guard let executedCommandsBuffer = device.makeBuffer(length: MemoryLayout<UInt8>.size * totalCommands, options: [.storageModeShared]) else { return }
 
+        // Nothing was visible before the first frame so every instanced mesh starts out hidden
+        guard let visibilityBuffer = device.makeBuffer(length: MemoryLayout<UInt8>.size * Swift.max(1, instancedMeshCount), options: [.storageModeShared]) else { return }
+        memset(visibilityBuffer.contents(), 0, visibilityBuffer.length)
+
+        // The compacted instance ids are rewritten every frame so they can live on the GPU
+        guard let instanceIdsBuffer = device.makeBuffer(length: MemoryLayout<UInt32>.size * Swift.max(1, instanceCount), options: [.storageModePrivate]),
+              let instanceCountsBuffer = device.makeBuffer(length: MemoryLayout<UInt32>.size * Swift.max(1, instancedMeshCount), options: [.storageModeShared]) else { return }
+
         // Set the struct to hold onto the icb data
         icb = .init(commandBuffer: commandBuffer,
                     commandBufferAlphaMask: commandBufferAlphaMask,
@@ -393,7 +595,10 @@ class RenderPassIndirect: RenderPass {
                     argumentEncoder: argumentEncoder,
                     argumentEncoderAlphaMask: argumentEncoderAlphaMask,
                     argumentEncoderTransparent: argumentEncoderTransparent,
-                    executedCommandsBuffer: executedCommandsBuffer
+                    executedCommandsBuffer: executedCommandsBuffer,
+                    visibilityBuffer: visibilityBuffer,
+                    instanceIdsBuffer: instanceIdsBuffer,
+                    instanceCountsBuffer: instanceCountsBuffer
         )
     }
 
@@ -23,7 +23,7 @@ extension Renderer {
         // Use the render pass descriptor from the MTKView
         let renderPassDescriptor = context.destinationProvider.currentRenderPassDescriptor
 
-        // Depth Texture Attachment
+        // Depth Texture Attachment (cleared rather than loaded, see `RenderPassIndirect.drawOccluders`)
         renderPassDescriptor?.depthAttachment.texture = depthTexture
         renderPassDescriptor?.depthAttachment.loadAction = .clear
         renderPassDescriptor?.depthAttachment.storeAction = .store
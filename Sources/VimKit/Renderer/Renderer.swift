@@ -156,30 +156,12 @@ extension Renderer {
     /// - Parameter index: the view index
     /// - Returns: the camera at the specifed index
     public func camera(_ index: Int) -> Camera {
-
-        // Splat out the frustum planes
-        let frustumPlanes = (camera.frustum.planes[0],
-                             camera.frustum.planes[1],
-                             camera.frustum.planes[2],
-                             camera.frustum.planes[3],
-                             camera.frustum.planes[4],
-                             camera.frustum.planes[5])
-
-        // Splat out the clip planes
-        let clipPlanes = (camera.clipPlanes[0],
-                          camera.clipPlanes[1],
-                          camera.clipPlanes[2],
-                          camera.clipPlanes[3],
-                          camera.clipPlanes[4],
-                          camera.clipPlanes[5])
-
-        return .init(
+        .init(
             position: camera.position,
             viewMatrix: camera.viewMatrix,
             projectionMatrix: camera.projectionMatrix,
             sceneTransform: camera.sceneTransform,
-            frustumPlanes: frustumPlanes,
-            clipPlanes: clipPlanes
+            culling: camera.culling
         )
     }
 }
@@ -208,7 +190,7 @@ extension Renderer {
         }
 
         let id = Int(pixelBytes)
-        guard let index = geometry.instanceOffsets.firstIndex(of: id) else { return }
+        guard let index = geometry.slot(id: id) else { return }
 
         let query = camera.unprojectPoint(displayLocation)
         var point3D: SIMD3<Float> = .zero
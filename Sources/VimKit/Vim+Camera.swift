@@ -13,6 +13,7 @@ import Foundation
 import ModelIO
 import simd
 import Spatial
+import VimKitShaders
 
 private let defaultFovDegrees: Float = 65
 private let defaultAspectRatio: Float = 1.3
@@ -28,7 +29,13 @@ extension Vim {
         public var frustum: Frustum = .init()
 
         /// The clipping planes to apply.
-        public var clipPlanes = [SIMD4<Float>](repeating: .invalid, count: 6)
+        public var clipPlanes = [SIMD4<Float>](repeating: .invalid, count: 6) {
+            didSet { updateCulling() }
+        }
+
+        /// The packed frustum + clip planes that are passed to the GPU for culling.
+        /// The culling data is only rebuilt when the projection or clip planes change.
+        public private(set) var culling: Culling = .init()
 
         /// Holds our scene rotation transform which is used to
         /// convert from other cameras (such as ARKit or VisionPro).
@@ -143,6 +150,14 @@ extension Vim {
             let projectiveTransform = ProjectiveTransform3D(fovyRadians: fovyRadians, aspectRatio: aspectRatio, nearZ: nearZ, farZ: farZ)
             projectionMatrix = .init(projectiveTransform)
             frustum.update(self)
+            updateCulling()
+        }
+
+        /// Packs the frustum and clip planes into the culling data.
+        private func updateCulling() {
+            culling = .init(projectionViewMatrix: projectionMatrix * viewMatrix,
+                            frustumPlanes: frustum.planes,
+                            clipPlanes: clipPlanes)
         }
 
         /// Updates the camera by translating and rotating the camera with the specified offsets.
@@ -388,6 +403,51 @@ extension Vim {
     }
 }
 
+extension Culling {
+
+    /// Packs the frustum and clip planes into culling data where every plane faces inward.
+    /// The clip planes are normalized and flipped once here (instead of for every instance), the invalid clip planes
+    /// are left out of the plane mask and the corner farthest along each plane normal is selected ahead of time.
+    /// - Parameters:
+    ///   - projectionViewMatrix: the camera projection view matrix
+    ///   - frustumPlanes: the 6 frustum planes
+    ///   - clipPlanes: the 6 clip planes (invalid planes have an infinite w)
+    init(projectionViewMatrix: float4x4, frustumPlanes: [SIMD4<Float>], clipPlanes: [SIMD4<Float>]) {
+        var planes = [SIMD4<Float>](repeating: .zero, count: 12)
+        var planeMask: UInt32 = 0
+        var vertexSelection: SIMD3<UInt32> = .zero
+
+        for (i, plane) in frustumPlanes.prefix(6).enumerated() {
+            planes[i] = plane
+            planeMask |= 1 << i
+        }
+        for (i, plane) in clipPlanes.prefix(6).enumerated() where !plane.w.isInfinite {
+            planes[i + 6] = SIMD4<Float>(-normalize(plane.xyz), plane.w)
+            planeMask |= 1 << (i + 6)
+        }
+        for (i, plane) in planes.enumerated() {
+            let bit: UInt32 = 1 << i
+            if plane.x >= .zero { vertexSelection.x |= bit }
+            if plane.y >= .zero { vertexSelection.y |= bit }
+            if plane.z >= .zero { vertexSelection.z |= bit }
+        }
+
+        self.init(projectionViewMatrix: projectionViewMatrix,
+                  planes: (planes[0], planes[1], planes[2], planes[3], planes[4], planes[5],
+                           planes[6], planes[7], planes[8], planes[9], planes[10], planes[11]),
+                  planeMask: planeMask,
+                  vertexSelection: vertexSelection)
+    }
+
+    /// Returns the active planes and the corner selection of each plane.
+    var activePlanes: [(plane: SIMD4<Float>, positive: SIMD3<UInt32>)] {
+        let planes = withUnsafeBytes(of: self.planes) { Array($0.bindMemory(to: SIMD4<Float>.self)) }
+        return planes.indices.filter { planeMask & (1 << $0) != 0 }.map { i in
+            (planes[i], (vertexSelection &>> UInt32(i)) & 1)
+        }
+    }
+}
+
 fileprivate extension Array where Element == SIMD4<Float> {
 
     subscript(_ side: Vim.Camera.Frustum.Plane) -> SIMD4<Float> {
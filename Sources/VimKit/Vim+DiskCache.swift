@@ -0,0 +1,430 @@
+//
+//  Vim+DiskCache.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+
+// The name of the cache manifest file
+private let manifestFileName = "manifest.json"
+// The file extension of in-flight writes
+private let temporaryFileExtension = "tmp"
+// The length of a hex encoded sha256 hash (every group is keyed by one)
+private let hashLength = 64
+// The default cache byte budget (8GB)
+private let defaultByteLimit: Int64 = 8 * 1024 * 1024 * 1024
+
+extension Vim {
+
+    /// Provides a content-addressed on-disk cache for downloaded vim files and the artifacts derived from them
+    /// (normals buffers, preview images, sqlite databases, etc).
+    ///
+    /// Every file is stored inside a group directory that is keyed by the model file hash, so all of the
+    /// artifacts of a model can be accounted for, touched and evicted together. A json manifest keeps track of
+    /// the files and last access time of each group and the least recently used groups are evicted once
+    /// the total size of the cache exceeds the `byteLimit`. Groups that belong to a model that is currently
+    /// open are pinned and never evicted.
+    ///
+    /// All writes go through a temporary file that is renamed into place once complete, so a crash mid-write
+    /// never leaves a truncated file behind that could later be memory mapped. Recording a file only adds it's
+    /// own size to the group and the manifest is persisted on a short debounce, so a burst of writes results in
+    /// a single manifest write (see `synchronize`).
+    public final class DiskCache: @unchecked Sendable {
+
+        /// The shared disk cache.
+        public static let shared: DiskCache = DiskCache()
+
+        /// Holds the cached files and access time of a model group.
+        struct Group: Codable {
+            /// The byte counts of the files inside the group keyed by file name.
+            var files: [String: Int64] = .init()
+            /// The total number of bytes of the recorded files.
+            var byteCount: Int64 = .zero
+            /// The last time the group was accessed.
+            var lastAccessed: Date = .now
+        }
+
+        /// The root directory of the cache.
+        let directory: URL
+        /// The delay before pending manifest changes are persisted.
+        let saveDelay: DispatchTimeInterval
+
+        /// The maximum number of bytes the cache should hold before it starts evicting the least recently used groups.
+        public var byteLimit: Int64 {
+            get {
+                lock.lock()
+                defer { lock.unlock() }
+                return limit
+            }
+            set {
+                lock.lock()
+                limit = newValue
+                lock.unlock()
+                trim()
+            }
+        }
+
+        /// Returns the total number of bytes held by the cache.
+        public var totalByteCount: Int64 {
+            lock.lock()
+            defer { lock.unlock() }
+            return groups.values.reduce(.zero) { $0 + $1.byteCount }
+        }
+
+        /// The cache groups keyed by model file hash.
+        private var groups: [String: Group] = .init()
+        /// The groups that are currently in use and shouldn't be evicted.
+        private var pinned: [String: Int] = .init()
+        /// The backing byte limit.
+        private var limit: Int64 = defaultByteLimit
+        /// Flag indicating if a manifest save has been scheduled but not yet performed.
+        private var isSaveScheduled: Bool = false
+        /// The lock mechanism.
+        private let lock = NSLock()
+
+        /// The manifest file url.
+        private var manifestURL: URL {
+            directory.appending(path: manifestFileName)
+        }
+
+        /// Initializes the cache inside the specified directory.
+        /// - Parameters:
+        ///   - directory: the root directory of the cache
+        ///   - saveDelay: the delay before pending manifest changes are persisted
+        init(directory: URL = FileManager.default.cacheDirectory, saveDelay: DispatchTimeInterval = .seconds(1)) {
+            self.directory = directory
+            self.saveDelay = saveDelay
+            try? FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+            load()
+        }
+
+        /// Returns the url of the group directory.
+        /// - Parameter group: the model group
+        /// - Returns: the group directory url
+        public func url(group: String) -> URL {
+            directory.appending(path: group, directoryHint: .isDirectory)
+        }
+
+        /// Returns the url of the named file inside the group (the file may or may not exist yet).
+        /// The group directory is created if it doesn't exist.
+        /// - Parameters:
+        ///   - name: the name of the file
+        ///   - group: the model group the file belongs to
+        /// - Returns: the file url
+        public func url(for name: String, group: String) -> URL {
+            let groupURL = url(group: group)
+            try? FileManager.default.createDirectory(at: groupURL, withIntermediateDirectories: true)
+            return groupURL.appending(path: name)
+        }
+
+        /// Looks up the url of a cached file by name in any group.
+        /// - Parameter name: the name of the file
+        /// - Returns: the file url or nil if no group contains a file with the name.
+        public func url(named name: String) -> URL? {
+            lock.lock()
+            defer { lock.unlock() }
+            guard let group = groups.first(where: { $0.value.files[name] != nil })?.key else { return nil }
+            return url(group: group).appending(path: name)
+        }
+
+        /// Returns true if the named file exists inside the group.
+        /// - Parameters:
+        ///   - name: the name of the file
+        ///   - group: the model group the file belongs to
+        public func contains(_ name: String, group: String) -> Bool {
+            FileManager.default.fileExists(atPath: url(group: group).appending(path: name).path)
+        }
+
+        /// Atomically writes the data into the named file of the group and records it in the manifest.
+        /// - Parameters:
+        ///   - data: the data to write
+        ///   - name: the name of the file
+        ///   - group: the model group the file belongs to
+        /// - Returns: the url of the written file
+        @discardableResult
+        public func write(_ data: Data, name: String, group: String) throws -> URL {
+            let fileURL = url(for: name, group: group)
+            let temporaryURL = temporaryURL(for: fileURL)
+            do {
+                try data.write(to: temporaryURL)
+                try replace(fileURL, with: temporaryURL)
+            } catch let error {
+                try? FileManager.default.removeItem(at: temporaryURL)
+                throw error
+            }
+            record(name, group: group, byteCount: Int64(data.count))
+            return fileURL
+        }
+
+        /// Atomically moves the file at the source url into the named file of the group and records it in the manifest.
+        /// The file is first moved next to its destination (which may copy across volumes) and then renamed into place.
+        /// - Parameters:
+        ///   - sourceURL: the url of the file to move
+        ///   - name: the name of the file
+        ///   - group: the model group the file belongs to
+        /// - Returns: the url of the moved file
+        @discardableResult
+        public func move(from sourceURL: URL, name: String, group: String) throws -> URL {
+            let fileURL = url(for: name, group: group)
+            let temporaryURL = temporaryURL(for: fileURL)
+            do {
+                try FileManager.default.moveItem(at: sourceURL, to: temporaryURL)
+                try replace(fileURL, with: temporaryURL)
+            } catch let error {
+                try? FileManager.default.removeItem(at: temporaryURL)
+                throw error
+            }
+            record(name, group: group)
+            return fileURL
+        }
+
+        /// Records a file that was written into the group directory by someone else (such as a sqlite store)
+        /// and marks the group as recently used.
+        /// - Parameters:
+        ///   - name: the name of the file
+        ///   - group: the model group the file belongs to
+        public func record(_ name: String, group: String) {
+            let fileURL = url(group: group).appending(path: name)
+            let size = (try? fileURL.resourceValues(forKeys: [.fileSizeKey]))?.fileSize ?? .zero
+            record(name, group: group, byteCount: Int64(size))
+        }
+
+        /// Records the byte count of a file inside the group and marks the group as recently used.
+        /// A file that is recorded again replaces it's previous byte count instead of adding to it.
+        /// The manifest save is deferred and the cache is only trimmed if the new total exceeds the byte limit.
+        /// - Parameters:
+        ///   - name: the name of the file
+        ///   - group: the model group the file belongs to
+        ///   - byteCount: the number of bytes the file occupies
+        private func record(_ name: String, group: String, byteCount: Int64) {
+            lock.lock()
+            var entry = groups[group] ?? Group()
+            entry.byteCount += byteCount - (entry.files[name] ?? .zero)
+            entry.files[name] = byteCount
+            entry.lastAccessed = .now
+            groups[group] = entry
+            scheduleSave()
+            let exceedsLimit = groups.values.reduce(.zero) { $0 + $1.byteCount } > limit
+            lock.unlock()
+            if exceedsLimit {
+                trim(excluding: group)
+            }
+        }
+
+        /// Marks the group as recently used.
+        /// - Parameter group: the model group
+        public func touch(group: String) {
+            lock.lock()
+            defer { lock.unlock() }
+            guard groups[group] != nil else { return }
+            groups[group]?.lastAccessed = .now
+            scheduleSave()
+        }
+
+        /// Immediately persists any pending manifest changes.
+        public func synchronize() {
+            lock.lock()
+            defer { lock.unlock() }
+            save()
+        }
+
+        /// Pins the group so that it won't be evicted while it is in use.
+        /// - Parameter group: the model group
+        public func pin(group: String) {
+            lock.lock()
+            defer { lock.unlock() }
+            pinned[group, default: .zero] += 1
+            groups[group]?.lastAccessed = .now
+        }
+
+        /// Unpins the group and allows it to be evicted again.
+        /// - Parameter group: the model group
+        public func unpin(group: String) {
+            lock.lock()
+            let count = (pinned[group] ?? 1) - 1
+            pinned[group] = count > .zero ? count : nil
+            lock.unlock()
+            trim()
+        }
+
+        /// Removes the group and all of its files from the cache.
+        /// - Parameter group: the model group
+        public func remove(group: String) {
+            lock.lock()
+            defer { lock.unlock() }
+            try? FileManager.default.removeItem(at: url(group: group))
+            groups[group] = nil
+            save()
+        }
+
+        /// Removes every group from the cache.
+        public func removeAll() {
+            lock.lock()
+            defer { lock.unlock() }
+            for group in groups.keys {
+                try? FileManager.default.removeItem(at: url(group: group))
+            }
+            groups.removeAll()
+            save()
+        }
+
+        /// Evicts the least recently used groups until the cache fits inside the byte limit.
+        /// - Parameter excluded: an optional group that should never be evicted (such as the group that was just written to)
+        public func trim(excluding excluded: String? = nil) {
+            lock.lock()
+            defer { lock.unlock() }
+
+            var totalByteCount = groups.values.reduce(.zero) { $0 + $1.byteCount }
+            let candidates = groups.filter { $0.key != excluded && pinned[$0.key] == nil }.sorted { $0.value.lastAccessed < $1.value.lastAccessed }
+
+            var evicted = false
+            for (group, entry) in candidates {
+                guard totalByteCount > limit else { break }
+                debugPrint("🗑️ [Cache] - evicting [\(group)]")
+                try? FileManager.default.removeItem(at: url(group: group))
+                groups[group] = nil
+                totalByteCount -= entry.byteCount
+                evicted = true
+            }
+            // Evictions are persisted right away so the manifest never references deleted groups
+            if evicted {
+                save()
+            }
+        }
+    }
+}
+
+private extension Vim.DiskCache {
+
+    /// Loads the manifest from disk and reconciles it with the contents of the cache directory.
+    ///
+    /// Only manifest groups and entries keyed by a sha256 hash are considered (every group and every file written
+    /// by previous versions of the cache is), so unrelated files that live in the same directory are left untouched.
+    /// - Group directories are recounted from disk, which drops groups that no longer exist and picks up files
+    ///   the debounced manifest never recorded.
+    /// - Downloads that previous versions stored as flat files in the root are moved into their own group.
+    /// - Any other flat files in the root (buffers, normals, sqlite stores, preview images) are derived
+    ///   artifacts from previous versions that are rebuilt on demand, so they are deleted.
+    /// - Temporary files left behind by interrupted writes are deleted.
+    func load() {
+        lock.lock()
+        defer { lock.unlock() }
+
+        var manifest = [String: Group]()
+        if let data = try? Data(contentsOf: manifestURL),
+           let groups = try? JSONDecoder().decode([String: Group].self, from: data) {
+            manifest = groups
+        }
+
+        let fileManager = FileManager.default
+        let entries = (try? fileManager.contentsOfDirectory(at: directory, includingPropertiesForKeys: [.isDirectoryKey])) ?? []
+        var groups = [String: Group]()
+        for entry in entries {
+            let name = entry.lastPathComponent
+            let isDirectory = (try? entry.resourceValues(forKeys: [.isDirectoryKey]))?.isDirectory ?? false
+
+            if isDirectory {
+                guard isHash(name) || manifest[name] != nil else { continue }
+                groups[name] = scan(group: name, lastAccessed: manifest[name]?.lastAccessed ?? .now)
+            } else if isHash(name) {
+                guard migrate(name) else { continue }
+                groups[name] = scan(group: name, lastAccessed: .now)
+            } else if isHash(String(name.prefix(hashLength))) || (entry.pathExtension == temporaryFileExtension && isHash(String(name.dropFirst().prefix(hashLength)))) {
+                // Legacy artifacts ("<hash>.<extension>") and interrupted migrations (".<hash>.<uuid>.tmp")
+                try? fileManager.removeItem(at: entry)
+            }
+        }
+        self.groups = groups
+        save()
+    }
+
+    /// Returns true if the name is a hex encoded sha256 hash.
+    /// - Parameter name: the file or directory name
+    func isHash(_ name: String) -> Bool {
+        name.count == hashLength && name.allSatisfy { $0.isHexDigit && !$0.isUppercase }
+    }
+
+    /// Moves a legacy download that is stored as a flat file at the root of the cache into it's own group.
+    /// The file is first renamed out of the way since the group directory lives at the same path.
+    /// - Parameter name: the name of the legacy file (which is also the name of it's group)
+    /// - Returns: true if the file was moved into the group
+    func migrate(_ name: String) -> Bool {
+        let fileManager = FileManager.default
+        let legacyURL = directory.appending(path: name)
+        let temporaryURL = temporaryURL(for: legacyURL)
+        do {
+            try replace(temporaryURL, with: legacyURL)
+            try fileManager.createDirectory(at: url(group: name), withIntermediateDirectories: true)
+            try replace(url(group: name).appending(path: name), with: temporaryURL)
+            return true
+        } catch let error {
+            debugPrint("💩 [Cache] - unable to migrate [\(name)]", error)
+            try? fileManager.removeItem(at: temporaryURL)
+            try? fileManager.removeItem(at: legacyURL)
+            return false
+        }
+    }
+
+    /// Scans the group directory for it's files and their byte counts and removes any temporary files.
+    /// - Parameters:
+    ///   - group: the model group
+    ///   - lastAccessed: the last time the group was accessed
+    /// - Returns: the group
+    func scan(group: String, lastAccessed: Date) -> Group {
+        let fileManager = FileManager.default
+        let files = (try? fileManager.contentsOfDirectory(at: url(group: group), includingPropertiesForKeys: [.fileSizeKey])) ?? []
+        var entry = Group(lastAccessed: lastAccessed)
+        for file in files {
+            guard file.pathExtension != temporaryFileExtension else {
+                try? fileManager.removeItem(at: file)
+                continue
+            }
+            let size = Int64((try? file.resourceValues(forKeys: [.fileSizeKey]))?.fileSize ?? .zero)
+            entry.files[file.lastPathComponent] = size
+            entry.byteCount += size
+        }
+        return entry
+    }
+
+    /// Atomically persists the manifest to disk. Must be called while holding the lock.
+    func save() {
+        isSaveScheduled = false
+        guard let data = try? JSONEncoder().encode(groups) else { return }
+        try? data.write(to: manifestURL, options: .atomic)
+    }
+
+    /// Schedules a manifest save after the `saveDelay` unless one is already pending, so a burst
+    /// of changes is persisted once. Must be called while holding the lock.
+    func scheduleSave() {
+        guard !isSaveScheduled else { return }
+        isSaveScheduled = true
+        DispatchQueue.global(qos: .utility).asyncAfter(deadline: .now() + saveDelay) { [weak self] in
+            guard let self else { return }
+            lock.lock()
+            defer { lock.unlock() }
+            guard isSaveScheduled else { return }
+            save()
+        }
+    }
+
+    /// Returns a unique temporary file url that lives next to the specified file url.
+    /// - Parameter fileURL: the destination file url
+    /// - Returns: a temporary file url inside the same directory
+    func temporaryURL(for fileURL: URL) -> URL {
+        fileURL.deletingLastPathComponent()
+            .appending(path: ".\(fileURL.lastPathComponent).\(UUID().uuidString)")
+            .appendingPathExtension(temporaryFileExtension)
+    }
+
+    /// Renames the temporary file into place, replacing any existing file.
+    /// - Parameters:
+    ///   - fileURL: the destination file url
+    ///   - temporaryURL: the fully written temporary file url
+    func replace(_ fileURL: URL, with temporaryURL: URL) throws {
+        guard rename(temporaryURL.path, fileURL.path) == .zero else {
+            throw CocoaError(.fileWriteUnknown, userInfo: [NSFilePathErrorKey: fileURL.path])
+        }
+    }
+}
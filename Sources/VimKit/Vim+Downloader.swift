@@ -36,11 +36,11 @@ extension Vim {
         /// Downloads the file, caches it, and returns the locally cached file url.
         func download(url: URL, delegate: (URLSessionTaskDelegate)? = nil) async throws -> URL {
             // Check if the file exists on disk first
-            let cacheDir = FileManager.default.cacheDirectory
-            let localFileURL = cacheDir.appending(path: url.sha256Hash)
+            let localFileURL = url.cacheURL
 
             if url.isCached {
                 debugPrint("🎯 Cache hit [\(url.absoluteString)]")
+                DiskCache.shared.touch(group: url.sha256Hash)
                 return localFileURL
             } else {
                 debugPrint("❌ Cache miss [\(localFileURL.path)]")
@@ -58,11 +58,12 @@ extension Vim {
                 try? FileManager.default.removeItem(at: downloadedURL)
                 throw DownloadError.error("Unable to download [\(url.absoluteString)] Status code[\(String(describing: response.statusCode()))]")
             }
-            // Move the file contents into our cache directory
+            // Atomically move the file contents into our cache directory
             do {
-                try FileManager.default.moveItem(at: downloadedURL, to: localFileURL)
+                try DiskCache.shared.move(from: downloadedURL, name: url.sha256Hash, group: url.sha256Hash)
             } catch let error {
                 debugPrint("💀", error)
+                throw error
             }
             return localFileURL
         }
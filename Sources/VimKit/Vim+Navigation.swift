@@ -27,7 +27,7 @@ extension Vim {
         guard pixelBytes != .empty else { return }
 
         let id = Int(pixelBytes)
-        guard let index = geometry.instanceOffsets.firstIndex(of: id) else { return }
+        guard let index = geometry.slot(id: id) else { return }
 
         let query = camera.unprojectPoint(center)
 
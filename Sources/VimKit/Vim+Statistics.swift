@@ -47,6 +47,9 @@ extension Vim {
             totalCommands - executedCommands
         }
 
+        /// The number of instances that survived culling and were drawn in the frame.
+        public var visibleInstanceCount: Int = .zero
+
         /// The percentage of commands that have been culled.
         public var cullingPercentage: Float {
             guard totalCommands != .zero else { return .zero }
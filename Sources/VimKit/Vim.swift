@@ -109,7 +109,7 @@ public class Vim: NSObject, ObservableObject, @unchecked Sendable {
     @MainActor
     public lazy var bufferNames: [String] = {
         assert(state == .ready, "Misuse - wait until the file is ready before you can read buffer data.")
-        return bfast.buffers.map { $0.name }
+        return bfast.names
     }()
 
     /// Returns the total bytes in this VIM file.
@@ -126,6 +126,11 @@ public class Vim: NSObject, ObservableObject, @unchecked Sendable {
         self.stats = .init()
     }
 
+    deinit {
+        guard let bfast else { return }
+        DiskCache.shared.unpin(group: bfast.fileHash)
+    }
+
     /// Loads the vim file from the remote source file url.
     /// - Parameters:
     ///   - url: the source url of the vim file
@@ -172,48 +177,38 @@ public class Vim: NSObject, ObservableObject, @unchecked Sendable {
 
         publish(state: .loading)
 
-        guard let bfast = BFast(url) else {
-            publish(state: .error("💀 Not a bfast file"))
+        let bfast: BFast
+        do {
+            bfast = try BFast(url)
+        } catch let error {
+            publish(state: .error("💀 Not a valid bfast file [\(error)]"))
             return
         }
+        // Keep the cached artifacts of this file from being evicted while it is open
+        if let previous = self.bfast {
+            DiskCache.shared.unpin(group: previous.fileHash)
+        }
+        DiskCache.shared.pin(group: bfast.fileHash)
         self.bfast = bfast
 
-        for buffer in bfast.buffers {
-            switch buffer.name {
-            case "header":
-                let headerEntries = String(data: buffer.data, encoding: .utf8)?.split(separator: "\n") ?? []
-                for headerEntry in headerEntries {
-                    let entry = headerEntry.split(separator: "=")
-                    header[String(entry[0])] = String(entry[1])
-                }
-                incrementProgressCount()
-            case "assets":
-                guard let container = BFast(buffer: buffer) else {
-                    publish(state: .error("💀 Assets buffer is not a bfast container"))
-                    return
-                }
-                assets = Assets(container)
-                incrementProgressCount()
-            case "entities":
-                guard let container = BFast(buffer: buffer) else {
-                    publish(state: .error("💀 Entities buffer is not a bfast container"))
-                    return
-                }
-                db = Database(container, self)
-                incrementProgressCount()
-            case "strings":
-                strings = String(data: buffer.data, encoding: .utf8)?.split(separator: "\0").map { String($0)} ?? []
-                strings.insert("", at: 0) // TODO: Bug? The indexes are off by 1
-                incrementProgressCount()
-            case "geometry":
-                guard let container = BFast(buffer: buffer) else { return }
-                geometry = Geometry(container)
-                incrementProgressCount()
-            default:
-                break
+        // Decode the containers on a task group and allow the load to be cancelled via the progress
+        let decoding = Task {
+            await decode(bfast)
+        }
+        Task { @MainActor in
+            progress.cancellationHandler = {
+                decoding.cancel()
             }
         }
 
+        let decoded = await withTaskCancellationHandler {
+            await decoding.value
+        } onCancel: {
+            decoding.cancel()
+        }
+
+        guard decoded else { return }
+
         // Subsribe to child container state changes
         subscribe()
 
@@ -223,6 +218,113 @@ public class Vim: NSObject, ObservableObject, @unchecked Sendable {
         publish(state: .ready)
     }
 
+    /// The decoded result of one of the top level buffers.
+    private enum Container: Sendable {
+        case header([String: String])
+        case strings([String])
+        case assets(Assets)
+        case entities(Database)
+        case geometry(Geometry)
+        case error(String)
+    }
+
+    /// Decodes the header, strings, entities, assets and geometry buffers concurrently.
+    /// Each buffer is independent of the others, so the total decode time is bounded by the largest container
+    /// instead of the sum of all of them. The decoded results are assigned on the calling task as they complete.
+    /// - Parameter bfast: the top level vim container
+    /// - Returns: true if all of the containers were decoded, false if an error occurred or the load was cancelled.
+    private func decode(_ bfast: BFast) async -> Bool {
+
+        await withTaskGroup(of: Container?.self) { group in
+
+            if let buffer = bfast.buffer("header") {
+                group.addTask {
+                    guard !Task.isCancelled else { return nil }
+                    var header = [String: String]()
+                    let headerEntries = String(data: buffer.data, encoding: .utf8)?.split(separator: "\n") ?? []
+                    for headerEntry in headerEntries {
+                        let entry = headerEntry.split(separator: "=", maxSplits: 1)
+                        guard entry.count == 2 else { continue }
+                        header[String(entry[0])] = String(entry[1])
+                    }
+                    return .header(header)
+                }
+            }
+
+            if let buffer = bfast.buffer("strings") {
+                group.addTask {
+                    guard !Task.isCancelled else { return nil }
+                    var strings = String(data: buffer.data, encoding: .utf8)?.split(separator: "\0").map { String($0)} ?? []
+                    strings.insert("", at: 0) // TODO: Bug? The indexes are off by 1
+                    return .strings(strings)
+                }
+            }
+
+            if let buffer = bfast.buffer("assets") {
+                group.addTask {
+                    guard !Task.isCancelled else { return nil }
+                    do {
+                        let container = try BFast(buffer: buffer)
+                        return .assets(Assets(container))
+                    } catch let error {
+                        return .error("💀 Assets buffer is not a valid bfast container [\(error)]")
+                    }
+                }
+            }
+
+            if let buffer = bfast.buffer("entities") {
+                group.addTask {
+                    guard !Task.isCancelled else { return nil }
+                    do {
+                        let container = try BFast(buffer: buffer)
+                        return .entities(Database(container, self))
+                    } catch let error {
+                        return .error("💀 Entities buffer is not a valid bfast container [\(error)]")
+                    }
+                }
+            }
+
+            if let buffer = bfast.buffer("geometry") {
+                group.addTask {
+                    guard !Task.isCancelled else { return nil }
+                    do {
+                        let container = try BFast(buffer: buffer)
+                        return .geometry(Geometry(container))
+                    } catch let error {
+                        return .error("💀 Geometry buffer is not a valid bfast container [\(error)]")
+                    }
+                }
+            }
+
+            for await result in group {
+                guard let result else { continue }
+                switch result {
+                case .header(let header):
+                    self.header = header
+                case .strings(let strings):
+                    self.strings = strings
+                case .assets(let assets):
+                    self.assets = assets
+                case .entities(let db):
+                    self.db = db
+                case .geometry(let geometry):
+                    self.geometry = geometry
+                case .error(let message):
+                    group.cancelAll()
+                    publish(state: .error(message))
+                    return false
+                }
+                incrementProgressCount()
+            }
+
+            guard !Task.isCancelled else {
+                publish(state: .unknown)
+                return false
+            }
+            return true
+        }
+    }
+
     /// Observes child state changes
     private func subscribe() {
 
@@ -267,25 +369,13 @@ public class Vim: NSObject, ObservableObject, @unchecked Sendable {
             publish(state: .unknown)
         }
 
-        var hashes = [String]([sha256Hash])
-        guard let geometry, let db else { return }
-        geometry.cancel()
-        db.cancel()
-
-        hashes.append(geometry.sha256Hash)
-        hashes.append(db.sha256Hash)
-
-        let cacheDirectory = FileManager.default.cacheDirectory
-        guard let files = try? FileManager.default.contentsOfDirectory(atPath: cacheDirectory.path()) else { return }
+        guard let bfast else { return }
+        geometry?.cancel()
+        db?.cancel()
 
-        for file in files {
-            for hash in hashes {
-                if file.contains(hash) {
-                    let url = FileManager.default.cacheDirectory.appending(path: file)
-                    try? FileManager.default.removeItem(at: url)
-                }
-            }
-        }
+        // Remove the model group (the downloaded file and all of its derived artifacts) from the cache
+        DiskCache.shared.unpin(group: bfast.fileHash)
+        DiskCache.shared.remove(group: bfast.fileHash)
     }
 
     /// Publishes the vim file state onto the main thread.
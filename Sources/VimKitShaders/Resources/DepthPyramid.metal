@@ -0,0 +1,78 @@
+//
+//  DepthPyramid.metal
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+#include <metal_stdlib>
+#include "../include/ShaderTypes.h"
+using namespace metal;
+
+// Returns the range of source texels covered by the destination texel.
+// Every source texel that overlaps the destination texel is included, so odd sizes stay conservative.
+// - Parameters:
+//   - position: The destination texel.
+//   - sourceSize: The source size.
+//   - destinationSize: The destination size.
+//   - lower: The first source texel.
+//   - upper: One past the last source texel.
+__attribute__((always_inline))
+static void footprint(const uint2 position,
+                      const uint2 sourceSize,
+                      const uint2 destinationSize,
+                      thread uint2 &lower,
+                      thread uint2 &upper) {
+    lower = position * sourceSize / destinationSize;
+    upper = min(((position + 1) * sourceSize + destinationSize - 1) / destinationSize, sourceSize);
+}
+
+// Writes the first level of the depth pyramid by keeping the farthest depth of the depth texture texels each texel covers.
+// - Parameters:
+//   - position: The thread position in the grid being executed.
+//   - depthTexture: The depth of the current frame's phase one occluders.
+//   - destination: The first level of the depth pyramid.
+[[kernel]]
+void depthPyramidFromDepth(uint2 position [[thread_position_in_grid]],
+                           depth2d<float, access::read> depthTexture [[texture(0)]],
+                           texture2d<float, access::write> destination [[texture(1)]]) {
+
+    const uint2 destinationSize = uint2(destination.get_width(), destination.get_height());
+    if (any(position >= destinationSize)) { return; }
+
+    uint2 lower, upper;
+    footprint(position, uint2(depthTexture.get_width(), depthTexture.get_height()), destinationSize, lower, upper);
+
+    float depth = 0.0;
+    for (uint y = lower.y; y < upper.y; y++) {
+        for (uint x = lower.x; x < upper.x; x++) {
+            depth = max(depth, depthTexture.read(uint2(x, y)));
+        }
+    }
+    destination.write(float4(depth), position);
+}
+
+// Writes the next level of the depth pyramid by keeping the farthest depth of the source texels each texel covers.
+// - Parameters:
+//   - position: The thread position in the grid being executed.
+//   - source: The previous level of the depth pyramid.
+//   - destination: The next level of the depth pyramid.
+[[kernel]]
+void depthPyramid(uint2 position [[thread_position_in_grid]],
+                  texture2d<float, access::read> source [[texture(0)]],
+                  texture2d<float, access::write> destination [[texture(1)]]) {
+
+    const uint2 destinationSize = uint2(destination.get_width(), destination.get_height());
+    if (any(position >= destinationSize)) { return; }
+
+    uint2 lower, upper;
+    footprint(position, uint2(source.get_width(), source.get_height()), destinationSize, lower, upper);
+
+    float depth = 0.0;
+    for (uint y = lower.y; y < upper.y; y++) {
+        for (uint x = lower.x; x < upper.x; x++) {
+            depth = max(depth, source.read(uint2(x, y)).r);
+        }
+    }
+    destination.write(float4(depth), position);
+}
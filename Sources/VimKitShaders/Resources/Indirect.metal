@@ -9,101 +9,110 @@
 #include "../include/ShaderTypes.h"
 using namespace metal;
 
-// Checks if the instance is inside the view frustum.
+// Checks if the instance is inside the view frustum and clip planes.
+// Only the bounds corner farthest along each plane normal is tested, which gives the same answer
+// as testing if all 8 corners are outside of the plane.
 // - Parameters:
-//   - camera: The per frame camera data.
+//   - culling: The per frame camera culling data.
 //   - instance: The instance to check if inside the view frustum.
-//   - corners: The instance bounding box corners.
-// - Returns: true if the instance is inside the view frustum, otherwise false
+// - Returns: true if the instance is inside the view frustum and clip planes, otherwise false
 __attribute__((always_inline))
-static bool isInsideViewFrustumAndClipPlanes(const Camera camera,
-                                             const Instance instance,
-                                             const float4 corners[8]) {
-    
-    
+static bool isInsideViewFrustumAndClipPlanes(const Culling culling,
+                                             const Instance instance) {
+
     if (instance.state == InstanceStateHidden) { return false; }
 
-    // Loop through the frustum + clip planes and check the box corners
-    for (int i = 0; i < 6; i++) {
+    const float3 minBounds = float3(instance.minBounds);
+    const float3 maxBounds = float3(instance.maxBounds);
 
-        const float4 frustumPlane = camera.frustumPlanes[i];
-        
-        if (dot(frustumPlane, corners[0]) < 0 &&
-            dot(frustumPlane, corners[1]) < 0 &&
-            dot(frustumPlane, corners[2]) < 0 &&
-            dot(frustumPlane, corners[3]) < 0 &&
-            dot(frustumPlane, corners[4]) < 0 &&
-            dot(frustumPlane, corners[5]) < 0 &&
-            dot(frustumPlane, corners[6]) < 0 &&
-            dot(frustumPlane, corners[7]) < 0) {
-            // Not visible - all corners returned negative
-            return false;
-        }
-        
-        const float4 clipPlane = camera.clipPlanes[i];
-        const float3 planeNormal = normalize(clipPlane.xyz);
-        
-        // Skip the plane if it's not valid
-        if (isinf(clipPlane.w)) { continue; }
-
-        if (-dot(planeNormal, corners[0].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[1].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[2].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[3].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[4].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[5].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[6].xyz) + clipPlane.w < 0 &&
-            -dot(planeNormal, corners[7].xyz) + clipPlane.w < 0) {
-            // Not visible - all corners returned negative
+    // Loop through the active frustum + clip planes
+    uint mask = culling.planeMask;
+    while (mask != 0) {
+        const uint i = ctz(mask);
+        mask &= mask - 1;
+
+        const bool3 positive = bool3((culling.vertexSelection >> i) & 1u);
+        const float3 corner = select(minBounds, maxBounds, positive);
+        if (dot(culling.planes[i], float4(corner, 1.0)) < 0) {
+            // Not visible - the farthest corner is outside of the plane
             return false;
         }
     }
     return true;
 }
 
-// Calculates the texture coordinates for the specified position.
+// Checks if the instance bounds are completely behind the depth pyramid (Hi-Z).
+// The screen space rect of the projected bounds is tested against the pyramid level where it covers
+// at most 2x2 texels, so only 4 texels are ever read no matter how large the instance is on screen.
 // - Parameters:
-//   - frame: The per frame data.
-//   - position: The position.
+//   - projectionViewMatrix: The camera projection view matrix.
+//   - corners: The instance bounding box corners.
+//   - depthPyramid: The depth pyramid (the farthest depth of the texels each texel covers).
+// - Returns: true if the instance is occluded
 __attribute__((always_inline))
-static float2 textureCoordinates(const Frame frame,
-                                 const float4 position) {
-    float2 clip = position.xy / position.w;
-    float2 screenCoords = clip * 0.5f + 0.5f;
-    return screenCoords * frame.viewportSize;
+static bool isOccluded(const float4x4 projectionViewMatrix,
+                       const float4 corners[8],
+                       texture2d<float, access::read> depthPyramid) {
+
+    float2 uvMin = float2(1.0);
+    float2 uvMax = float2(0.0);
+    float minDepth = 1.0;
+
+    for (int i = 0; i < 8; i++) {
+        const float4 clip = projectionViewMatrix * corners[i];
+        // The bounds cross the near plane so they can't be tested
+        if (clip.w <= 0) { return false; }
+        const float3 ndc = clip.xyz / clip.w;
+        const float2 uv = float2(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5);
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        minDepth = min(minDepth, ndc.z);
+    }
+
+    uvMin = saturate(uvMin);
+    uvMax = saturate(uvMax);
+    const float2 extent = uvMax - uvMin;
+
+    // Find the first level where the rect is no wider or taller than a single texel
+    const uint levelCount = depthPyramid.get_num_mip_levels();
+    uint level = 0;
+    uint2 size = uint2(depthPyramid.get_width(0), depthPyramid.get_height(0));
+    while (level + 1 < levelCount && any(extent * float2(size) > 1.0)) {
+        level++;
+        size = uint2(depthPyramid.get_width(level), depthPyramid.get_height(level));
+    }
+
+    const uint2 p0 = min(uint2(uvMin * float2(size)), size - 1);
+    const uint2 p1 = min(uint2(uvMax * float2(size)), size - 1);
+    const float maxDepth = max(max(depthPyramid.read(p0, level).r, depthPyramid.read(uint2(p1.x, p0.y), level).r),
+                               max(depthPyramid.read(uint2(p0.x, p1.y), level).r, depthPyramid.read(p1, level).r));
+    return minDepth > maxDepth;
 }
 
 // Checks if the instance is visible by performing contribution and depth testing.
 // - Parameters:
-//   - camera: The per frame data.
+//   - frame: The per frame data.
 //   - instance: The instance to check.
 //   - corners: The instance bounding box corners.
-//   - textureSize: The texture size.
-//   - textureSampler: The texture sampler.
-//   - depthTexture: The depth texture.
+//   - depthPyramid: The depth pyramid built from the current frame's phase one occluders.
 // - Returns: true if the instance passes the contribution & depth test
 __attribute__((always_inline))
 static bool isInstanceVisible(const Frame frame,
                               const Instance instance,
                               const float4 corners[8],
-                              const uint2 textureSize,
-                              const sampler textureSampler,
-                              depth2d<float> depthTexture) {
+                              texture2d<float, access::read> depthPyramid) {
     
     const bool enableDepthTesting = frame.enableDepthTesting;
     const bool enableContributionTesting = frame.enableContributionTesting;
     const Camera camera = frame.cameras[0];
-    
-    float4x4 viewMatrix = camera.viewMatrix;
-    float4x4 projectionMatrix = camera.projectionMatrix;
-    float4x4 projectionViewMatrix = projectionMatrix * viewMatrix;
+    const float4x4 projectionViewMatrix = camera.culling.projectionViewMatrix;
     
     // Contribution culling (remove instances that are too small to contribute significantly to the final image)
     if (enableContributionTesting) {
 
         // Transform the bounding box
-        float4 minBounds = projectionViewMatrix * float4(instance.minBounds, 1.0);
-        float4 maxBounds = projectionViewMatrix * float4(instance.maxBounds, 1.0);
+        float4 minBounds = projectionViewMatrix * float4(float3(instance.minBounds), 1.0);
+        float4 maxBounds = projectionViewMatrix * float4(float3(instance.maxBounds), 1.0);
 
         float3 boxMin = minBounds.xyz / minBounds.w;
         float3 boxMax = maxBounds.xyz / maxBounds.w;
@@ -118,80 +127,151 @@ static bool isInstanceVisible(const Frame frame,
         }
     }
     
-    // Depth z culling (eliminate instances that are behind other instances)
+    // Hi-Z occlusion culling (eliminate instances that are behind other instances)
     if (enableDepthTesting) {
-        
-        for (int i = 0; i < 8; i++) {
-            const float4 corner = projectionViewMatrix * corners[i];
-            const float2 sampleCoords = textureCoordinates(frame, corner);
-            const float depthSample = depthTexture.sample(textureSampler, sampleCoords);
-            float depthValue = corner.z / corner.w;
-            if (depthValue >= depthSample) {
-                return true;
-            }
-        }
-        
-        return false;
+        return !isOccluded(projectionViewMatrix, corners, depthPyramid);
     }
     
     return true;
 }
 
-// Checks if the instanced mesh is visible inside the view frustum and passes the depth test.
+// Checks if the instance is visible inside the view frustum and passes the contribution and depth test.
 // - Parameters:
 //   - frame: The per frame data.
-//   - instancedMesh: The instanced mesh to check.
-//   - instances: The instances pointer.
-//   - meshes: The meshes pointer.
-//   - submeshes: The submeshes pointer.
-//   - textureSampler: The texture sampler.
-//   - depthTexture: The depth texture.
-// - Returns: true if the instanced mesh is inside the view frustum and passes the depth test
+//   - instance: The instance to check.
+//   - depthPyramid: The depth pyramid.
+// - Returns: true if the instance is inside the view frustum and passes the contribution and depth test
 __attribute__((always_inline))
-static bool isInstancedMeshVisible(const Frame frame,
-                                   const InstancedMesh instancedMesh,
-                                   constant Instance *instances,
-                                   constant Mesh *meshes,
-                                   constant Submesh *submeshes,
-                                   sampler textureSampler,
-                                   depth2d<float> depthTexture) {
-    
+static bool isVisible(const Frame frame,
+                      const Instance instance,
+                      texture2d<float, access::read> depthPyramid) {
+
     const Camera camera = frame.cameras[0]; // TODO: Stereoscopic views??
 
-    // Get the texture size and sampler
-    const uint2 textureSize = uint2(depthTexture.get_width(), depthTexture.get_height());
-    
-    const int lowerBound = (int) instancedMesh.baseInstance;
-    const int upperBound = lowerBound + (int) instancedMesh.instanceCount;
+    if (!isInsideViewFrustumAndClipPlanes(camera.culling, instance)) { return false; }
 
-    // Loop through the instances and check their visibility
-    // If any instances are visible simply return true and allow the instancing draw call to happen
-    for (int i = lowerBound; i < upperBound; i++) {
-        
-        const Instance instance = instances[i];
-        
-        // Extract the box corners
-        const float4 corners[8] = {
-            float4(instance.minBounds, 1.0),
-            float4(instance.minBounds.x, instance.minBounds.y, instance.maxBounds.z, 1.0),
-            float4(instance.minBounds.x, instance.maxBounds.y, instance.minBounds.z, 1.0),
-            float4(instance.minBounds.x, instance.maxBounds.y, instance.maxBounds.z, 1.0),
-            float4(instance.maxBounds.x, instance.minBounds.y, instance.minBounds.z, 1.0),
-            float4(instance.maxBounds.x, instance.minBounds.y, instance.maxBounds.z, 1.0),
-            float4(instance.maxBounds.x, instance.maxBounds.y, instance.minBounds.z, 1.0),
-            float4(instance.maxBounds, 1.0)
-        };
-
-        const bool insideFrustum = isInsideViewFrustumAndClipPlanes(camera, instance, corners);
-
-        if (insideFrustum) {
-            // Check if the instance passes the depth & contribution test
-            const bool isVisible = isInstanceVisible(frame, instance, corners, textureSize, textureSampler, depthTexture);
-            if (isVisible) { return true; }
+    // Extract the box corners
+    const float4 corners[8] = {
+        float4(float3(instance.minBounds), 1.0),
+        float4(instance.minBounds.x, instance.minBounds.y, instance.maxBounds.z, 1.0),
+        float4(instance.minBounds.x, instance.maxBounds.y, instance.minBounds.z, 1.0),
+        float4(instance.minBounds.x, instance.maxBounds.y, instance.maxBounds.z, 1.0),
+        float4(instance.maxBounds.x, instance.minBounds.y, instance.minBounds.z, 1.0),
+        float4(instance.maxBounds.x, instance.minBounds.y, instance.maxBounds.z, 1.0),
+        float4(instance.maxBounds.x, instance.maxBounds.y, instance.minBounds.z, 1.0),
+        float4(float3(instance.maxBounds), 1.0)
+    };
+
+    // Check if the instance passes the depth & contribution test
+    return isInstanceVisible(frame, instance, corners, depthPyramid);
+}
+
+// Compacts the ids of the visible instances of an instanced mesh into the instance ids buffer.
+// The instances are tested one simdgroup wide at a time and the survivors are packed with a prefix sum,
+// so the ids keep their original order and are written to the instanced mesh's own range of the buffer
+// (starting at it's base instance) without any atomics.
+// - Parameters:
+//   - frame: The per frame data.
+//   - instancedMesh: The instanced mesh whose instances to compact.
+//   - instances: The instances pointer.
+//   - instanceIds: The instance ids buffer to compact into.
+//   - lane: The thread index in the simdgroup.
+//   - width: The number of threads in the simdgroup.
+//   - depthPyramid: The depth pyramid.
+// - Returns: the number of visible instances
+__attribute__((always_inline))
+static uint compactInstances(const Frame frame,
+                             const InstancedMesh instancedMesh,
+                             constant Instance *instances,
+                             device uint32_t *instanceIds,
+                             const uint lane,
+                             const uint width,
+                             texture2d<float, access::read> depthPyramid) {
+
+    const uint lowerBound = (uint) instancedMesh.baseInstance;
+    const uint upperBound = lowerBound + (uint) instancedMesh.instanceCount;
+
+    uint count = 0;
+    for (uint base = lowerBound; base < upperBound; base += width) {
+        const uint i = base + lane;
+        const bool visible = i < upperBound && isVisible(frame, instances[i], depthPyramid);
+        const uint offset = simd_prefix_exclusive_sum(visible ? 1u : 0u);
+        if (visible) {
+            instanceIds[lowerBound + count + offset] = i;
         }
+        count += simd_sum(visible ? 1u : 0u);
+    }
+    return count;
+}
+
+// Compacts the visible instances of the opaque instanced meshes that were visible in the previous frame (phase one).
+// Every other instanced mesh gets an instance count of zero. Depth testing is skipped since the depth pyramid
+// hasn't been built yet for this frame. Dispatched with one simdgroup sized threadgroup per instanced mesh.
+// - Parameters:
+//   - y: The index of the instanced mesh.
+//   - lane: The thread index in the simdgroup.
+//   - width: The number of threads in the simdgroup.
+//   - frames: The frames buffer.
+//   - instances: The instances pointer.
+//   - instancedMeshes: The instanced meshes pointer.
+//   - visibility: The visibility of each instanced mesh in the previous frame.
+//   - instanceIds: The instance ids buffer to compact into.
+//   - instanceCounts: The number of visible instances of each instanced mesh.
+//   - depthPyramid: The depth pyramid (not read).
+[[kernel]]
+void compactOccluderInstances(uint y [[threadgroup_position_in_grid]],
+                              uint lane [[thread_index_in_simdgroup]],
+                              uint width [[threads_per_simdgroup]],
+                              constant Frame *frames [[buffer(KernelBufferIndexFrames)]],
+                              constant Instance *instances [[buffer(KernelBufferIndexInstances)]],
+                              constant InstancedMesh *instancedMeshes [[buffer(KernelBufferIndexInstancedMeshes)]],
+                              constant uint8_t *visibility [[buffer(KernelBufferIndexVisibility)]],
+                              device uint32_t *instanceIds [[buffer(KernelBufferIndexInstanceIds)]],
+                              device uint32_t *instanceCounts [[buffer(KernelBufferIndexInstanceCounts)]],
+                              texture2d<float, access::read> depthPyramid [[texture(0)]]) {
+
+    const InstancedMesh instancedMesh = instancedMeshes[y];
+    uint count = 0;
+
+    // Only opaque instanced meshes that were visible in the previous frame are occluders
+    if (visibility[y] != 0 && !instancedMesh.transparent) {
+        Frame frame = frames[0];
+        frame.enableDepthTesting = false;
+        count = compactInstances(frame, instancedMesh, instances, instanceIds, lane, width, depthPyramid);
+    }
+
+    if (lane == 0) {
+        instanceCounts[y] = count;
+    }
+}
+
+// Compacts the visible instances of every instanced mesh (phase two).
+// Dispatched with one simdgroup sized threadgroup per instanced mesh.
+// - Parameters:
+//   - y: The index of the instanced mesh.
+//   - lane: The thread index in the simdgroup.
+//   - width: The number of threads in the simdgroup.
+//   - frames: The frames buffer.
+//   - instances: The instances pointer.
+//   - instancedMeshes: The instanced meshes pointer.
+//   - instanceIds: The instance ids buffer to compact into.
+//   - instanceCounts: The number of visible instances of each instanced mesh.
+//   - depthPyramid: The depth pyramid built from the phase one occluders.
+[[kernel]]
+void compactVisibleInstances(uint y [[threadgroup_position_in_grid]],
+                             uint lane [[thread_index_in_simdgroup]],
+                             uint width [[threads_per_simdgroup]],
+                             constant Frame *frames [[buffer(KernelBufferIndexFrames)]],
+                             constant Instance *instances [[buffer(KernelBufferIndexInstances)]],
+                             constant InstancedMesh *instancedMeshes [[buffer(KernelBufferIndexInstancedMeshes)]],
+                             device uint32_t *instanceIds [[buffer(KernelBufferIndexInstanceIds)]],
+                             device uint32_t *instanceCounts [[buffer(KernelBufferIndexInstanceCounts)]],
+                             texture2d<float, access::read> depthPyramid [[texture(0)]]) {
+
+    const uint count = compactInstances(frames[0], instancedMeshes[y], instances, instanceIds, lane, width, depthPyramid);
+    if (lane == 0) {
+        instanceCounts[y] = count;
     }
-    
-    return false;
 }
 
 // Encodes and draws the indexed primitives using the specified render command.
@@ -202,11 +282,12 @@ static bool isInstancedMeshVisible(const Frame frame,
 //   - indexBuffer: The pointer to the index buffer.
 //   - frames: The frames buffer.
 //   - instances: The instances pointer.
+//   - instanceIds: The compacted instance ids pointer.
 //   - materials: The materials pointer.
 //   - colors: The colors pointer.
 //   - indexCount: The count of indexed vertices to draw.
 //   - instanceCount: The count of instances to draw
-//   - baseInstance: The starting index of the instances pointer.
+//   - baseInstance: The starting index of the instance ids pointer.
 __attribute__((always_inline))
 static void encodeAndDraw(thread render_command &cmd,
                           constant float *positions,
@@ -215,6 +296,7 @@ static void encodeAndDraw(thread render_command &cmd,
                           constant Frame *frames,
                           constant Light *lights,
                           constant Instance *instances,
+                          device uint32_t *instanceIds,
                           constant Material *materials,
                           constant float4 *colors,
                           uint indexCount,
@@ -226,6 +308,7 @@ static void encodeAndDraw(thread render_command &cmd,
     cmd.set_vertex_buffer(positions, VertexBufferIndexPositions);
     cmd.set_vertex_buffer(normals, VertexBufferIndexNormals);
     cmd.set_vertex_buffer(instances, VertexBufferIndexInstances);
+    cmd.set_vertex_buffer(instanceIds, VertexBufferIndexInstanceIds);
     cmd.set_vertex_buffer(materials, VertexBufferIndexMaterials);
     cmd.set_vertex_buffer(colors, VertexBufferIndexColors);
     cmd.set_vertex_buffer(materials, VertexBufferIndexMaterials);
@@ -242,7 +325,142 @@ static void encodeAndDraw(thread render_command &cmd,
                                 baseInstance);
 }
 
-// Encodes the buffers and adds draw commands via indirect command buffer.
+// Encodes the draw command of the submesh at the x lane of the instanced mesh.
+// - Parameters:
+//   - commandBuffer: The indirect command buffer to encode into.
+//   - index: The index of the render command.
+//   - x: The submesh lane.
+//   - instancedMesh: The instanced mesh to draw.
+//   - instanceCount: The number of compacted instances to draw.
+//   - positions: The pointer to the positions.
+//   - normals: The pointer to the normals.
+//   - indexBuffer: The pointer to the index buffer.
+//   - frames: The frames buffer.
+//   - lights: The lights buffer.
+//   - instances: The instances pointer.
+//   - instanceIds: The compacted instance ids pointer.
+//   - meshes: The meshes pointer.
+//   - submeshes: The submeshes pointer.
+//   - materials: The materials pointer.
+//   - colors: The colors pointer.
+__attribute__((always_inline))
+static void encodeSubmesh(command_buffer commandBuffer,
+                          const uint index,
+                          const uint x,
+                          const InstancedMesh instancedMesh,
+                          const uint instanceCount,
+                          constant float *positions,
+                          constant float *normals,
+                          constant uint32_t *indexBuffer,
+                          constant Frame *frames,
+                          constant Light *lights,
+                          constant Instance *instances,
+                          device uint32_t *instanceIds,
+                          constant Mesh *meshes,
+                          constant Submesh *submeshes,
+                          constant Material *materials,
+                          constant float4 *colors) {
+
+    const uint baseInstance = instancedMesh.baseInstance;
+    const Mesh mesh = meshes[instancedMesh.mesh];
+
+    const BoundedRange submeshRange = mesh.submeshes;
+    const uint lowerBound = (uint) submeshRange.lowerBound;
+    const uint upperBound = (uint) submeshRange.upperBound;
+
+    const uint i = x + lowerBound;
+    if (i >= upperBound) { return; }
+
+    // Get indirect render commnd from the indirect command buffer
+    render_command cmd(commandBuffer, index);
+
+    const Submesh submesh = submeshes[i];
+    const BoundedRange indexRange = submesh.indices;
+    const uint materialIndex = (uint) submesh.material;
+    const uint indexCount = (uint)indexRange.upperBound - (uint)indexRange.lowerBound;
+    const uint indexBufferOffset = indexRange.lowerBound;
+
+    // Execute the draw call
+    encodeAndDraw(cmd,
+                  positions,
+                  normals,
+                  &indexBuffer[indexBufferOffset],
+                  frames,
+                  lights,
+                  instances,
+                  instanceIds,
+                  &materials[materialIndex],
+                  colors,
+                  indexCount,
+                  instanceCount,
+                  baseInstance);
+}
+
+// Encodes the depth only draw commands of the occluder instances compacted by `compactOccluderInstances` (phase one).
+// These commands are drawn into the depth texture before the depth pyramid is built, so everything else
+// can be tested against the current frame's depth instead of the previous frame's depth.
+// - Parameters:
+//   - threadPosition: The thread position in the grid being executed.
+//   - positions: The pointer to the positions.
+//   - normals: The pointer to the normals.
+//   - indexBuffer: The pointer to the index buffer.
+//   - frames: The frames buffer.
+//   - lights: The lights buffer.
+//   - instances: The instances pointer.
+//   - instancedMeshes: The instanced meshes pointer.
+//   - meshes: The meshes pointer.
+//   - submeshes: The submeshes pointer.
+//   - materials: The materials pointer.
+//   - colors: The colors pointer.
+//   - icbContainer: The pointer to the indirect command buffer container.
+//   - instanceIds: The compacted instance ids.
+//   - instanceCounts: The number of compacted instances of each instanced mesh.
+[[kernel]]
+void encodeOccluderRenderCommands(uint2 threadPosition [[thread_position_in_grid]],
+                                  uint2 gridSize [[threads_per_grid]],
+                                  constant float *positions [[buffer(KernelBufferIndexPositions)]],
+                                  constant float *normals [[buffer(KernelBufferIndexNormals)]],
+                                  constant uint32_t *indexBuffer [[buffer(KernelBufferIndexIndexBuffer)]],
+                                  constant Frame *frames [[buffer(KernelBufferIndexFrames)]],
+                                  constant Light *lights [[buffer(KernelBufferIndexLights)]],
+                                  constant Instance *instances [[buffer(KernelBufferIndexInstances)]],
+                                  constant InstancedMesh *instancedMeshes [[buffer(KernelBufferIndexInstancedMeshes)]],
+                                  constant Mesh *meshes [[buffer(KernelBufferIndexMeshes)]],
+                                  constant Submesh *submeshes [[buffer(KernelBufferIndexSubmeshes)]],
+                                  constant Material *materials [[buffer(KernelBufferIndexMaterials)]],
+                                  constant float4 *colors [[buffer(KernelBufferIndexColors)]],
+                                  device ICBContainer *icbContainer [[buffer(KernelBufferIndexCommandBufferContainer)]],
+                                  device uint32_t *instanceIds [[buffer(KernelBufferIndexInstanceIds)]],
+                                  constant uint32_t *instanceCounts [[buffer(KernelBufferIndexInstanceCounts)]]) {
+
+    const uint x = threadPosition.x;
+    const uint y = threadPosition.y;
+    const uint index = y + (x * gridSize.y);
+
+    const uint instanceCount = instanceCounts[y];
+    if (instanceCount == 0) { return; }
+
+    encodeSubmesh(icbContainer->commandBufferDepthOnly,
+                  index,
+                  x,
+                  instancedMeshes[y],
+                  instanceCount,
+                  positions,
+                  normals,
+                  indexBuffer,
+                  frames,
+                  lights,
+                  instances,
+                  instanceIds,
+                  meshes,
+                  submeshes,
+                  materials,
+                  colors);
+}
+
+// Encodes the buffers and adds draw commands via indirect command buffer (phase two).
+// Only the instances compacted by `compactVisibleInstances` are drawn, and the instanced meshes with any visible
+// instances are kept as the visibility that selects the occluders of the next frame.
 // - Parameters:
 //   - threadPosition: The thread position in the grid being executed.
 //   - positions: The pointer to the positions.
@@ -258,8 +476,9 @@ static void encodeAndDraw(thread render_command &cmd,
 //   - colors: The colors pointer.
 //   - icbContainer: The pointer to the indirect command buffer container.
 //   - executedCommands: The excuted commands buffer that keeps track of culling results.
-//   - textureSampler: The texture sampler.
-//   - depthTexture: The depth texture.
+//   - visibility: The visibility of each instanced mesh which is carried over to the next frame.
+//   - instanceIds: The compacted instance ids.
+//   - instanceCounts: The number of compacted instances of each instanced mesh.
 [[kernel]]
 void encodeIndirectRenderCommands(uint2 threadPosition [[thread_position_in_grid]],
                                   uint2 gridSize [[threads_per_grid]],
@@ -276,8 +495,9 @@ void encodeIndirectRenderCommands(uint2 threadPosition [[thread_position_in_grid
                                   constant float4 *colors [[buffer(KernelBufferIndexColors)]],
                                   device ICBContainer *icbContainer [[buffer(KernelBufferIndexCommandBufferContainer)]],
                                   device uint8_t *executedCommands [[buffer(KernelBufferIndexExecutedCommands)]],
-                                  sampler textureSampler [[sampler(0)]],
-                                  depth2d<float> depthTexture [[texture(0)]]) {
+                                  device uint8_t *visibility [[buffer(KernelBufferIndexVisibility)]],
+                                  device uint32_t *instanceIds [[buffer(KernelBufferIndexInstanceIds)]],
+                                  constant uint32_t *instanceCounts [[buffer(KernelBufferIndexInstanceCounts)]]) {
     
     // The x lane provides the max number of submeshes that the mesh can contain
     const uint x = threadPosition.x;
@@ -289,19 +509,16 @@ void encodeIndirectRenderCommands(uint2 threadPosition [[thread_position_in_grid
     // Calculate the index of this position in the grid. This is used to
     // get the the render command at this unique index as only one draw call can be issued per thread.
     const uint index = y + (x * height);
-    
-    const InstancedMesh instancedMesh = instancedMeshes[y];
-    const Frame frame = frames[0];
-
-    // Perform depth testing to check if the instanced mesh should be occluded or not
-    bool visible = isInstancedMeshVisible(frame,
-                             instancedMesh,
-                             instances,
-                             meshes,
-                             submeshes,
-                             textureSampler,
-                             depthTexture);
-    
+
+    // The instanced mesh is visible if any of it's instances survived culling
+    const uint instanceCount = instanceCounts[y];
+    const bool visible = instanceCount > 0;
+
+    // Carry the visibility over to the next frame (only the first lane writes it)
+    if (x == 0) {
+        visibility[y] = visible ? 1 : 0;
+    }
+
     // If this instanced mesh isn't visible don't issue any draw commands and simply exit
     if (!visible) {
         // Mark the command as not being executed
@@ -311,41 +528,21 @@ void encodeIndirectRenderCommands(uint2 threadPosition [[thread_position_in_grid
 
     // Mark the command as being executed
     executedCommands[index] = 1;
-    
-    const uint instanceCount = instancedMesh.instanceCount;
-    const uint baseInstance = instancedMesh.baseInstance;
-    const Mesh mesh = meshes[instancedMesh.mesh];
 
-    const BoundedRange submeshRange = mesh.submeshes;
-    const uint lowerBound = (uint) submeshRange.lowerBound;
-    const uint upperBound = (uint) submeshRange.upperBound;
-
-    const uint i = x + lowerBound;
-
-    if (i < upperBound) {
-
-        // Get indirect render commnd from the indirect command buffer
-        render_command cmd(icbContainer->commandBuffer, index);
-        
-        const Submesh submesh = submeshes[i];
-        const BoundedRange indexRange = submesh.indices;
-        const uint materialIndex = (uint) submesh.material;
-        const uint indexCount = (uint)indexRange.upperBound - (uint)indexRange.lowerBound;
-        const uint indexBufferOffset = indexRange.lowerBound;
-
-        // Execute the draw call
-        encodeAndDraw(cmd,
-                      positions,
-                      normals,
-                      &indexBuffer[indexBufferOffset],
-                      frames,
-                      lights,
-                      instances,
-                      &materials[materialIndex],
-                      colors,
-                      indexCount,
-                      instanceCount,
-                      baseInstance);
-
-    }
+    encodeSubmesh(icbContainer->commandBuffer,
+                  index,
+                  x,
+                  instancedMeshes[y],
+                  instanceCount,
+                  positions,
+                  normals,
+                  indexBuffer,
+                  frames,
+                  lights,
+                  instances,
+                  instanceIds,
+                  meshes,
+                  submeshes,
+                  materials,
+                  colors);
 }
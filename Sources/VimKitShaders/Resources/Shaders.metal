@@ -11,28 +11,23 @@
 
 using namespace metal;
 
-// The main vertex shader function.
+// Transforms the vertex of the instance.
 // - Parameters:
 //   - in: The vertex position + normal data.
 //   - amp_id: The index into the uniforms array used for stereoscopic views in visionOS.
-//   - vertex_id: The per-vertex identifier.
-//   - instance_id: The baseInstance parameter passed to the draw call used to map this instance to it's transform data.
+//   - instance: The instance being drawn.
 //   - frames: The frames buffer.
-//   - instances: The instances pointer.
 //   - materials: The materials pointer.
 //   - colors: The colors pointer used to apply custom color profiles to instances.
-[[vertex]]
-VertexOut vertexMain(VertexIn in [[stage_in]],
-                     ushort amp_id [[amplification_id]],
-                     uint vertex_id [[vertex_id]],
-                     uint instance_id [[instance_id]],
-                     constant Frame *frames [[buffer(VertexBufferIndexFrames)]],
-                     constant Instance *instances [[buffer(VertexBufferIndexInstances)]],
-                     constant Material *materials [[buffer(VertexBufferIndexMaterials)]],
-                     constant float4 *colors [[buffer(VertexBufferIndexColors)]]) {
+__attribute__((always_inline))
+static VertexOut transformVertex(VertexIn in,
+                                 ushort amp_id,
+                                 const Instance instance,
+                                 constant Frame *frames,
+                                 constant Material *materials,
+                                 constant float4 *colors) {
 
     VertexOut out;
-    const Instance instance = instances[instance_id];
     const Material material = materials[0];
     const Frame frame = frames[0];
     const Camera camera = frame.cameras[amp_id];
@@ -41,7 +36,7 @@ VertexOut vertexMain(VertexIn in [[stage_in]],
     int colorIndex = instance.colorIndex;
     
     // Matrices
-    float4x4 modelMatrix = instance.matrix;
+    float4x4 modelMatrix = instanceMatrix(instance);
     float4x4 viewMatrix = camera.viewMatrix;
     float4x4 projectionMatrix = camera.projectionMatrix;
     float4x4 modelViewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
@@ -92,18 +87,15 @@ VertexOut vertexMain(VertexIn in [[stage_in]],
 
     }
     
-    // Clip Planes
+    // Clip Planes (packed after the 6 frustum planes, pre-normalized and facing inward)
     for (int i = 0; i < 6; i++) {
-        const float4 plane = camera.clipPlanes[i];
-        const float3 planeNormal = normalize(plane.xyz);
-
-        // Validate clip plane by making sure the w isn't infinite
-        if (isinf(plane.w)) {
+        // Skip the clip plane if it isn't active
+        if ((camera.culling.planeMask & (1u << (i + 6))) == 0) {
             out.clipDistance[i] = 0.0f;
             continue;
         }
         // Calculate the distance to the clip plane
-        const float clipDistance = -dot(planeNormal, worldPosition.xyz) + plane.w;
+        const float clipDistance = dot(camera.culling.planes[i + 6], float4(worldPosition.xyz, 1.0));
         out.clipDistance[i] = clipDistance;
     }
     
@@ -118,6 +110,52 @@ VertexOut vertexMain(VertexIn in [[stage_in]],
     return out;
 }
 
+// The main vertex shader function.
+// - Parameters:
+//   - in: The vertex position + normal data.
+//   - amp_id: The index into the uniforms array used for stereoscopic views in visionOS.
+//   - vertex_id: The per-vertex identifier.
+//   - instance_id: The baseInstance parameter passed to the draw call used to map this instance to it's transform data.
+//   - frames: The frames buffer.
+//   - instances: The instances pointer.
+//   - materials: The materials pointer.
+//   - colors: The colors pointer used to apply custom color profiles to instances.
+[[vertex]]
+VertexOut vertexMain(VertexIn in [[stage_in]],
+                     ushort amp_id [[amplification_id]],
+                     uint vertex_id [[vertex_id]],
+                     uint instance_id [[instance_id]],
+                     constant Frame *frames [[buffer(VertexBufferIndexFrames)]],
+                     constant Instance *instances [[buffer(VertexBufferIndexInstances)]],
+                     constant Material *materials [[buffer(VertexBufferIndexMaterials)]],
+                     constant float4 *colors [[buffer(VertexBufferIndexColors)]]) {
+    return transformVertex(in, amp_id, instances[instance_id], frames, materials, colors);
+}
+
+// The vertex shader function used by indirect command buffers that only draw the instances that survived culling.
+// - Parameters:
+//   - in: The vertex position + normal data.
+//   - amp_id: The index into the uniforms array used for stereoscopic views in visionOS.
+//   - vertex_id: The per-vertex identifier.
+//   - instance_id: The baseInstance parameter passed to the draw call used to map this instance to it's compacted instance id.
+//   - frames: The frames buffer.
+//   - instances: The instances pointer.
+//   - instanceIds: The compacted instance ids.
+//   - materials: The materials pointer.
+//   - colors: The colors pointer used to apply custom color profiles to instances.
+[[vertex]]
+VertexOut vertexIndirect(VertexIn in [[stage_in]],
+                         ushort amp_id [[amplification_id]],
+                         uint vertex_id [[vertex_id]],
+                         uint instance_id [[instance_id]],
+                         constant Frame *frames [[buffer(VertexBufferIndexFrames)]],
+                         constant Instance *instances [[buffer(VertexBufferIndexInstances)]],
+                         const device uint32_t *instanceIds [[buffer(VertexBufferIndexInstanceIds)]],
+                         constant Material *materials [[buffer(VertexBufferIndexMaterials)]],
+                         constant float4 *colors [[buffer(VertexBufferIndexColors)]]) {
+    return transformVertex(in, amp_id, instances[instanceIds[instance_id]], frames, materials, colors);
+}
+
 // The main fragment shader function.
 // - Parameters:
 //   - in: the data passed from the vertex function.
@@ -32,7 +32,7 @@ VertexOut vertexVisibilityTest(VertexIn in [[stage_in]],
     const Material material = materials[0];
     const Camera camera = frames[0].cameras[amp_id];
     
-    float4x4 modelMatrix = instance.matrix;
+    float4x4 modelMatrix = instanceMatrix(instance);
     float4x4 viewMatrix = camera.viewMatrix;
     float4x4 projectionMatrix = camera.projectionMatrix;
     float4x4 modelViewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
@@ -10,6 +10,7 @@
 
 #ifdef __METAL_VERSION__
 #define NS_ENUM(_type, _name) enum _name : _type _name; enum _name : _type
+#define NS_REFINED_FOR_SWIFT
 typedef metal::int32_t EnumBackingType;
 #else
 #import <Foundation/Foundation.h>
@@ -17,15 +18,27 @@ typedef NSInteger EnumBackingType;
 #endif
 #import <simd/simd.h>
 
+// A tightly packed 3 component float vector (12 bytes with 4 byte alignment).
+#ifdef __METAL_VERSION__
+#include <metal_stdlib>
+typedef metal::packed_float3 PackedFloat3;
+#else
+typedef struct {
+    float x;
+    float y;
+    float z;
+} PackedFloat3;
+#endif
+
 //***********************************************************************
 // SWIFT/METAL STRUCTURES THAT ARE SHARED BETWEEN METAL SHADERS AND SWIFT
 //***********************************************************************
 
 typedef struct {
     // The lower bounds of the range
-    size_t lowerBound;
+    uint32_t lowerBound NS_REFINED_FOR_SWIFT;
     // The upper bounds of the range
-    size_t upperBound;
+    uint32_t upperBound NS_REFINED_FOR_SWIFT;
 } BoundedRange;
 
 typedef struct {
@@ -39,7 +52,7 @@ typedef struct {
 
 typedef struct {
     // The material index (-1 indicates no material)
-    size_t material;
+    int32_t material NS_REFINED_FOR_SWIFT;
     // The range of values in the index buffer to define the geometry of its triangular faces in local space.
     BoundedRange indices;
 } Submesh;
@@ -49,14 +62,28 @@ typedef struct {
     BoundedRange submeshes;
 } Mesh;
 
+// A struct that holds the camera culling data which is packed once per frame so
+// culling an instance only takes a single dot product per active plane.
+typedef struct {
+    // The combined projection view matrix.
+    simd_float4x4 projectionViewMatrix;
+    // The 6 frustum planes followed by the 6 clip planes. Every plane faces inward (a point is inside when
+    // dot(plane, point) >= 0) so the clip planes are stored with their normals normalized and flipped.
+    simd_float4 planes[12];
+    // The bitmask of the planes to test (invalid clip planes are left out).
+    uint32_t planeMask;
+    // The x, y, z bitmasks of the planes whose normal component is positive, used to select
+    // the bounds corner farthest along each plane normal (the max bounds if set, otherwise the min bounds).
+    simd_uint3 vertexSelection;
+} Culling;
+
 // A struct that holds per frame camera data
 typedef struct {
     simd_float3 position;
     simd_float4x4 viewMatrix;
     simd_float4x4 projectionMatrix;
     simd_float4x4 sceneTransform;
-    simd_float4 frustumPlanes[6];
-    simd_float4 clipPlanes[6];
+    Culling culling;
 } Camera;
 
 // Enum constants for lighting types
@@ -109,26 +136,26 @@ typedef NS_ENUM(EnumBackingType, InstanceState) {
     InstanceStateIsolated = 3
 };
 
-// Instance
+// Instance (96 bytes)
 typedef struct {
-    // The index of the instance.
-    size_t index;
-    // The index of the color override to use from the colors buffer (-1 indicates no override)
-    size_t colorIndex;
-    // The 4x4 row-major matrix representing the node's world-space transform.
-    simd_float4x4 matrix;
-    // The state of the instance
-    InstanceState state;
+    // The first 3 rows of the node's affine world-space transform (the last row is always [0, 0, 0, 1]).
+    simd_float3x4 matrix NS_REFINED_FOR_SWIFT;
     // The instance min bounds (in world space)
-    simd_float3 minBounds;
+    PackedFloat3 minBounds NS_REFINED_FOR_SWIFT;
     // The instance max bounds (in world space)
-    simd_float3 maxBounds;
+    PackedFloat3 maxBounds NS_REFINED_FOR_SWIFT;
+    // The index of the instance.
+    uint32_t index NS_REFINED_FOR_SWIFT;
     // The parent index of the instance (-1 indicates no parent).
-    size_t parent;
+    int32_t parent NS_REFINED_FOR_SWIFT;
     // The mesh index (-1 indicates no mesh)
-    size_t mesh;
+    int32_t mesh NS_REFINED_FOR_SWIFT;
+    // The index of the color override to use from the colors buffer (-1 indicates no override)
+    int16_t colorIndex NS_REFINED_FOR_SWIFT;
     // The first bit of each flag designates whether the instance should be initially hidden (1) or not (0) when rendered.
     int16_t flags;
+    // The state of the instance (see InstanceState)
+    uint8_t state NS_REFINED_FOR_SWIFT;
     // Flag indicating if this instance is transparent or not.
     bool transparent;
 } Instance;
@@ -155,6 +182,7 @@ typedef NS_ENUM(EnumBackingType, VertexBufferIndex) {
     VertexBufferIndexSubmeshes = 5,
     VertexBufferIndexMaterials = 6,
     VertexBufferIndexColors = 7,
+    VertexBufferIndexInstanceIds = 8,
 };
 
 // Enum constants for the association of a specific buffer index argument passed into the shader fragment function
@@ -183,7 +211,10 @@ typedef NS_ENUM(EnumBackingType, KernelBufferIndex) {
     KernelBufferIndexMaterials = 9,
     KernelBufferIndexColors = 10,
     KernelBufferIndexCommandBufferContainer = 11,
-    KernelBufferIndexExecutedCommands = 12
+    KernelBufferIndexExecutedCommands = 12,
+    KernelBufferIndexVisibility = 13,
+    KernelBufferIndexInstanceIds = 14,
+    KernelBufferIndexInstanceCounts = 15
 };
 
 // Enum constants for argument buffer indices
@@ -297,6 +328,12 @@ float4 phongLighting(float3 position,
                      constant Light *lights
 );
 
+// Expands the affine world-space transform of the instance into a 4x4 matrix.
+static inline float4x4 instanceMatrix(const Instance instance) {
+    const float3x4 rows = instance.matrix;
+    return transpose(float4x4(rows[0], rows[1], rows[2], float4(0, 0, 0, 1)));
+}
+
 #endif
 
 #endif /* ShaderTypes_h */
@@ -0,0 +1,162 @@
+//
+//  BFastTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import Testing
+@testable import VimKit
+
+@Suite("BFast Tests",
+       .tags(.reader))
+class BFastTests {
+
+    private let directory: URL = FileManager.default.temporaryDirectory.appending(path: UUID().uuidString)
+
+    init() throws {
+        try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+    }
+
+    deinit {
+        try? FileManager.default.removeItem(at: directory)
+    }
+
+    /// Builds a BFast container with 64 byte aligned buffers.
+    /// - Parameter buffers: the named buffers
+    /// - Returns: the container bytes
+    private func container(_ buffers: [(String, [UInt8])]) -> [UInt8] {
+        let names = Array(buffers.map { $0.0 }.joined(separator: "\0").utf8) + [0]
+        let contents = [names] + buffers.map { $0.1 }
+        let aligned: (Int) -> Int = { ($0 + 63) / 64 * 64 }
+
+        let dataStart = aligned(32 + 16 * contents.count)
+        var ranges = [(UInt64, UInt64)]()
+        var offset = dataStart
+        for content in contents {
+            ranges.append((UInt64(offset), UInt64(offset + content.count)))
+            offset = aligned(offset + content.count)
+        }
+        let dataEnd = Int(ranges.last!.1)
+
+        var words: [UInt64] = [0xBFA5, UInt64(dataStart), UInt64(dataEnd), UInt64(contents.count)]
+        for range in ranges {
+            words.append(range.0)
+            words.append(range.1)
+        }
+        var bytes = [UInt8](repeating: 0, count: dataEnd)
+        words.withUnsafeBytes { pointer in
+            bytes.replaceSubrange(0..<pointer.count, with: pointer)
+        }
+        for (content, range) in zip(contents, ranges) {
+            bytes.replaceSubrange(Int(range.0)..<Int(range.1), with: content)
+        }
+        return bytes
+    }
+
+    /// Writes the bytes to a temporary file and opens it as a BFast container.
+    private func open(_ bytes: [UInt8]) throws -> BFast {
+        let url = directory.appending(path: UUID().uuidString)
+        try Data(bytes).write(to: url)
+        return try BFast(url)
+    }
+
+    /// Overwrites the little endian 64 bit word at the specified word index.
+    private func patch(_ bytes: inout [UInt8], word: Int, value: UInt64) {
+        withUnsafeBytes(of: value.littleEndian) { pointer in
+            bytes.replaceSubrange(word * 8..<(word + 1) * 8, with: pointer)
+        }
+    }
+
+    @Test("Verify valid container")
+    func verifyValid() throws {
+        let bfast = try open(container([("header", Array("vim=1.0".utf8)), ("strings", [1, 2, 3])]))
+        #expect(bfast.names == ["header", "strings"])
+        #expect(bfast.buffer("strings")?.data == Data([1, 2, 3]))
+        #expect(bfast.bufferByteSize(name: "header") == 7)
+        #expect(bfast.buffer("geometry") == nil)
+    }
+
+    @Test("Verify invalid containers")
+    func verifyInvalid() throws {
+        let valid = container([("a", [1]), ("b", [2])])
+
+        #expect(throws: BFast.ValidationError.truncated(16)) {
+            try self.open(Array(valid[0..<16]))
+        }
+
+        var bytes = valid
+        patch(&bytes, word: 0, value: 0xBEEF)
+        #expect(throws: BFast.ValidationError.invalidMagic(0xBEEF)) {
+            try self.open(bytes)
+        }
+
+        bytes = valid
+        patch(&bytes, word: 3, value: .max)
+        #expect(throws: BFast.ValidationError.invalidNumberOfBuffers(.max)) {
+            try self.open(bytes)
+        }
+
+        // Push the end of the last range past the end of the data section
+        bytes = valid
+        patch(&bytes, word: 9, value: UInt64(valid.count + 1))
+        #expect(throws: BFast.ValidationError.rangeOutOfBounds(2)) {
+            try self.open(bytes)
+        }
+
+        // Move the start of the names range off of the 64 byte boundary
+        bytes = valid
+        let begin = bytes.withUnsafeBytes { $0.loadUnaligned(fromByteOffset: 4 * 8, as: UInt64.self) }
+        patch(&bytes, word: 4, value: begin + 1)
+        #expect(throws: BFast.ValidationError.misalignedRange(0)) {
+            try self.open(bytes)
+        }
+
+        // Move the start of the last range on top of the previous range
+        bytes = valid
+        let previous = bytes.withUnsafeBytes { $0.loadUnaligned(fromByteOffset: 6 * 8, as: UInt64.self) }
+        patch(&bytes, word: 8, value: previous)
+        #expect(throws: BFast.ValidationError.overlappingRange(2)) {
+            try self.open(bytes)
+        }
+
+        // Erase the second name from the names buffer
+        bytes = valid
+        let namesStart = Int(bytes.withUnsafeBytes { $0.loadUnaligned(fromByteOffset: 4 * 8, as: UInt64.self) })
+        bytes.replaceSubrange(namesStart..<namesStart + 4, with: Array("a\0\0\0".utf8))
+        #expect(throws: BFast.ValidationError.invalidNames(1, 2)) {
+            try self.open(bytes)
+        }
+    }
+
+    @Test("Verify container identity")
+    func verifyIdentity() throws {
+        // Two different files with the same name in different directories
+        let first = directory.appending(path: "a").appending(path: "model.vim")
+        let second = directory.appending(path: "b").appending(path: "model.vim")
+        for url in [first, second] {
+            try FileManager.default.createDirectory(at: url.deletingLastPathComponent(), withIntermediateDirectories: true)
+        }
+        try Data(container([("a", [1])])).write(to: first)
+        try Data(container([("a", [1]), ("b", [2])])).write(to: second)
+
+        let a = try BFast(first)
+        let b = try BFast(second)
+        #expect(a.sha256Hash != b.sha256Hash)
+        #expect(a.fileHash != b.fileHash)
+
+        // Editing the file in place changes the container identity but keeps the cache group
+        try Data(container([("a", [1, 2, 3, 4])])).write(to: first)
+        let edited = try BFast(first)
+        #expect(edited.sha256Hash != a.sha256Hash)
+        #expect(edited.fileHash == a.fileHash)
+
+        // Nested containers are keyed by the identity of the file they live in
+        let nested = try open(container([("nested", container([("a", [1])]))]))
+        let buffer = try #require(nested.buffer("nested"))
+        let child = try BFast(buffer: buffer)
+        #expect(child.sha256Hash != nested.sha256Hash)
+        #expect(child.fileHash == nested.fileHash)
+    }
+}
@@ -0,0 +1,298 @@
+//
+//  BVHTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import simd
+import Testing
+@testable import VimKit
+
+@Suite("BVH Tests",
+       .tags(.model))
+class BVHTests {
+
+    /// Makes a grid of unit boxes.
+    /// - Parameter size: the number of boxes along each axis
+    /// - Returns: the instance indices and their boxes
+    private func boxes(_ size: Int) -> [(index: Int, box: MDLAxisAlignedBoundingBox)] {
+        var data = [(index: Int, box: MDLAxisAlignedBoundingBox)]()
+        for x in 0..<size {
+            for y in 0..<size {
+                for z in 0..<size {
+                    let minBounds = SIMD3<Float>(Float(x), Float(y), Float(z)) * 2
+                    data.append((index: data.count * 3, box: .init(maxBounds: minBounds + 1, minBounds: minBounds)))
+                }
+            }
+        }
+        return data
+    }
+
+    /// Makes a height field of triangles and it's mesh hierarchy.
+    /// - Parameter size: the number of quads along each axis
+    /// - Returns: the vertex positions, the corner indices and the mesh hierarchy
+    static func heightField(_ size: Int) -> ([Float], [UInt32], Geometry.MeshHierarchy) {
+        var positions = [Float]()
+        for x in 0...size {
+            for z in 0...size {
+                positions.append(contentsOf: [Float(x), sin(Float(x) * 0.3) + cos(Float(z) * 0.2), Float(z)])
+            }
+        }
+        var indices = [UInt32]()
+        for x in 0..<size {
+            for z in 0..<size {
+                let i = UInt32(x * (size + 1) + z)
+                let j = i + UInt32(size + 1)
+                indices.append(contentsOf: [i, j, i + 1, i + 1, j, j + 1])
+            }
+        }
+        let submeshes = [Submesh(.empty, 0..<indices.count)]
+        let mesh = Mesh(0..<1)
+
+        let hierarchy = positions.withUnsafeBufferPointer { positions in
+            indices.withUnsafeBufferPointer { indices in
+                submeshes.withUnsafeBufferPointer { submeshes in
+                    Geometry.MeshHierarchy(mesh: mesh, positions: positions, indices: indices, submeshes: submeshes)
+                }
+            }
+        }
+        return (positions, indices, hierarchy)
+    }
+
+    @Test("Verify hierarchy structure")
+    func verifyStructure() async throws {
+        let leafSize = 4
+        let data = boxes(20)
+        let bvh = await Geometry.BVH(data, leafSize: leafSize)
+
+        #expect(MemoryLayout<Geometry.BVH.Node>.stride == 32)
+
+        var leafInstances = [Int]()
+        for (i, node) in bvh.nodes.enumerated() {
+            if node.isLeaf {
+                #expect(node.count <= leafSize)
+                leafInstances.append(contentsOf: bvh.instances[node.range].map { Int($0) })
+            } else {
+                // The first child directly follows it's parent
+                let children = [bvh.nodes[i + 1], bvh.nodes[Int(node.offset)]]
+                #expect(Int(node.offset) > i + 1)
+                for child in children {
+                    #expect(simd_all(node.box.minBounds .<= child.box.minBounds))
+                    #expect(simd_all(node.box.maxBounds .>= child.box.maxBounds))
+                }
+            }
+        }
+
+        // Every instance must be contained in exactly one leaf
+        #expect(leafInstances.sorted() == data.map { $0.index })
+
+        // Traversing the whole tree must visit every instance once
+        var visited = [Int]()
+        bvh.traverse { _ in true } visit: { visited.append($0) }
+        #expect(visited.sorted() == data.map { $0.index })
+        #expect(bvh.bounds.minBounds == .zero)
+        #expect(bvh.bounds.maxBounds == SIMD3<Float>(repeating: 39))
+    }
+
+    @Test("Verify degenerate boxes")
+    func verifyDegenerate() async throws {
+        // All of the boxes share the same center
+        let box = MDLAxisAlignedBoundingBox(maxBounds: .one, minBounds: .zero)
+        let data = (0..<100).map { (index: $0, box: box) }
+        let bvh = await Geometry.BVH(data, leafSize: 8)
+
+        var count = 0
+        bvh.traverse { _ in true } visit: { _ in count += 1 }
+        #expect(count == data.count)
+    }
+
+    @Test("Verify restored hierarchy validation")
+    func verifyValidation() async throws {
+        let data = boxes(4)
+        let instanceCount = data.count * 3
+        let bvh = await Geometry.BVH(data, leafSize: 4)
+        let nodes = bvh.nodes
+        let instances = bvh.instances
+        #expect(Geometry.BVH.isValid(nodes: nodes, instances: instances, instanceCount: instanceCount))
+        #expect(Geometry.BVH.isValid(nodes: [], instances: [], instanceCount: instanceCount))
+
+        // An instance index past the end of the instances
+        var corrupt = instances
+        corrupt[0] = UInt32(instanceCount)
+        #expect(!Geometry.BVH.isValid(nodes: nodes, instances: corrupt, instanceCount: instanceCount))
+
+        // A leaf range past the end of the instance indices
+        let leaf = try #require(nodes.firstIndex { $0.isLeaf })
+        var nodesCopy = nodes
+        nodesCopy[leaf].offset = UInt32(instances.count)
+        #expect(!Geometry.BVH.isValid(nodes: nodesCopy, instances: instances, instanceCount: instanceCount))
+
+        // A second child that points back at the root (or past the end of the nodes)
+        nodesCopy = nodes
+        nodesCopy[0].offset = 0
+        #expect(!Geometry.BVH.isValid(nodes: nodesCopy, instances: instances, instanceCount: instanceCount))
+        nodesCopy[0].offset = UInt32(nodes.count)
+        #expect(!Geometry.BVH.isValid(nodes: nodesCopy, instances: instances, instanceCount: instanceCount))
+
+        // Trailing nodes that are never reached
+        #expect(!Geometry.BVH.isValid(nodes: nodes + [nodes[leaf]], instances: instances, instanceCount: instanceCount))
+    }
+
+    @Test("Verify hidden subtrees are pruned")
+    func verifyHidden() async throws {
+        let data = boxes(20)
+        var bvh = await Geometry.BVH(data, leafSize: 4)
+
+        // Isolate 1% of the instances
+        let isolated = Set(data.prefix(80).map { $0.index })
+        for (index, _) in data where !isolated.contains(index) {
+            bvh.setHidden(index, true)
+        }
+
+        var nodeCount = 0
+        var visited = [Int]()
+        bvh.traverse { _ in nodeCount += 1; return true } visit: { visited.append($0) }
+        #expect(Set(visited) == isolated)
+        #expect(nodeCount < bvh.nodes.count / 10)
+
+        // Unhiding restores the whole tree
+        for (index, _) in data where !isolated.contains(index) {
+            bvh.setHidden(index, false)
+        }
+        #expect(bvh.hidden.count == 0)
+        visited.removeAll()
+        bvh.traverse { _ in true } visit: { visited.append($0) }
+        #expect(visited.count == data.count)
+    }
+
+    @Test("Verify refit")
+    func verifyRefit() async throws {
+        var data = boxes(10)
+        var bvh = await Geometry.BVH(data, leafSize: 4)
+
+        // Move the first box outside of the current bounds
+        let offset = SIMD3<Float>(repeating: 100)
+        data[0].box = .init(maxBounds: data[0].box.maxBounds + offset, minBounds: data[0].box.minBounds + offset)
+        let boxes = Dictionary(uniqueKeysWithValues: data.map { ($0.index, $0.box) })
+        bvh.refit { boxes[$0]! }
+
+        #expect(bvh.bounds.maxBounds == data[0].box.maxBounds)
+        for (i, node) in bvh.nodes.enumerated() where !node.isLeaf {
+            for child in [bvh.nodes[i + 1], bvh.nodes[Int(node.offset)]] {
+                #expect(simd_all(node.box.minBounds .<= child.box.minBounds))
+                #expect(simd_all(node.box.maxBounds .>= child.box.maxBounds))
+            }
+        }
+    }
+
+    @Test("Verify mesh hierarchy raycasts")
+    func verifyMeshRaycast() throws {
+        let (positions, indices, hierarchy) = Self.heightField(64)
+        #expect(hierarchy.vertices.count == indices.count)
+
+        // Every hit must match the closest hit found by testing every triangle
+        for k in 0..<32 {
+            let origin = SIMD3<Float>(Float(k * 2), 10, Float(k))
+            let query = Geometry.RaycastQuery(origin: origin, direction: normalize([0.3, -1, 0.2]))
+            var expected: Float?
+            for t in 0..<(indices.count / 3) {
+                let corner = { (i: Int) in
+                    let v = Int(indices[t * 3 + i]) * 3
+                    return SIMD3<Float>(positions[v], positions[v + 1], positions[v + 2])
+                }
+                guard let result = query.hitTest(corner(0), corner(1), corner(2)) else { continue }
+                expected = min(expected ?? .infinity, result.distance)
+            }
+            #expect(hierarchy.raycast(query) == expected)
+        }
+
+        // Nothing is hit pointing away from the surface
+        #expect(hierarchy.raycast(.init(origin: [10, 10, 10], direction: [0, 1, 0])) == nil)
+    }
+
+    @Test("Verify ray packets")
+    func verifyRayPackets() throws {
+        let size = 256
+        let (_, _, hierarchy) = Self.heightField(size)
+
+        // A sampling grid of rays looking down onto the height field
+        var queries = [Geometry.RaycastQuery]()
+        for x in 0..<size {
+            for z in 0..<size {
+                queries.append(.init(origin: [Float(x) + 0.25, 10, Float(z) + 0.75], direction: normalize([0.1, -1, 0.05])))
+            }
+        }
+
+        // The packet results must match the single ray results
+        let expected = queries.map { hierarchy.raycast($0) ?? .infinity }
+        var results = [Float]()
+        results.reserveCapacity(queries.count)
+        for p in stride(from: 0, to: queries.count, by: 4) {
+            var closest = SIMD4<Float>(repeating: .infinity)
+            hierarchy.raycast(Geometry.RayPacket(queries[p..<p + 4]), closest: &closest)
+            results.append(contentsOf: [closest.x, closest.y, closest.z, closest.w])
+        }
+
+        #expect(results.count == expected.count)
+        for (result, expected) in zip(results, expected) {
+            #expect(result == expected || abs(result - expected) <= 1e-4 * max(expected, 1))
+        }
+    }
+
+    @Test("Verify batch raycasts")
+    func verifyBatchRaycasts() async throws {
+        let meshes = [Self.heightField(16).2, Self.heightField(4).2]
+
+        // A 3x3 grid of rotated, scaled and translated instances of both meshes (the center instance is hidden)
+        var instances = [Instance]()
+        for x in 0..<3 {
+            for z in 0..<3 {
+                let i = instances.count
+                var matrix = float4x4(simd_quatf(angle: Float(i) * 0.4, axis: [0, 1, 0]))
+                matrix.columns.0 *= 1 + Float(i % 3) * 0.25
+                matrix.columns.2 *= 1 + Float(i % 2) * 0.5
+                matrix.columns.3 = [Float(x) * 40, Float(i % 2), Float(z) * 40, 1]
+                var instance = Instance(index: i, matrix: matrix, flags: .zero, parent: .empty, mesh: i % 2, transparent: false)
+                let vertices = meshes[i % 2].vertices.map { (matrix * SIMD4<Float>($0, 1)).xyz }
+                instance.minBounds = vertices.reduce(SIMD3<Float>(repeating: .infinity)) { simd_min($0, $1) }
+                instance.maxBounds = vertices.reduce(SIMD3<Float>(repeating: -.infinity)) { simd_max($0, $1) }
+                if i == 4 {
+                    instance.state = .hidden
+                }
+                instances.append(instance)
+            }
+        }
+        let data = instances.enumerated().map { (index: $0.offset, box: MDLAxisAlignedBoundingBox(maxBounds: $0.element.maxBounds, minBounds: $0.element.minBounds)) }
+        let bvh = await Geometry.BVH(data, leafSize: 2)
+
+        // A sampling grid of rays looking down onto the instances (not a multiple of 4) and a ray that misses everything
+        var queries = [Geometry.RaycastQuery]()
+        for x in 0..<45 {
+            for z in 0..<45 {
+                queries.append(.init(origin: [Float(x) * 2.1 - 10, 10, Float(z) * 2.1 - 10], direction: normalize([0.05, -1, 0.03])))
+            }
+        }
+        queries.append(.init(origin: [40, 10, 40], direction: [0, 1, 0]))
+        #expect(queries.count % 4 != 0)
+
+        instances.withUnsafeBufferPointer { instances in
+            for bvh in [bvh, nil] {
+                let results = Geometry.raycast(batch: queries, instances: instances, bvh: bvh) { meshes[$0] }
+                #expect(results.count == queries.count)
+                #expect(results.contains { $0 != nil })
+                #expect(results.last! == nil)
+                for (query, result) in zip(queries, results) {
+                    let expected = Geometry.raycast(query, instances: instances, bvh: bvh) { meshes[$0] }
+                    #expect(result?.slot == expected?.slot)
+                    #expect(result?.slot != 4)
+                    if let result, let expected {
+                        #expect(abs(result.result.distance - expected.result.distance) <= 1e-4 * max(expected.result.distance, 1))
+                    }
+                }
+            }
+        }
+    }
+}
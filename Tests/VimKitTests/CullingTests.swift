@@ -0,0 +1,176 @@
+//
+//  CullingTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import simd
+import Testing
+@testable import VimKit
+import VimKitShaders
+
+@Suite("Culling Tests",
+       .tags(.model))
+class CullingTests {
+
+    /// Makes the per frame data from the camera.
+    private func makeFrame(_ camera: Vim.Camera, minContributionArea: Float) -> Frame {
+        var frame = Frame()
+        frame.cameras.0 = Camera(position: camera.position,
+                                 viewMatrix: camera.viewMatrix,
+                                 projectionMatrix: camera.projectionMatrix,
+                                 sceneTransform: camera.sceneTransform,
+                                 culling: camera.culling)
+        frame.enableContributionTesting = true
+        frame.minContributionArea = minContributionArea
+        return frame
+    }
+
+    /// A port of the original 8 corner frustum + clip plane test and the contribution test in `isInstanceVisible`
+    /// that reads the unpacked planes straight from the camera.
+    private func isVisible(_ frame: Frame, _ camera: Vim.Camera, _ instance: Instance) -> Bool {
+        guard instance.state != .hidden else { return false }
+        let box = MDLAxisAlignedBoundingBox(maxBounds: instance.maxBounds, minBounds: instance.minBounds)
+        let corners = box.corners.map { SIMD4<Float>($0, 1) }
+        let frustumPlanes = camera.frustum.planes
+        let clipPlanes = camera.clipPlanes
+        for i in 0..<6 {
+            if corners.allSatisfy({ dot(frustumPlanes[i], $0) < 0 }) { return false }
+            let clipPlane = clipPlanes[i]
+            let normal = normalize(clipPlane.xyz)
+            if clipPlane.w.isInfinite { continue }
+            if corners.allSatisfy({ -dot(normal, $0.xyz) + clipPlane.w < 0 }) { return false }
+        }
+
+        let matrix = camera.projectionMatrix * camera.viewMatrix
+        let minBounds = matrix * SIMD4<Float>(instance.minBounds, 1)
+        let maxBounds = matrix * SIMD4<Float>(instance.maxBounds, 1)
+        let boxMin = minBounds.xyz / minBounds.w
+        let boxMax = maxBounds.xyz / maxBounds.w
+        let d = boxMax - boxMin
+        let area = abs(2 * (d.x * d.y + d.y * d.z + d.z * d.x))
+        return !(area < frame.minContributionArea)
+    }
+
+    @Test("Verify culling matches the GPU rules")
+    func verifyCulling() throws {
+        let camera = Vim.Camera()
+        camera.look(in: .ypositive, from: [0, -50, 0])
+        camera.clipPlanes[0] = [1, 0, 0, 20]
+
+        var generator = SeededRandomNumberGenerator(seed: 0x5EED)
+        var instances = [Instance]()
+        for i in 0..<1001 {
+            var instance = Instance(index: i, matrix: .identity, flags: .zero, parent: .empty, mesh: 0, transparent: false)
+            let center = SIMD3<Float>(.random(in: -100...100, using: &generator), .random(in: -100...100, using: &generator), .random(in: -100...100, using: &generator))
+            let extents = SIMD3<Float>(.random(in: 0.01...5, using: &generator), .random(in: 0.01...5, using: &generator), .random(in: 0.01...5, using: &generator))
+            instance.minBounds = center - extents
+            instance.maxBounds = center + extents
+            if i % 17 == 0 {
+                instance.state = .hidden
+            }
+            instances.append(instance)
+        }
+
+        let frame = makeFrame(camera, minContributionArea: 0.0001)
+        let culler = Geometry.Culler(frame)
+        var results = [UInt8](repeating: 2, count: instances.count)
+        instances.withUnsafeBufferPointer { instances in
+            results.withUnsafeMutableBufferPointer { results in
+                culler.cull(instances, range: instances.indices, into: results)
+            }
+        }
+
+        let expected = instances.map { isVisible(frame, camera, $0) ? UInt8(1) : UInt8(0) }
+        #expect(results == expected)
+        #expect(expected.contains(0))
+        #expect(expected.contains(1))
+    }
+
+    @Test("Verify hierarchy culling matches linear culling")
+    func verifyHierarchyCulling() async throws {
+        let camera = Vim.Camera()
+        camera.look(in: .ypositive, from: [0, -50, 0])
+        camera.clipPlanes[0] = [1, 0, 0, 20]
+
+        // A grid of boxes around the camera (every 7th is hidden)
+        var instances = [Instance]()
+        for x in -10..<10 {
+            for y in -10..<10 {
+                for z in -5..<5 {
+                    var instance = Instance(index: instances.count, matrix: .identity, flags: .zero, parent: .empty, mesh: 0, transparent: false)
+                    let minBounds = SIMD3<Float>(Float(x), Float(y), Float(z)) * 10
+                    instance.minBounds = minBounds
+                    instance.maxBounds = minBounds + SIMD3<Float>(repeating: Float(abs(x * y * z) % 5 + 1))
+                    if instances.count % 7 == 0 {
+                        instance.state = .hidden
+                    }
+                    instances.append(instance)
+                }
+            }
+        }
+
+        let frame = makeFrame(camera, minContributionArea: 0.0001)
+        let culler = Geometry.Culler(frame)
+        let data = instances.enumerated().map { (index: $0.offset, box: MDLAxisAlignedBoundingBox(maxBounds: $0.element.maxBounds, minBounds: $0.element.minBounds)) }
+        let bvh = await Geometry.BVH(data, leafSize: 4)
+
+        var results = [UInt8](repeating: 0, count: instances.count)
+        var candidates = [Int]()
+        instances.withUnsafeBufferPointer { instances in
+            results.withUnsafeMutableBufferPointer { results in
+                culler.cull(instances, range: instances.indices, into: results)
+            }
+            bvh.traverse { culler.contains($0.box) } visit: { candidates.append($0) }
+            candidates = culler.cull(instances, indices: candidates)
+        }
+
+        let expected = results.indices.filter { results[$0] == 1 }
+        #expect(expected.isNotEmpty)
+        #expect(candidates.sorted() == expected)
+    }
+
+    @Test("Verify packed culling planes")
+    func verifyCullingPlanes() throws {
+        let camera = Vim.Camera()
+        camera.look(in: .ypositive, from: [0, -50, 0])
+        camera.clipPlanes[2] = [0, -3, 4, 10]
+
+        // The 6 frustum planes and the only valid clip plane are active
+        let culling = camera.culling
+        #expect(culling.planeMask == 0b0001_0011_1111)
+        #expect(culling.projectionViewMatrix == camera.projectionMatrix * camera.viewMatrix)
+
+        // The clip plane is normalized and flipped to face inward
+        let planes = culling.activePlanes
+        #expect(planes.count == 7)
+        #expect(simd_distance(planes[6].plane, [0, 0.6, -0.8, 10]) < 0.0001)
+        #expect(planes[6].positive == [1, 1, 0])
+        for (i, plane) in camera.frustum.planes.enumerated() {
+            #expect(planes[i].plane == plane)
+            #expect(planes[i].positive == SIMD3<UInt32>(plane.x >= 0 ? 1 : 0, plane.y >= 0 ? 1 : 0, plane.z >= 0 ? 1 : 0))
+        }
+
+        // Invalidating the clip planes rebuilds the culling data
+        camera.clipPlanes.invalidate()
+        #expect(camera.culling.planeMask == 0b0000_0011_1111)
+    }
+
+    @Test("Verify instance compaction")
+    func verifyCompaction() throws {
+        // 3 instanced meshes with 4, 1 and 5 instances
+        let instancedMeshes = [
+            InstancedMesh(mesh: 0, transparent: false, instanceCount: 4, baseInstance: 0),
+            InstancedMesh(mesh: 1, transparent: false, instanceCount: 1, baseInstance: 4),
+            InstancedMesh(mesh: 2, transparent: false, instanceCount: 5, baseInstance: 5)
+        ]
+        let visible: [UInt8] = [0, 1, 0, 1, 0, 1, 1, 0, 0, 1]
+        let (ids, counts) = Geometry.compact(visible, instancedMeshes: instancedMeshes)
+        #expect(counts == [2, 0, 3])
+        #expect(Array(ids[0..<2]) == [1, 3])
+        #expect(Array(ids[5..<8]) == [5, 6, 9])
+    }
+}
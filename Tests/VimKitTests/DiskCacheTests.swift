@@ -0,0 +1,122 @@
+//
+//  DiskCacheTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import Testing
+@testable import VimKit
+
+@Suite("Disk Cache Tests",
+       .tags(.utility))
+class DiskCacheTests {
+
+    private let directory: URL = FileManager.default.temporaryDirectory.appending(path: UUID().uuidString)
+
+    deinit {
+        try? FileManager.default.removeItem(at: directory)
+    }
+
+    @Test("Verify atomic writes")
+    func verifyWrites() async throws {
+        let cache = Vim.DiskCache(directory: directory)
+        let data = Data(repeating: 1, count: 1024)
+        let url = try cache.write(data, name: "a.normals", group: "a")
+
+        #expect(try Data(contentsOf: url) == data)
+        #expect(cache.contains("a.normals", group: "a"))
+        #expect(cache.url(named: "a.normals") == url)
+        #expect(cache.totalByteCount == 1024)
+
+        // No temporary files should be left behind
+        let files = try FileManager.default.contentsOfDirectory(atPath: cache.url(group: "a").path)
+        #expect(files == ["a.normals"])
+
+        // The manifest should survive a reload
+        cache.synchronize()
+        let reloaded = Vim.DiskCache(directory: directory)
+        #expect(reloaded.url(named: "a.normals") == url)
+    }
+
+    @Test("Verify recorded byte counts")
+    func verifyRecording() async throws {
+        let cache = Vim.DiskCache(directory: directory, saveDelay: .never)
+        try cache.write(Data(repeating: 1, count: 1024), name: "a.normals", group: "a")
+        try cache.write(Data(repeating: 1, count: 512), name: "a.png", group: "a")
+        #expect(cache.totalByteCount == 1536)
+
+        // Rewriting a file replaces it's byte count
+        try cache.write(Data(repeating: 1, count: 256), name: "a.normals", group: "a")
+        #expect(cache.totalByteCount == 768)
+
+        // Files written by someone else are recorded by their own size
+        let url = cache.url(for: "a.sqlite", group: "a")
+        try Data(repeating: 1, count: 128).write(to: url)
+        cache.record("a.sqlite", group: "a")
+        #expect(cache.totalByteCount == 896)
+
+        // Recording doesn't write the manifest until the pending save is performed
+        let manifestURL = directory.appending(path: "manifest.json")
+        #expect(!FileManager.default.fileExists(atPath: manifestURL.path))
+        cache.synchronize()
+        let reloaded = Vim.DiskCache(directory: directory)
+        #expect(reloaded.totalByteCount == 896)
+        #expect(reloaded.url(named: "a.sqlite") == url)
+    }
+
+    @Test("Verify legacy cache migration")
+    func verifyMigration() async throws {
+        let fileManager = FileManager.default
+        try fileManager.createDirectory(at: directory, withIntermediateDirectories: true)
+        let hash = String(repeating: "ab", count: 32)
+        let unrecorded = String(repeating: "cd", count: 32)
+        let data = Data(repeating: 1, count: 1024)
+
+        // Files written by previous versions straight into the cache root
+        try data.write(to: directory.appending(path: hash))
+        try data.write(to: directory.appending(path: "\(hash).normals"))
+        try data.write(to: directory.appending(path: "\(hash).sqlite"))
+        try data.write(to: directory.appending(path: "notes.txt"))
+        // A group the manifest never recorded
+        try fileManager.createDirectory(at: directory.appending(path: unrecorded), withIntermediateDirectories: true)
+        try data.write(to: directory.appending(path: unrecorded).appending(path: "\(unrecorded).png"))
+
+        let cache = Vim.DiskCache(directory: directory)
+
+        // The legacy download is moved into it's own group and the derived artifacts are removed
+        #expect(cache.contains(hash, group: hash))
+        #expect(try Data(contentsOf: cache.url(group: hash).appending(path: hash)) == data)
+        #expect(!fileManager.fileExists(atPath: directory.appending(path: "\(hash).normals").path))
+        #expect(!fileManager.fileExists(atPath: directory.appending(path: "\(hash).sqlite").path))
+
+        // Unrelated files are left alone and unrecorded groups are counted
+        #expect(fileManager.fileExists(atPath: directory.appending(path: "notes.txt").path))
+        #expect(cache.url(named: "\(unrecorded).png") != nil)
+        #expect(cache.totalByteCount == 2048)
+    }
+
+    @Test("Verify least recently used eviction")
+    func verifyEviction() async throws {
+        let cache = Vim.DiskCache(directory: directory)
+        let data = Data(repeating: 1, count: 1024)
+        try cache.write(data, name: "a", group: "a")
+        try cache.write(data, name: "b", group: "b")
+        try cache.write(data, name: "c", group: "c")
+
+        // Pin the oldest group and touch the next oldest
+        cache.pin(group: "a")
+        cache.touch(group: "b")
+
+        cache.byteLimit = 2048
+        #expect(cache.contains("a", group: "a"))
+        #expect(cache.contains("b", group: "b"))
+        #expect(!cache.contains("c", group: "c"))
+
+        cache.unpin(group: "a")
+        cache.byteLimit = 1024
+        #expect(!cache.contains("a", group: "a"))
+        #expect(cache.contains("b", group: "b"))
+    }
+}
@@ -0,0 +1,67 @@
+//
+//  LayoutTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import simd
+import Testing
+@testable import VimKit
+import VimKitShaders
+
+@Suite("Layout Tests",
+       .tags(.model))
+class LayoutTests {
+
+    /// Pins the memory layout of the structs shared between Swift and Metal.
+    /// Any change here must be mirrored by the Metal shaders.
+    @Test("Verify shared struct layouts")
+    func verifyLayouts() throws {
+        #expect(MemoryLayout<BoundedRange>.size == 8)
+        #expect(MemoryLayout<BoundedRange>.stride == 8)
+        #expect(MemoryLayout<Mesh>.stride == 8)
+        #expect(MemoryLayout<Submesh>.stride == 12)
+        #expect(MemoryLayout<PackedFloat3>.size == 12)
+        #expect(MemoryLayout<PackedFloat3>.alignment == 4)
+
+        #expect(MemoryLayout<Instance>.size == 90)
+        #expect(MemoryLayout<Instance>.stride == 96)
+        #expect(MemoryLayout<Instance>.alignment == 16)
+        #expect(MemoryLayout<Instance>.offset(of: \.__matrix) == 0)
+        #expect(MemoryLayout<Instance>.offset(of: \.__minBounds) == 48)
+        #expect(MemoryLayout<Instance>.offset(of: \.__maxBounds) == 60)
+        #expect(MemoryLayout<Instance>.offset(of: \.__index) == 72)
+        #expect(MemoryLayout<Instance>.offset(of: \.__parent) == 76)
+        #expect(MemoryLayout<Instance>.offset(of: \.__mesh) == 80)
+        #expect(MemoryLayout<Instance>.offset(of: \.__colorIndex) == 84)
+        #expect(MemoryLayout<Instance>.offset(of: \.flags) == 86)
+        #expect(MemoryLayout<Instance>.offset(of: \.__state) == 88)
+        #expect(MemoryLayout<Instance>.offset(of: \.transparent) == 89)
+    }
+
+    @Test("Verify instance accessors")
+    func verifyInstanceAccessors() throws {
+        // A rotation about the y axis followed by a translation
+        let matrix = float4x4([0.6, 0, -0.8, 0], [0, 1, 0, 0], [0.8, 0, 0.6, 0], [1, 2, 3, 1])
+        var instance = Instance(index: 42, matrix: matrix, flags: .zero, parent: .empty, mesh: 7, transparent: true)
+        instance.minBounds = [-1, -2, -3]
+        instance.maxBounds = [1, 2, 3]
+        instance.colorIndex = 5
+
+        #expect(instance.index == 42)
+        #expect(instance.parent == .empty)
+        #expect(instance.mesh == 7)
+        #expect(instance.colorIndex == 5)
+        #expect(instance.state == .default)
+        #expect(instance.transparent)
+        #expect(instance.matrix == matrix)
+        #expect(instance.minBounds == [-1, -2, -3])
+        #expect(instance.maxBounds == [1, 2, 3])
+
+        let submesh = Submesh(.empty, 3..<9)
+        #expect(submesh.material == .empty)
+        #expect(submesh.indices.range == 3..<9)
+    }
+}
@@ -0,0 +1,65 @@
+//
+//  NormalsTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import Testing
+@testable import VimKit
+
+@Suite("Normals Tests",
+       .tags(.model))
+class NormalsTests {
+
+    @Test("Verify vertex normals")
+    func verifyVertexNormals() throws {
+        // A unit quad in the xy plane made of 2 faces that share an edge
+        let positions: [Float] = [
+            0, 0, 0,
+            1, 0, 0,
+            1, 1, 0,
+            0, 1, 0
+        ]
+        let indices: [UInt32] = [0, 1, 2, 0, 2, 3]
+
+        let data = positions.withUnsafeBufferPointer { positions in
+            indices.withUnsafeBufferPointer { indices in
+                Geometry.vertexNormals(positions: positions, indices: indices)
+            }
+        }
+        let normals: [Float] = data.unsafeTypeArray()
+        #expect(normals.count == positions.count)
+        for i in stride(from: 0, to: normals.count, by: 3) {
+            #expect(SIMD3<Float>(normals[i], normals[i+1], normals[i+2]) == [0, 0, 1])
+        }
+    }
+
+    @Test("Verify vertex normals are deterministic")
+    func verifyDeterministic() throws {
+        // A triangle fan around a shared center vertex
+        let segments = 1024
+        var positions: [Float] = [0, 0, 0]
+        var indices = [UInt32]()
+        for i in 0..<segments {
+            let angle = Float(i) / Float(segments) * 2 * .pi
+            positions.append(contentsOf: [cos(angle), sin(angle), Float(i % 7) * 0.1])
+            indices.append(contentsOf: [0, UInt32(i + 1), UInt32((i + 1) % segments + 1)])
+        }
+
+        let compute = { (chunkCount: Int) in
+            positions.withUnsafeBufferPointer { positions in
+                indices.withUnsafeBufferPointer { indices in
+                    Geometry.vertexNormals(positions: positions, indices: indices, chunkCount: chunkCount)
+                }
+            }
+        }
+
+        // The results must be bit for bit identical no matter how the work is split
+        let data = compute(1)
+        for chunkCount in [3, ProcessInfo.processInfo.activeProcessorCount * 4] {
+            #expect(compute(chunkCount) == data)
+        }
+    }
+}
@@ -0,0 +1,225 @@
+//
+//  OcclusionTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import MetalKit
+import simd
+import Testing
+@testable import VimKit
+import VimKitShaders
+
+@Suite("Occlusion Tests",
+       .tags(.model))
+class OcclusionTests {
+
+    /// Rasterizes a wall that fills the screen at y = 0 and builds the depth pyramid from it.
+    /// The wall is a single large triangle so no shared edge crosses the screen.
+    /// - Parameter projectionViewMatrix: the camera projection view matrix
+    /// - Returns: the rasterizer and the depth pyramid
+    private func wall(_ projectionViewMatrix: float4x4) -> (Geometry.DepthRasterizer, Geometry.DepthPyramid) {
+        var rasterizer = Geometry.DepthRasterizer(width: 128, height: 64)
+        rasterizer.rasterize([-1000, 0, -500], [1000, 0, -500], [0, 0, 1500], projectionViewMatrix: projectionViewMatrix)
+        let pyramid = Geometry.DepthPyramid(depth: rasterizer.depth, width: rasterizer.width, height: rasterizer.height)
+        return (rasterizer, pyramid)
+    }
+
+    /// Makes the per frame data from the camera.
+    private func makeFrame(_ camera: Vim.Camera) -> Frame {
+        var frame = Frame()
+        frame.cameras.0 = Camera(position: camera.position,
+                                 viewMatrix: camera.viewMatrix,
+                                 projectionMatrix: camera.projectionMatrix,
+                                 sceneTransform: camera.sceneTransform,
+                                 culling: camera.culling)
+        frame.enableContributionTesting = true
+        frame.minContributionArea = 0.0001
+        return frame
+    }
+
+    /// Makes the triangle hierarchy of a single mesh.
+    /// - Parameters:
+    ///   - positions: the vertex positions layed out in slices of [x,y,z]
+    ///   - indices: the corner indices (3 per face)
+    /// - Returns: the mesh hierarchy
+    private func hierarchy(_ positions: [Float], _ indices: [UInt32]) -> Geometry.MeshHierarchy {
+        let submeshes = [Submesh(.empty, 0..<indices.count)]
+        return positions.withUnsafeBufferPointer { positions in
+            indices.withUnsafeBufferPointer { indices in
+                submeshes.withUnsafeBufferPointer { submeshes in
+                    Geometry.MeshHierarchy(mesh: Mesh(0..<1), positions: positions, indices: indices, submeshes: submeshes)
+                }
+            }
+        }
+    }
+
+    /// The signed edge function of the point against the edge from a to b.
+    private func edge(_ a: SIMD3<Float>, _ b: SIMD3<Float>, _ p: SIMD2<Float>) -> Float {
+        (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)
+    }
+
+    @Test("Verify depth pyramid levels")
+    func verifyDepthPyramidLevels() throws {
+        let width = 13, height = 7
+        var generator = SeededRandomNumberGenerator(seed: 0xD397)
+        let depth = (0..<(width * height)).map { _ in Float.random(in: 0...1, using: &generator) }
+        let pyramid = Geometry.DepthPyramid(depth: depth, width: width, height: height)
+        #expect(pyramid.sizes == [[6, 3], [3, 1], [1, 1]])
+
+        // Every texel must hold the farthest depth of the texels below it (including the odd rows and columns)
+        #expect(pyramid.depth(level: 2, x: 0, y: 0) == depth.max())
+        for y in 0..<3 {
+            for x in 0..<6 {
+                let lowerX = x * width / 6, upperX = min(((x + 1) * width + 5) / 6, width)
+                let lowerY = y * height / 3, upperY = min(((y + 1) * height + 2) / 3, height)
+                var expected: Float = 0
+                for sy in lowerY..<upperY {
+                    for sx in lowerX..<upperX {
+                        expected = max(expected, depth[sy * width + sx])
+                    }
+                }
+                #expect(pyramid.depth(level: 0, x: x, y: y) == expected)
+            }
+        }
+    }
+
+    @Test("Verify occlusion")
+    func verifyOcclusion() throws {
+        let camera = Vim.Camera()
+        camera.look(in: .ypositive, from: [0, -50, 0])
+        let projectionViewMatrix = camera.projectionMatrix * camera.viewMatrix
+        let (rasterizer, pyramid) = wall(projectionViewMatrix)
+
+        // The wall covers the whole screen
+        #expect(!rasterizer.depth.contains(1))
+
+        // Behind the wall
+        #expect(pyramid.isOccluded(minBounds: [-2, 10, -2], maxBounds: [2, 14, 2], projectionViewMatrix: projectionViewMatrix))
+        // In front of the wall
+        #expect(!pyramid.isOccluded(minBounds: [-2, -14, -2], maxBounds: [2, -10, 2], projectionViewMatrix: projectionViewMatrix))
+        // Passing through the wall
+        #expect(!pyramid.isOccluded(minBounds: [-2, -2, -2], maxBounds: [2, 2, 2], projectionViewMatrix: projectionViewMatrix))
+        // Crossing the near plane
+        #expect(!pyramid.isOccluded(minBounds: [-2, -60, -2], maxBounds: [2, 20, 2], projectionViewMatrix: projectionViewMatrix))
+    }
+
+    @Test("Verify rasterization is inner conservative")
+    func verifyRasterization() throws {
+        let camera = Vim.Camera()
+        camera.look(in: .ypositive, from: [0, -50, 0])
+        let projectionViewMatrix = camera.projectionMatrix * camera.viewMatrix
+        let width = 128, height = 64
+
+        // Projects the point into pixel space (x, y) and depth (z) the same way the rasterizer does
+        let project = { (point: SIMD3<Float>) -> SIMD3<Float> in
+            let clip = projectionViewMatrix * SIMD4<Float>(point, 1)
+            let ndc = clip.xyz / clip.w
+            return [(ndc.x * 0.5 + 0.5) * Float(width), (0.5 - ndc.y * 0.5) * Float(height), ndc.z]
+        }
+
+        // Every written pixel must lie completely inside the projected triangle and must never be
+        // closer than the triangle surface anywhere inside the pixel
+        var generator = SeededRandomNumberGenerator(seed: 0x7A57)
+        var coveredCount = 0
+        for _ in 0..<32 {
+            let points = (0..<3).map { _ in
+                SIMD3<Float>(.random(in: -30...30, using: &generator), .random(in: -10...30, using: &generator), .random(in: -20...20, using: &generator))
+            }
+            var rasterizer = Geometry.DepthRasterizer(width: width, height: height)
+            rasterizer.rasterize(points[0], points[1], points[2], projectionViewMatrix: projectionViewMatrix)
+
+            let (a, b, c) = (project(points[0]), project(points[1]), project(points[2]))
+            let area = edge(a, b, SIMD2<Float>(c.x, c.y))
+            for y in 0..<height {
+                for x in 0..<width {
+                    let depth = rasterizer.depth[y * width + x]
+                    guard depth < 1 else { continue }
+                    coveredCount += 1
+                    let samples: [SIMD2<Float>] = [[0, 0], [1, 0], [0, 1], [1, 1], [0.5, 0.5]]
+                    for sample in samples {
+                        let p = SIMD2<Float>(Float(x), Float(y)) + sample
+                        let w0 = edge(b, c, p) / area
+                        let w1 = edge(c, a, p) / area
+                        let w2 = edge(a, b, p) / area
+                        #expect(min(w0, w1, w2) >= -0.0001)
+                        #expect(depth >= w0 * a.z + w1 * b.z + w2 * c.z - 0.00001)
+                    }
+                }
+            }
+        }
+        #expect(coveredCount > 0)
+
+        // A single small triangle never covers more pixels than it's bounds
+        var rasterizer = Geometry.DepthRasterizer(width: width, height: height)
+        rasterizer.rasterize([0, 0, 0], [10, 0, 0], [0, 0, 10], projectionViewMatrix: projectionViewMatrix)
+        let covered = rasterizer.depth.filter { $0 < 1 }
+        #expect(covered.isNotEmpty)
+        #expect(covered.count < rasterizer.depth.count / 4)
+
+        // A triangle behind the camera is skipped
+        var behind = Geometry.DepthRasterizer(width: width, height: height)
+        behind.rasterize([0, -100, 0], [10, -100, 0], [0, -100, 10], projectionViewMatrix: projectionViewMatrix)
+        #expect(!behind.depth.contains { $0 < 1 })
+    }
+
+    @Test("Verify culling results")
+    func verifyCullingResults() throws {
+        let camera = Vim.Camera()
+        camera.look(in: .ypositive, from: [0, -50, 0])
+        let frame = makeFrame(camera)
+
+        // Mesh 0 is a wall that fills the screen at y = 0, mesh 1 is a small triangle
+        let meshes = [
+            hierarchy([-1000, 0, -500, 1000, 0, -500, 0, 0, 1500], [0, 1, 2]),
+            hierarchy([0, 0, 0, 1, 0, 0, 0, 0, 1], [0, 1, 2])
+        ]
+
+        let box = { (center: SIMD3<Float>, mesh: Int) -> Instance in
+            var instance = Instance(index: 0, matrix: .identity, flags: .zero, parent: .empty, mesh: mesh, transparent: false)
+            instance.minBounds = center - 2
+            instance.maxBounds = center + 2
+            return instance
+        }
+        var wall = Instance(index: 0, matrix: .identity, flags: .zero, parent: .empty, mesh: 0, transparent: false)
+        wall.minBounds = [-1000, -1, -500]
+        wall.maxBounds = [1000, 1, 1500]
+        var hidden = box([0, -20, 0], 1)
+        hidden.state = .hidden
+
+        let instances = [
+            wall,
+            // Behind the wall
+            box([-10, 12, 0], 1), box([0, 12, 0], 1), box([10, 12, 0], 1),
+            // In front of the wall
+            box([-10, -12, 0], 1), box([10, -12, 0], 1),
+            // Behind the camera
+            box([0, -200, 0], 1),
+            hidden
+        ]
+
+        instances.withUnsafeBufferPointer { instances in
+            // Only the wall is rasterized and it hides the boxes behind it
+            let pyramid = Geometry.makeDepthPyramid(frame, instances: instances, width: 128, height: 64, occluderCount: 1) { meshes[$0] }
+            let projectionViewMatrix = camera.culling.projectionViewMatrix
+            #expect(pyramid.isOccluded(minBounds: instances[2].minBounds, maxBounds: instances[2].maxBounds, projectionViewMatrix: projectionViewMatrix))
+            #expect(!pyramid.isOccluded(minBounds: instances[4].minBounds, maxBounds: instances[4].maxBounds, projectionViewMatrix: projectionViewMatrix))
+
+            // Without any occluders nothing is hidden
+            let empty = Geometry.makeDepthPyramid(frame, instances: instances, width: 128, height: 64, occluderCount: 0) { meshes[$0] }
+            #expect(!empty.isOccluded(minBounds: instances[2].minBounds, maxBounds: instances[2].maxBounds, projectionViewMatrix: projectionViewMatrix))
+
+            let results = Geometry.cullingResults([frame, frame], instances: instances, occluderCount: 1) { meshes[$0] }
+            #expect(results.count == 2)
+            for result in results {
+                #expect(result.instanceCount == 8)
+                #expect(result.frustumVisibleCount == 6)
+                #expect(result.visibleCount == 3)
+                #expect(result.frustumCullRate == 2.0 / 8.0)
+                #expect(result.occlusionCullRate == 3.0 / 6.0)
+            }
+        }
+    }
+}
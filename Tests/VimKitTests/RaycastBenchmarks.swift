@@ -0,0 +1,80 @@
+//
+//  RaycastBenchmarks.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import Testing
+@testable import VimKit
+
+/// Benchmarks only run when explicitly requested (`VIMKIT_BENCHMARKS=1 swift test --filter Benchmarks`).
+private let benchmarksEnabled = ProcessInfo.processInfo.environment["VIMKIT_BENCHMARKS"] != nil
+
+@Suite("Raycast Benchmarks",
+       .enabled(if: benchmarksEnabled),
+       .tags(.benchmark))
+class RaycastBenchmarks {
+
+    @Test("Measure single rays vs ray packets")
+    func measureRayPackets() throws {
+        let size = 256
+        let (_, _, hierarchy) = BVHTests.heightField(size)
+
+        // A sampling grid of rays looking down onto the height field
+        var queries = [Geometry.RaycastQuery]()
+        for x in 0..<size {
+            for z in 0..<size {
+                queries.append(.init(origin: [Float(x) + 0.25, 10, Float(z) + 0.75], direction: normalize([0.1, -1, 0.05])))
+            }
+        }
+
+        var start = Date.now
+        var hits = 0
+        for query in queries where hierarchy.raycast(query) != nil {
+            hits += 1
+        }
+        let scalarTime = abs(start.timeIntervalSinceNow)
+
+        start = Date.now
+        var packetHits = 0
+        for p in stride(from: 0, to: queries.count, by: 4) {
+            var closest = SIMD4<Float>(repeating: .infinity)
+            hierarchy.raycast(Geometry.RayPacket(queries[p..<p + 4]), closest: &closest)
+            packetHits += (0..<4).filter { closest[$0] < .infinity }.count
+        }
+        let packetTime = abs(start.timeIntervalSinceNow)
+        #expect(hits == packetHits)
+
+        let rays = Double(queries.count) / 1_000_000
+        debugPrint("􀬨 Single rays [\(String(format: "%.2f", rays / scalarTime)) Mrays/s], ray packets [\(String(format: "%.2f", rays / packetTime)) Mrays/s]")
+    }
+
+    @Test("Measure batch raycasts")
+    func measureBatchRaycasts() throws {
+        let size = 256
+        let (_, _, hierarchy) = BVHTests.heightField(size)
+        var instance = Instance(index: 0, matrix: .identity, flags: .zero, parent: .empty, mesh: 0, transparent: false)
+        instance.minBounds = hierarchy.vertices.reduce(SIMD3<Float>(repeating: .infinity)) { simd_min($0, $1) }
+        instance.maxBounds = hierarchy.vertices.reduce(SIMD3<Float>(repeating: -.infinity)) { simd_max($0, $1) }
+        let instances = [instance]
+
+        var queries = [Geometry.RaycastQuery]()
+        for x in 0..<size * 2 {
+            for z in 0..<size * 2 {
+                queries.append(.init(origin: [Float(x) * 0.5 + 0.1, 10, Float(z) * 0.5 + 0.3], direction: normalize([0.1, -1, 0.05])))
+            }
+        }
+
+        let start = Date.now
+        let results = instances.withUnsafeBufferPointer { instances in
+            Geometry.raycast(batch: queries, instances: instances, bvh: nil) { _ in hierarchy }
+        }
+        let timeInterval = abs(start.timeIntervalSinceNow)
+        #expect(results.count == queries.count)
+
+        let rate = Double(queries.count) / Swift.max(timeInterval, .ulpOfOne) / 1_000_000
+        debugPrint("􀬨 Raycast [\(queries.count)] rays in [\(timeInterval.stringFromTimeInterval())] [\(String(format: "%.2f", rate)) Mrays/s]")
+    }
+}
@@ -0,0 +1,30 @@
+//
+//  SeededRandomNumberGenerator.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+
+/// A deterministic SplitMix64 generator so tests that use random data can be reproduced from their seed.
+/// See: https://prng.di.unimi.it/splitmix64.c
+struct SeededRandomNumberGenerator: RandomNumberGenerator {
+
+    /// The generator state.
+    private var state: UInt64
+
+    /// Initializes the generator with the specified seed.
+    /// - Parameter seed: the seed
+    init(seed: UInt64) {
+        self.state = seed
+    }
+
+    mutating func next() -> UInt64 {
+        state &+= 0x9E37_79B9_7F4A_7C15
+        var z = state
+        z = (z ^ (z >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+        return z ^ (z >> 31)
+    }
+}
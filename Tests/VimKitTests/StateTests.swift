@@ -0,0 +1,70 @@
+//
+//  StateTests.swift
+//  VimKit
+//
+//  Created by Kevin McKee
+//
+
+import Foundation
+import Testing
+@testable import VimKit
+import VimKitShaders
+
+@Suite("State Tests",
+       .tags(.model))
+class StateTests {
+
+    @Test("Verify slot set")
+    func verifySlotSet() throws {
+        var set = Geometry.SlotSet(capacity: 130, filled: true)
+        #expect(set.count == 130)
+        #expect(Array(set) == Array(0..<130))
+
+        #expect(set.remove(64))
+        #expect(!set.remove(64))
+        #expect(!set.contains(64))
+        #expect(set.count == 129)
+
+        set = Geometry.SlotSet(capacity: 130)
+        for slot in [129, 3, 64, 63] {
+            #expect(set.insert(slot))
+        }
+        #expect(!set.insert(3))
+        #expect(set.count == 4)
+        #expect(Array(set) == [3, 63, 64, 129])
+    }
+
+    @Test("Verify instance states")
+    func verifyInstanceStates() throws {
+        let count = 100
+        var states = Geometry.InstanceStates(count: count)
+        #expect(states.count(state: .default) == count)
+
+        for slot in 10..<20 {
+            states.set(.hidden, at: slot)
+        }
+        states.set(.selected, at: 50)
+        #expect(states.count(state: .hidden) == 10)
+        #expect(states.count(state: .selected) == 1)
+        #expect(states.count(state: .default) == count - 11)
+        #expect(states.state(at: 50) == .selected)
+
+        // Colors are reference counted
+        states.set(colorIndex: 2, at: 1)
+        states.set(colorIndex: 2, at: 2)
+        #expect(states.set(colorIndex: .empty, at: 1) == nil)
+        #expect(states.set(colorIndex: .empty, at: 2) == 2)
+
+        // Only the dirty ranges are written into the instances
+        #expect(Array(states.dirty.ranges) == [1..<3, 10..<20, 50..<51])
+        var instances = [Instance](repeating: Instance(), count: count)
+        instances.withUnsafeMutableBufferPointer { pointer in
+            states.flush(to: pointer)
+        }
+        #expect(states.dirty.isEmpty)
+        #expect(instances.filter { $0.state == .hidden }.count == 10)
+        #expect(instances[50].state == .selected)
+        #expect(instances[1].colorIndex == .empty)
+        #expect(instances[0].colorIndex == .zero) // Never written
+    }
+}
@@ -10,6 +10,7 @@ import Foundation
 import Testing
 
 extension Tag {
+    @Tag static var benchmark: Self
     @Tag static var database: Self
     @Tag static var reader: Self
     @Tag static var model: Self